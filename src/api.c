@@ -9,6 +9,7 @@
 #include "ffmpeg.h"
 #include "progress.h"
 #include "stream.h"
+#include "tpool.h"
 #include "version.h"
 
 static bool g_ready = false;
@@ -25,7 +26,9 @@ static BOOL ffmpeg_input_info_get(INPUT_HANDLE ih, INPUT_INFO *iip) {
         .biSize = sizeof(BITMAPINFOHEADER),
         .biWidth = vi->width,
         .biHeight = vi->height,
-        .biCompression = vi->is_rgb ? MAKEFOURCC('B', 'G', 'R', 0) : MAKEFOURCC('Y', 'U', 'Y', '2'),
+        .biCompression = vi->is_rgb    ? MAKEFOURCC('B', 'G', 'R', 0)
+                         : vi->is_yc48 ? MAKEFOURCC('Y', 'C', '4', '8')
+                                       : MAKEFOURCC('Y', 'U', 'Y', '2'),
         .biBitCount = (WORD)vi->bit_depth,
     };
     iip->flag |= INPUT_INFO_FLAG_VIDEO | INPUT_INFO_FLAG_VIDEO_RANDOM_ACCESS;
@@ -57,12 +60,11 @@ static BOOL ffmpeg_input_info_get(INPUT_HANDLE ih, INPUT_INFO *iip) {
 }
 
 static int ffmpeg_input_read_video_ex(INPUT_HANDLE ih, int frame, void *buf, bool const saving) {
-  (void)saving;
   if (!g_ready) {
     return 0;
   }
   size_t wr = 0;
-  error err = streammap_read_video(g_smp, (intptr_t)ih, (int64_t)frame, buf, &wr);
+  error err = streammap_read_video(g_smp, (intptr_t)ih, (int64_t)frame, buf, &wr, saving);
   if (efailed(err)) {
     ereport(err);
     return 0;
@@ -276,6 +278,7 @@ cleanup:
 
 static BOOL ffmpeg_input_exit(void) {
   streammap_destroy(&g_smp);
+  tpool_exit();
   for (size_t i = 0; i < sizeof(ffmpeg_dll_handles) / sizeof(ffmpeg_dll_handles[0]); ++i) {
     if (ffmpeg_dll_handles[i]) {
       FreeLibrary(ffmpeg_dll_handles[i]);
@@ -328,6 +331,44 @@ static struct combo_items const number_of_streams[] = {
     {0},
 };
 
+static struct combo_items const idle_timeouts[] = {
+    {0, L"閉じない"},
+    {30, L"30秒"},
+    {60, L"1分"},
+    {180, L"3分"},
+    {600, L"10分"},
+    {0},
+};
+
+static struct combo_items const memory_budgets[] = {
+    {0, L"制限なし"},
+    {512, L"512MB"},
+    {1024, L"1GB"},
+    {1536, L"1.5GB"},
+    {2048, L"2GB"},
+    {3072, L"3GB"},
+    {0},
+};
+
+static struct combo_items const convert_bands[] = {
+    {0, L"自動"},
+    {1, L"1"},
+    {2, L"2"},
+    {4, L"4"},
+    {8, L"8"},
+    {16, L"16"},
+    {0},
+};
+
+static struct combo_items const max_resolutions[] = {
+    {0, L"制限なし"},
+    {2160, L"3840x2160"},
+    {1440, L"2560x1440"},
+    {1080, L"1920x1080"},
+    {720, L"1280x720"},
+    {0},
+};
+
 static struct combo_items const audio_index_modes[] = {
     {aim_noindex, L"なし"},
     {aim_relax, L"リラックス"},
@@ -362,11 +403,19 @@ enum config_control {
   ID_EDT_DECODERS = 1001,
   ID_CMB_HANDLE_MANAGE_MODE = 1002,
   ID_CMB_NUMBER_OF_STREAMS = 1003,
+  ID_CMB_IDLE_TIMEOUT = 1004,
+  ID_CMB_MEMORY_BUDGET = 1005,
   ID_CMB_VIDEO_SCALING = 2000,
+  ID_CMB_VIDEO_CONVERT_BANDS = 2001,
+  ID_CHK_VIDEO_OUTPUT_YC48 = 2002,
+  ID_CHK_VIDEO_DITHER = 2003,
+  ID_CMB_VIDEO_MAX_RESOLUTION = 2004,
+  ID_CHK_VIDEO_FAST_PREVIEW = 2005,
   ID_CMB_AUDIO_INDEX_MODE = 3000,
   ID_CMB_AUDIO_SAMPLE_RATE = 3001,
   ID_CHK_AUDIO_USE_SOX = 3002,
   ID_CHK_AUDIO_INVERT_PHASE = 3003,
+  ID_CHK_AUDIO_DECODE_TRACK = 3004,
 };
 
 static wchar_t *ver_to_str(wchar_t *const buf, char const *const ident, unsigned int ver) {
@@ -415,11 +464,19 @@ static INT_PTR CALLBACK config_wndproc(HWND const dlg, UINT const message, WPARA
     SetWindowTextA(GetDlgItem(dlg, ID_EDT_DECODERS), config_get_preferred_decoders(pr->config));
     set_combo(dlg, ID_CMB_HANDLE_MANAGE_MODE, handle_manage_modes, (int)(config_get_handle_manage_mode(pr->config)));
     set_combo(dlg, ID_CMB_NUMBER_OF_STREAMS, number_of_streams, (int)(config_get_number_of_stream(pr->config)));
+    set_combo(dlg, ID_CMB_IDLE_TIMEOUT, idle_timeouts, (int)(config_get_idle_timeout(pr->config)));
+    set_combo(dlg, ID_CMB_MEMORY_BUDGET, memory_budgets, (int)(config_get_memory_budget(pr->config)));
     set_combo(dlg, ID_CMB_VIDEO_SCALING, scaling_algorithms, (int)(config_get_scaling(pr->config)));
+    set_combo(dlg, ID_CMB_VIDEO_CONVERT_BANDS, convert_bands, config_get_convert_bands(pr->config));
+    set_check(dlg, ID_CHK_VIDEO_OUTPUT_YC48, config_get_output_yc48(pr->config));
+    set_check(dlg, ID_CHK_VIDEO_DITHER, config_get_dither(pr->config));
+    set_combo(dlg, ID_CMB_VIDEO_MAX_RESOLUTION, max_resolutions, config_get_max_resolution(pr->config));
+    set_check(dlg, ID_CHK_VIDEO_FAST_PREVIEW, config_get_fast_preview(pr->config));
     set_combo(dlg, ID_CMB_AUDIO_INDEX_MODE, audio_index_modes, (int)(config_get_audio_index_mode(pr->config)));
     set_combo(dlg, ID_CMB_AUDIO_SAMPLE_RATE, audio_sample_rates, (int)(config_get_audio_sample_rate(pr->config)));
     set_check(dlg, ID_CHK_AUDIO_USE_SOX, config_get_audio_use_sox(pr->config));
     set_check(dlg, ID_CHK_AUDIO_INVERT_PHASE, config_get_audio_invert_phase(pr->config));
+    set_check(dlg, ID_CHK_AUDIO_DECODE_TRACK, config_get_audio_decode_track(pr->config));
     return TRUE;
   }
   case WM_DESTROY:
@@ -446,6 +503,16 @@ static INT_PTR CALLBACK config_wndproc(HWND const dlg, UINT const message, WPARA
         err = ethru(err);
         goto cleanup;
       }
+      err = config_set_idle_timeout(pr->config, get_combo(dlg, ID_CMB_IDLE_TIMEOUT, idle_timeouts));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+      err = config_set_memory_budget(pr->config, get_combo(dlg, ID_CMB_MEMORY_BUDGET, memory_budgets));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
       err = config_set_need_postfix(pr->config, get_check(dlg, ID_CHK_NEED_POSTFIX));
       if (efailed(err)) {
         err = ethru(err);
@@ -472,6 +539,31 @@ static INT_PTR CALLBACK config_wndproc(HWND const dlg, UINT const message, WPARA
         err = ethru(err);
         goto cleanup;
       }
+      err = config_set_convert_bands(pr->config, get_combo(dlg, ID_CMB_VIDEO_CONVERT_BANDS, convert_bands));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+      err = config_set_output_yc48(pr->config, get_check(dlg, ID_CHK_VIDEO_OUTPUT_YC48));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+      err = config_set_dither(pr->config, get_check(dlg, ID_CHK_VIDEO_DITHER));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+      err = config_set_max_resolution(pr->config, get_combo(dlg, ID_CMB_VIDEO_MAX_RESOLUTION, max_resolutions));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+      err = config_set_fast_preview(pr->config, get_check(dlg, ID_CHK_VIDEO_FAST_PREVIEW));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
       err = config_set_audio_index_mode(
           pr->config, (enum audio_index_mode)(get_combo(dlg, ID_CMB_AUDIO_INDEX_MODE, audio_index_modes)));
       if (efailed(err)) {
@@ -494,6 +586,11 @@ static INT_PTR CALLBACK config_wndproc(HWND const dlg, UINT const message, WPARA
         err = ethru(err);
         goto cleanup;
       }
+      err = config_set_audio_decode_track(pr->config, get_check(dlg, ID_CHK_AUDIO_DECODE_TRACK));
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
     cleanup:
       ereport(sfree(&s));
       if (efailed(err)) {
@@ -7,7 +7,10 @@
 #include "audioidx.h"
 #include "ffmpeg.h"
 #include "now.h"
+#include "pcmcache.h"
+#include "pcmfile.h"
 #include "resampler.h"
+#include "tpool.h"
 
 #define SHOWLOG_AUDIO_GET_INFO 0
 #define SHOWLOG_AUDIO_REPORT_INDEX_ENTRIES 0
@@ -15,12 +18,18 @@
 #define SHOWLOG_AUDIO_SEEK_SPEED 0
 #define SHOWLOG_AUDIO_READ 0
 #define SHOWLOG_AUDIO_GAP 0
+#define SHOWLOG_AUDIO_HIBERNATE 0
 
 // osr = original sample rate
 // asr = active sample rate
+// A pool member whose ffmpeg.cctx is NULL is hibernating, it is reopened when a read chooses it.
 struct stream {
   struct ffmpeg_stream ffmpeg;
   struct timespec ts;
+  // Unused members count as idle from the time they were opened.
+  struct timespec opened_at;
+  // Set when the position came from seek_estimated or from the pts, it may be off until the next seek.
+  bool estimated;
 };
 
 enum status {
@@ -36,15 +45,21 @@ struct audio {
 
   struct wstr filepath;
   void *handle;
+  // Kept so that pool members can be opened without probing the decoders again.
+  AVCodec const *codec;
   mtx_t mtx;
-  thrd_t thread;
+  struct tpool_group group;
   enum status status;
+  // number of streams that are opened or being opened.
+  size_t claimed;
 
   int64_t valid_first_sample_pos_asr;
   int out_sample_rate;
   struct audioidx *idx;
   enum audio_index_mode index_mode;
   bool wait_index;
+  struct pcmcache *cache;
+  struct pcmfile *track;
 };
 
 static inline int64_t get_start_time(struct stream const *const stream) {
@@ -107,22 +122,54 @@ void audio_get_info(struct audio const *const a, struct info_audio *const ai) {
 #endif
 }
 
-static NODISCARD error seek(struct audio *const a,
-                            struct resampler *const resampler,
-                            struct stream *stream,
-                            int64_t const sample,
-                            int64_t *sample_pos_osr) {
-  (void)a;
-#if SHOWLOG_AUDIO_REPORT_INDEX_ENTRIES
-  {
-    char s[256];
-    ov_snprintf(s, 256, NULL, "a index entries: %d", avformat_index_get_entries_count(stream->ffmpeg.stream));
-    OutputDebugStringA(s);
+// Returns the sample position of the current frame.
+// Once a seek has started the indexer, the index gives the exact position, the pts is only an estimate in some formats.
+// *estimated is set when the position comes from the pts.
+static int64_t get_frame_pos_osr(struct audio *const a, struct stream const *const stream, bool *const estimated) {
+  if (a->idx) {
+    int64_t const pos = audioidx_get(a->idx, stream->ffmpeg.frame->pts, false);
+    if (pos >= 0) {
+      *estimated = false;
+      return pos;
+    }
   }
-#endif
-#if SHOWLOG_AUDIO_SEEK_SPEED
-  double const start = now();
-#endif
+  *estimated = true;
+  return pts_to_sample_pos_osr(stream->ffmpeg.frame->pts, stream);
+}
+
+// Seeks to the packet found in the index.
+// The decoder starts at an earlier packet so that its state has settled by the time the packet is decoded,
+// the frames before the packet are discarded.
+static NODISCARD error seek_packet(struct audio *const a,
+                                   struct stream *const stream,
+                                   struct audioidx_entry const *const e) {
+  int64_t start_pts = e->pts;
+  if (e->pos > 0) {
+    int const preroll = stream->ffmpeg.stream->codecpar->seek_preroll;
+    struct audioidx_entry prev;
+    if (audioidx_find(a->idx, e->pos - (preroll > 1 ? preroll : 1), false, &prev)) {
+      start_pts = prev.pts;
+    }
+  }
+  error err = ffmpeg_seek(&stream->ffmpeg, start_pts);
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  // The demuxer may also land on an earlier packet.
+  do {
+    int const r = ffmpeg_grab(&stream->ffmpeg);
+    if (r < 0) {
+      return errffmpeg(r);
+    }
+  } while (stream->ffmpeg.frame->pts != AV_NOPTS_VALUE && stream->ffmpeg.frame->pts < e->pts);
+  return eok();
+}
+
+// Seeks to the timestamp estimated from the sample and steps back until the frame is not after the sample.
+static NODISCARD error seek_estimated(struct audio *const a,
+                                      struct resampler *const resampler,
+                                      struct stream *const stream,
+                                      int64_t const sample) {
   error err = eok();
   int64_t time_stamp = sample_pos_osr_to_pts(sample, stream);
   int64_t const duration1s = (int64_t)(av_q2d(av_inv_q(stream->ffmpeg.cctx->pkt_timebase)));
@@ -168,6 +215,46 @@ static NODISCARD error seek(struct audio *const a,
     }
     break;
   }
+cleanup:
+  return err;
+}
+
+static NODISCARD error seek(struct audio *const a,
+                            struct resampler *const resampler,
+                            struct stream *stream,
+                            int64_t const sample,
+                            int64_t *sample_pos_osr) {
+#if SHOWLOG_AUDIO_REPORT_INDEX_ENTRIES
+  {
+    char s[256];
+    ov_snprintf(s, 256, NULL, "a index entries: %d", avformat_index_get_entries_count(stream->ffmpeg.stream));
+    OutputDebugStringA(s);
+  }
+#endif
+#if SHOWLOG_AUDIO_SEEK_SPEED
+  double const start = now();
+#endif
+  error err = eok();
+  // The index knows which packet contains the sample, so the decoder starts right there.
+  // Without it, the seek lands around the estimated timestamp and decodes forward.
+  bool landed = false;
+  bool estimated = false;
+  struct audioidx_entry e;
+  if (a->idx && audioidx_find(a->idx, sample, a->wait_index, &e)) {
+    err = seek_packet(a, stream, &e);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+    landed = get_frame_pos_osr(a, stream, &estimated) <= sample;
+  }
+  if (!landed) {
+    err = seek_estimated(a, resampler, stream, sample);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+  }
 #if 0
   if (stream->resampled_current_pos_isr < sample) {
     // https://ffmpeg.org/doxygen/6.0/group__lavc__packet.html#gga9a80bfcacc586b483a973272800edb97a2093332d8086d25a04942ede61007f6a
@@ -194,7 +281,9 @@ static NODISCARD error seek(struct audio *const a,
     }
   }
 #endif
-  int64_t pos_osr = pts_to_sample_pos_osr(stream->ffmpeg.frame->pts, stream);
+  int64_t pos_osr = get_frame_pos_osr(a, stream, &estimated);
+  // The position of the following frames is counted from this one.
+  stream->estimated = !landed || estimated;
   while (pos_osr + stream->ffmpeg.frame->nb_samples <= sample) {
     pos_osr += stream->ffmpeg.frame->nb_samples;
     // It seems we should not use ffmpeg_grab_discard here.
@@ -244,81 +333,123 @@ static NODISCARD error read_buffer(
   return eok();
 }
 
-static NODISCARD error grab_next_frame(struct resampler *const resampler, struct stream *const stream) {
+// Converts the current frame that starts at frame_pos_asr into the resampled buffer.
+// With passthrough, a frame that starts at the read position and fits in the rest of the request
+// is converted straight into dest instead, and the buffer is left empty at the end of the frame.
+static NODISCARD error resample_frame(struct resampler *const resampler,
+                                      struct stream *const stream,
+                                      int64_t const frame_pos_asr,
+                                      int64_t const readpos_asr,
+                                      int const length,
+                                      int *read,
+                                      uint8_t *const dest) {
+  error err = resampler_set_input(resampler, stream->ffmpeg.frame);
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  int const nb_samples = stream->ffmpeg.frame->nb_samples;
+  bool const direct = resampler->passthrough && frame_pos_asr == readpos_asr && nb_samples <= length - *read;
+  int written = direct ? length - *read : resampler->samples;
+  err = resampler_resample(resampler,
+                           stream->ffmpeg.frame->data,
+                           nb_samples,
+                           direct ? dest + *read * resampler_out_sample_size : resampler->buf,
+                           &written);
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  if (direct) {
+    *read += written;
+    resampler->pos = frame_pos_asr + written;
+    resampler->written = 0;
+  } else {
+    resampler->pos = frame_pos_asr;
+    resampler->written = written;
+  }
+  resampler->estimated = stream->estimated;
+  return eok();
+}
+
+static NODISCARD error grab_next_frame(struct resampler *const resampler,
+                                       struct stream *const stream,
+                                       int64_t const readpos_asr,
+                                       int const length,
+                                       int *read,
+                                       uint8_t *const dest) {
 #if SHOWLOG_AUDIO_READ
   OutputDebugStringA(__FILE_NAME__ " grab_next_frame");
 #endif
-  int r = ffmpeg_grab(&stream->ffmpeg);
-  if (r < 0) {
-    return errffmpeg(r);
-  }
-  r = swr_convert(resampler->ctx,
-                  (void *)&resampler->buf,
-                  resampler->samples,
-                  (void *)stream->ffmpeg.frame->data,
-                  stream->ffmpeg.frame->nb_samples);
+  int const r = ffmpeg_grab(&stream->ffmpeg);
   if (r < 0) {
     return errffmpeg(r);
   }
-  resampler->pos += resampler->written;
-  resampler->written = r;
+  int64_t const frame_pos_asr = resampler->pos + resampler->written;
 #if SHOWLOG_AUDIO_GAP
   int64_t const pts_pos =
       pts_to_sample_pos_osr(stream->ffmpeg.frame->pts, stream) * resampler->gcd.factor_b / resampler->gcd.factor_a;
-  if (resampler->pos != pts_pos) {
+  if (frame_pos_asr != pts_pos) {
     char s[256];
-    ov_snprintf(s, 256, NULL, "pos gap: %lld %lld", resampler->pos, pts_pos);
+    ov_snprintf(s, 256, NULL, "pos gap: %lld %lld", frame_pos_asr, pts_pos);
     OutputDebugStringA(s);
   }
 #endif
+  error err = resample_frame(resampler, stream, frame_pos_asr, readpos_asr, length, read, dest);
+  if (efailed(err)) {
+    return ethru(err);
+  }
   return eok();
 }
 
 static NODISCARD error seek_frame(struct audio *const a,
                                   struct resampler *const resampler,
                                   struct stream *const stream,
-                                  int64_t const pos_osr) {
+                                  int64_t const readpos_asr,
+                                  int const length,
+                                  int *read,
+                                  uint8_t *const dest) {
 #if SHOWLOG_AUDIO_READ
   OutputDebugStringA(__FILE_NAME__ " seek_frame");
 #endif
   int64_t real_current_pos_osr;
-  error err = seek(a, resampler, stream, pos_osr, &real_current_pos_osr);
+  error err = seek(
+      a, resampler, stream, readpos_asr * resampler->gcd.factor_a / resampler->gcd.factor_b, &real_current_pos_osr);
   if (efailed(err)) {
     return ethru(err);
   }
 
-  int r = swr_init(resampler->ctx);
-  if (r < 0) {
-    return errffmpeg(r);
+  if (!resampler->passthrough && !resampler->pcmconv) {
+    int const r = swr_init(resampler->ctx);
+    if (r < 0) {
+      return errffmpeg(r);
+    }
   }
-  r = swr_convert(resampler->ctx,
-                  (void *)&resampler->buf,
-                  resampler->samples,
-                  (void *)stream->ffmpeg.frame->data,
-                  stream->ffmpeg.frame->nb_samples);
-  if (r < 0) {
-    return errffmpeg(r);
+  err = resample_frame(resampler,
+                       stream,
+                       real_current_pos_osr * resampler->gcd.factor_b / resampler->gcd.factor_a,
+                       readpos_asr,
+                       length,
+                       read,
+                       dest);
+  if (efailed(err)) {
+    return ethru(err);
   }
-  resampler->pos = real_current_pos_osr * resampler->gcd.factor_b / resampler->gcd.factor_a;
-  resampler->written = r;
   return eok();
 }
 
-static NODISCARD error convert_frame(struct resampler *const resampler, struct stream *const stream) {
+static NODISCARD error convert_frame(struct resampler *const resampler,
+                                     struct stream *const stream,
+                                     int64_t const frame_pos_asr,
+                                     int64_t const readpos_asr,
+                                     int const length,
+                                     int *read,
+                                     uint8_t *const dest) {
 #if SHOWLOG_AUDIO_READ
   OutputDebugStringA(__FILE_NAME__ " convert_frame");
 #endif
-  int r = swr_convert(resampler->ctx,
-                      (void *)&resampler->buf,
-                      resampler->samples,
-                      (void *)stream->ffmpeg.frame->data,
-                      stream->ffmpeg.frame->nb_samples);
-  if (r < 0) {
-    return errffmpeg(r);
+  error err = resample_frame(resampler, stream, frame_pos_asr, readpos_asr, length, read, dest);
+  if (efailed(err)) {
+    return ethru(err);
   }
-  resampler->pos =
-      pts_to_sample_pos_osr(stream->ffmpeg.frame->pts, stream) * resampler->gcd.factor_b / resampler->gcd.factor_a;
-  resampler->written = r;
   return eok();
 }
 
@@ -346,6 +477,8 @@ static NODISCARD error stream_read(struct audio *const a,
   error err = eok();
   uint8_t *dest = buf;
   int read = 0;
+  // Samples converted at an estimated position are not cached, a later read may find the exact ones.
+  bool exact = true;
 
   while (read < length) {
     int64_t const readpos_asr = offset_asr + read;
@@ -360,6 +493,7 @@ static NODISCARD error stream_read(struct audio *const a,
 
     // Is the data we want in the resampled buffer?
     if (readpos_asr >= resampler->pos && readpos_asr < resampler->pos + resampler->written) {
+      exact = exact && !resampler->estimated;
       err = read_buffer(resampler, readpos_asr, length, &read, dest);
       if (efailed(err)) {
         goto cleanup;
@@ -368,33 +502,38 @@ static NODISCARD error stream_read(struct audio *const a,
     }
 
     // Is the data we want in the current frame?
-    int64_t const frame_pos_osr = pts_to_sample_pos_osr(stream->ffmpeg.frame->pts, stream);
+    bool frame_pos_estimated = false;
+    int64_t const frame_pos_osr = get_frame_pos_osr(a, stream, &frame_pos_estimated);
     int64_t const frame_pos_asr = frame_pos_osr * resampler->gcd.factor_b / resampler->gcd.factor_a;
     int64_t const frame_end_pos_asr =
         (frame_pos_osr + stream->ffmpeg.frame->nb_samples) * resampler->gcd.factor_b / resampler->gcd.factor_a;
     if (readpos_asr >= frame_pos_asr && readpos_asr < frame_end_pos_asr) {
-      err = convert_frame(resampler, stream);
+      stream->estimated = stream->estimated || frame_pos_estimated;
+      err = convert_frame(resampler, stream, frame_pos_asr, readpos_asr, length, &read, dest);
       if (efailed(err)) {
         goto cleanup;
       }
+      exact = exact && !resampler->estimated;
       continue;
     }
     // Is the data we want in the next frame?
     int64_t const next_frame_end_pos_asr =
         (frame_pos_osr + stream->ffmpeg.frame->nb_samples * 2) * resampler->gcd.factor_b / resampler->gcd.factor_a;
     if (readpos_asr >= frame_end_pos_asr && readpos_asr < next_frame_end_pos_asr) {
-      err = grab_next_frame(resampler, stream);
+      err = grab_next_frame(resampler, stream, readpos_asr, length, &read, dest);
       if (efailed(err)) {
         goto cleanup;
       }
+      exact = exact && !resampler->estimated;
       continue;
     }
 
     // The data we want cannot be obtained without seeking.
-    err = seek_frame(a, resampler, stream, readpos_asr * resampler->gcd.factor_a / resampler->gcd.factor_b);
+    err = seek_frame(a, resampler, stream, readpos_asr, length, &read, dest);
     if (efailed(err)) {
       goto cleanup;
     }
+    exact = exact && !resampler->estimated;
   }
 
 cleanup:
@@ -412,6 +551,9 @@ cleanup:
       ereport(err);
     }
   }
+  if (a->cache && exact && read > 0) {
+    ereport(pcmcache_write(a->cache, offset_asr, read, buf));
+  }
   if (read < length) {
     memset(dest + (read * resampler_out_sample_size), 0, (size_t)((length - read) * resampler_out_sample_size));
     read = length;
@@ -420,36 +562,105 @@ cleanup:
   return err;
 }
 
-static int create_sub_stream(void *userdata) {
+// Pool members are opened concurrently by up to this many tasks per file.
+static size_t const max_parallel_open = 4;
+
+// Opens a pool member, the stream keeps its ts.
+static NODISCARD error open_member(struct audio *const a, struct stream *const stream) {
+  *stream = (struct stream){
+      .ts = stream->ts,
+  };
+  timespec_get(&stream->opened_at, TIME_UTC);
+  error err = ffmpeg_open(&stream->ffmpeg,
+                          &(struct ffmpeg_open_options){
+                              .filepath = a->filepath.ptr,
+                              .handle = a->handle,
+                              .media_type = AVMEDIA_TYPE_AUDIO,
+                              .codec = a->codec,
+                              .try_grab = false,
+                          });
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  return eok();
+}
+
+static inline bool is_hibernating(struct stream const *const stream) { return !stream->ffmpeg.cctx; }
+
+static inline bool is_older(struct timespec const *const a, struct timespec const *const b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+void audio_hibernate(struct audio *const a, int const idle_seconds) {
+  if (!a || idle_seconds < 0) {
+    return;
+  }
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  // Pool members may be appended by create_sub_stream meanwhile, so the lock is held until they are closed.
+  mtx_lock(&a->mtx);
+  size_t const len = a->len;
+  // The most recently used member stays open and is moved to the front, since the information is read from streams[0].
+  size_t mru = 0;
+  for (size_t i = 1; i < len; ++i) {
+    if (is_older(&a->streams[mru].ts, &a->streams[i].ts)) {
+      mru = i;
+    }
+  }
+  if (mru) {
+    struct stream const tmp = a->streams[0];
+    a->streams[0] = a->streams[mru];
+    a->streams[mru] = tmp;
+  }
+  size_t closed = 0;
+  for (size_t i = 1; i < len; ++i) {
+    struct stream *const stream = a->streams + i;
+    struct timespec const *const last = is_older(&stream->ts, &stream->opened_at) ? &stream->opened_at : &stream->ts;
+    if (is_hibernating(stream) || now.tv_sec - last->tv_sec < idle_seconds) {
+      continue;
+    }
+    ffmpeg_close(&stream->ffmpeg);
+    *stream = (struct stream){
+        .ts = stream->ts,
+    };
+    ++closed;
+  }
+  mtx_unlock(&a->mtx);
+#if SHOWLOG_AUDIO_HIBERNATE
+  if (closed) {
+    char s[256];
+    ov_snprintf(s, 256, NULL, "a hibernate: %zu of %zu members closed", closed, len);
+    OutputDebugStringA(s);
+  }
+#else
+  (void)closed;
+#endif
+}
+
+static void create_sub_stream(void *const userdata) {
   struct audio *const a = userdata;
   for (;;) {
     mtx_lock(&a->mtx);
-    size_t const cap = a->cap;
-    size_t const len = a->len;
-    enum status st = a->status;
+    bool const claimed = a->status != status_closing && a->claimed < a->cap;
+    if (claimed) {
+      ++a->claimed;
+    }
     mtx_unlock(&a->mtx);
-    if (st == status_closing || cap == len) {
+    if (!claimed) {
       break;
     }
-    a->streams[len] = (struct stream){0};
-    error err = ffmpeg_open(&a->streams[len].ffmpeg,
-                            &(struct ffmpeg_open_options){
-                                .filepath = a->filepath.ptr,
-                                .handle = a->handle,
-                                .media_type = AVMEDIA_TYPE_AUDIO,
-                                .codec = a->streams[0].ffmpeg.codec,
-                                .try_grab = false,
-                            });
+    struct stream stream = {0};
+    error err = open_member(a, &stream);
     if (efailed(err)) {
       err = ethru(err);
       ereport(err);
       break;
     }
+    // find_stream only looks at streams[0..len), so the new member becomes usable as soon as len is updated.
     mtx_lock(&a->mtx);
-    ++a->len;
+    a->streams[a->len++] = stream;
     mtx_unlock(&a->mtx);
   }
-  return 0;
 }
 
 static struct stream *find_stream(struct audio *const a, struct gcd const gcd, int64_t const offset) {
@@ -458,7 +669,13 @@ static struct stream *find_stream(struct audio *const a, struct gcd const gcd, i
   mtx_lock(&a->mtx);
   size_t const num_stream = a->len;
   if (a->status == status_nothread && a->cap > 1) {
-    if (thrd_create(&a->thread, create_sub_stream, a) == thrd_success) {
+    size_t const n = a->cap - 1 < max_parallel_open ? a->cap - 1 : max_parallel_open;
+    for (size_t i = 0; i < n; ++i) {
+      error err = tpool_submit(tpool_priority_prefetch, &a->group, create_sub_stream, a);
+      if (efailed(err)) {
+        ereport(err);
+        break;
+      }
       a->status = status_running;
     }
   }
@@ -468,6 +685,13 @@ static struct stream *find_stream(struct audio *const a, struct gcd const gcd, i
   struct stream *oldest = NULL;
   for (size_t i = 0; i < num_stream; ++i) {
     struct stream *stream = a->streams + i;
+    // Hibernating members are the least recently used, so they are only chosen to seek.
+    if (is_hibernating(stream)) {
+      if (oldest == NULL || is_older(&stream->ts, &oldest->ts)) {
+        oldest = stream;
+      }
+      continue;
+    }
     int64_t const pos_osr = pts_to_sample_pos_osr(stream->ffmpeg.frame->pts, stream);
     int64_t const pos = pos_osr * gcd.factor_b / gcd.factor_a;
     int64_t const pos_end = (pos_osr + stream->ffmpeg.frame->nb_samples) * gcd.factor_b / gcd.factor_a;
@@ -500,7 +724,30 @@ NODISCARD error audio_read(struct audio *const a,
                            int *const written,
                            bool const accurate) {
   a->wait_index = (a->index_mode == aim_strict) || accurate;
-  return stream_read(a, r, find_stream(a, r->gcd, offset), offset, length, buf, written);
+  // The decoded track and the cache serve what they have, only the rest is decoded here.
+  int cached = pcmfile_read(a->track, offset, length, buf);
+  if (cached < length) {
+    cached += pcmcache_read(
+        a->cache, offset + cached, length - cached, (uint8_t *)buf + cached * resampler_out_sample_size);
+  }
+  if (cached == length) {
+    *written = length;
+    return eok();
+  }
+  int wr = 0;
+  int64_t const pos = offset + cached;
+  uint8_t *const dest = (uint8_t *)buf + cached * resampler_out_sample_size;
+  struct stream *const stream = find_stream(a, r->gcd, pos);
+  if (is_hibernating(stream)) {
+    error err = open_member(a, stream);
+    if (efailed(err)) {
+      *written = cached;
+      return ethru(err);
+    }
+  }
+  error err = stream_read(a, r, stream, pos, length - cached, dest, &wr);
+  *written = cached + wr;
+  return err;
 }
 
 void audio_destroy(struct audio **const app) {
@@ -513,7 +760,7 @@ void audio_destroy(struct audio **const app) {
       mtx_lock(&a->mtx);
       a->status = status_closing;
       mtx_unlock(&a->mtx);
-      thrd_join(a->thread, NULL);
+      tpool_group_wait(&a->group);
     }
     for (size_t i = 0; i < a->len; ++i) {
       ffmpeg_close(&a->streams[i].ffmpeg);
@@ -521,7 +768,10 @@ void audio_destroy(struct audio **const app) {
     ereport(mem_free(&a->streams));
   }
   audioidx_destroy(&a->idx);
+  pcmfile_destroy(&a->track);
+  pcmcache_destroy(&a->cache);
   ereport(sfree(&a->filepath));
+  tpool_group_exit(&a->group);
   mtx_destroy(&a->mtx);
   ereport(mem_free(app));
 }
@@ -543,6 +793,7 @@ NODISCARD error audio_create(struct audio **const app, struct audio_options cons
       .valid_first_sample_pos_asr = AV_NOPTS_VALUE,
   };
   mtx_init(&a->mtx, mtx_plain);
+  tpool_group_init(&a->group);
 
   if (opt->filepath) {
     err = scpy(&a->filepath, opt->filepath);
@@ -572,9 +823,34 @@ NODISCARD error audio_create(struct audio **const app, struct audio_options cons
     err = ethru(err);
     goto cleanup;
   }
+  timespec_get(&a->streams[0].opened_at, TIME_UTC);
+  a->codec = a->streams[0].ffmpeg.codec;
   a->len = 1;
+  a->claimed = 1;
   a->out_sample_rate = get_output_sample_rate(opt->sample_rate, a->streams[0].ffmpeg.stream->codecpar->sample_rate);
 
+  if (opt->cache_budget) {
+    err = pcmcache_create(&a->cache, (size_t)resampler_out_sample_size, opt->cache_budget);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+  }
+
+  int64_t const duration = a->streams[0].ffmpeg.fctx->duration;
+  if (opt->decode_track && duration != AV_NOPTS_VALUE) {
+    // Reads fall back to the decoders until the track is decoded, so a failure here is not fatal.
+    ereport(pcmfile_create(&a->track,
+                           &(struct pcmfile_options){
+                               .filepath = opt->filepath,
+                               .handle = opt->handle,
+                               .codec = a->streams[0].ffmpeg.codec,
+                               .out_rate = a->out_sample_rate,
+                               .use_sox = opt->use_sox,
+                               .samples = av_rescale_rnd(duration, a->out_sample_rate, AV_TIME_BASE, AV_ROUND_DOWN),
+                           }));
+  }
+
   if (a->index_mode != aim_noindex) {
     err = audioidx_create(&a->idx,
                           &(struct audioidx_create_options){
@@ -595,4 +871,53 @@ cleanup:
   return err;
 }
 
+static size_t get_frame_size(AVFrame const *const frame) {
+  size_t r = 0;
+  for (size_t i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+    r += frame->buf[i]->size;
+  }
+  return r;
+}
+
+size_t audio_get_memory_usage(struct audio *const a) {
+  if (!a) {
+    return 0;
+  }
+  size_t r = 0;
+  mtx_lock(&a->mtx);
+  for (size_t i = 0; i < a->len; ++i) {
+    if (is_hibernating(a->streams + i)) {
+      continue;
+    }
+    r += ffmpeg_get_memory_usage(&a->streams[i].ffmpeg) + get_frame_size(a->streams[i].ffmpeg.frame);
+  }
+  mtx_unlock(&a->mtx);
+  return r;
+}
+
+size_t audio_get_index_memory_usage(struct audio *const a) {
+  return a && a->idx ? audioidx_get_memory_usage(a->idx) : 0;
+}
+
+size_t audio_get_cache_memory_usage(struct audio *const a) {
+  return a ? pcmcache_get_memory_usage(a->cache) + pcmfile_get_memory_usage(a->track) : 0;
+}
+
+double audio_get_index_build_time(struct audio *const a) {
+  return a && a->idx ? audioidx_get_build_time(a->idx) : 0;
+}
+
+void audio_drop_index(struct audio *const a) {
+  if (a && a->idx) {
+    audioidx_reset(a->idx);
+  }
+}
+
+void audio_drop_cache(struct audio *const a) {
+  if (a) {
+    pcmcache_clear(a->cache);
+    pcmfile_destroy(&a->track);
+  }
+}
+
 void *audio_get_codec_parameter(struct audio const *const a) { return a->streams[0].ffmpeg.stream->codecpar; }
@@ -39,6 +39,11 @@ struct audio_options {
   size_t num_stream;
   enum audio_index_mode index_mode;
   enum audio_sample_rate sample_rate;
+  // Bytes of resampled output kept for repeated reads, 0 disables the cache.
+  size_t cache_budget;
+  // Decodes the whole track on a worker, reads are copied from it once it covers them.
+  bool decode_track;
+  bool use_sox;
 };
 
 NODISCARD error audio_create(struct audio **const app, struct audio_options const *const opt);
@@ -52,3 +57,17 @@ NODISCARD error audio_read(struct audio *const a,
                            bool const accurate);
 void audio_get_info(struct audio const *const a, struct info_audio *const ai);
 void *audio_get_codec_parameter(struct audio const *const a);
+// Closes the decoders that have not been used for idle_seconds to free their memory, 0 closes all of them.
+// The most recently used decoder stays open, closed ones are reopened on the next read that needs them.
+void audio_hibernate(struct audio *const a, int const idle_seconds);
+// Returns the estimated bytes used by the decoders, the index is not included.
+size_t audio_get_memory_usage(struct audio *const a);
+size_t audio_get_index_memory_usage(struct audio *const a);
+size_t audio_get_cache_memory_usage(struct audio *const a);
+double audio_get_index_build_time(struct audio *const a);
+// Discards the index to free its memory, it is rebuilt by the next read that needs it.
+// It must not be called while the audio is being read.
+void audio_drop_index(struct audio *const a);
+// Discards the cached output and the decoded track, the next reads decode again.
+// It must not be called while the audio is being read.
+void audio_drop_cache(struct audio *const a);
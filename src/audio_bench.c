@@ -0,0 +1,125 @@
+#include "ffmpeg.h"
+#include "now.h"
+#include "resampler.h"
+
+#include <math.h>
+#include <ovprintf.h>
+#include <ovutil/win32.h>
+#include <stdio.h>
+
+#ifndef FFMPEGDIR
+#  define FFMPEGDIR L"."
+#endif
+
+static void initdll(void) { SetDllDirectoryW(FFMPEGDIR); }
+#define TEST_MY_INIT initdll()
+#include "ovtest.h"
+
+enum {
+  iterations = 10000,
+  // A typical frame size of AAC is 1024, the others decode more samples per frame.
+  frame_samples = 1024,
+  out_rate = 48000,
+};
+
+static void report(char const *const name, char const *const impl, double const elapsed) {
+  char s[256];
+  ov_snprintf(s, 256, NULL, "%s %s: %0.3fus/frame", name, impl, elapsed * 1000000 / (double)iterations);
+  puts(s);
+}
+
+static char const *const isa_names[] = {"c", "sse2", "avx2"};
+
+// Fills the frame with a 1kHz sine wave.
+static void fill_frame(AVFrame *const frame) {
+  int const planes = av_sample_fmt_is_planar(frame->format) ? frame->ch_layout.nb_channels : 1;
+  int const channels = planes == 1 ? frame->ch_layout.nb_channels : 1;
+  for (int p = 0; p < planes; ++p) {
+    for (int i = 0; i < frame->nb_samples * channels; ++i) {
+      double const v = sin(2 * 3.14159265358979323846 * 1000 * (double)(i / channels) / (double)frame->sample_rate);
+      if (frame->format == AV_SAMPLE_FMT_S16) {
+        ((int16_t *)(void *)frame->data[p])[i] = (int16_t)(v * 16384);
+      } else {
+        ((float *)(void *)frame->data[p])[i] = (float)(v * 0.5);
+      }
+    }
+  }
+}
+
+static bool run(char const *const name, char const *const impl, struct resampler *const r, AVFrame const *const frame) {
+  double const start = now();
+  for (int n = 0; n < iterations; ++n) {
+    int written = r->samples;
+    if (!TEST_SUCCEEDED_F(resampler_resample(r, frame->data, frame->nb_samples, r->buf, &written))) {
+      return false;
+    }
+  }
+  report(name, impl, now() - start);
+  return true;
+}
+
+static void bench(char const *const name,
+                  enum AVSampleFormat const sample_fmt,
+                  AVChannelLayout const *const ch_layout) {
+  AVCodecParameters *codecpar = avcodec_parameters_alloc();
+  AVFrame *frame = av_frame_alloc();
+  struct resampler *r = NULL;
+  if (!TEST_CHECK(codecpar != NULL) || !TEST_CHECK(frame != NULL)) {
+    goto cleanup;
+  }
+  codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+  codecpar->format = sample_fmt;
+  codecpar->sample_rate = out_rate;
+  if (!TEST_CHECK(av_channel_layout_copy(&codecpar->ch_layout, ch_layout) == 0)) {
+    goto cleanup;
+  }
+  frame->format = sample_fmt;
+  frame->sample_rate = out_rate;
+  frame->nb_samples = frame_samples;
+  if (!TEST_CHECK(av_channel_layout_copy(&frame->ch_layout, &codecpar->ch_layout) == 0) ||
+      !TEST_CHECK(av_frame_get_buffer(frame, 0) == 0)) {
+    goto cleanup;
+  }
+  fill_frame(frame);
+  if (!TEST_SUCCEEDED_F(resampler_create(&r,
+                                         &(struct resampler_options){
+                                             .out_rate = out_rate,
+                                             .codecpar = codecpar,
+                                         }))) {
+    goto cleanup;
+  }
+
+  if (r->passthrough && !run(name, "passthrough", r, frame)) {
+    goto cleanup;
+  }
+  if (r->pcmconv) {
+    for (int isa = pcmconv_isa_c; isa <= (int)pcmconv_get_isa(); ++isa) {
+      r->pcmconv_isa = (enum pcmconv_isa)isa;
+      if (!run(name, isa_names[isa], r, frame)) {
+        goto cleanup;
+      }
+    }
+  }
+  // Forces swresample on a source that has a faster path.
+  r->passthrough = false;
+  r->pcmconv = false;
+  run(name, "swr_convert", r, frame);
+
+cleanup:
+  resampler_destroy(&r);
+  av_frame_free(&frame);
+  avcodec_parameters_free(&codecpar);
+}
+
+static void bench_s16(void) { bench("s16 48kHz", AV_SAMPLE_FMT_S16, &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO); }
+static void bench_fltp(void) { bench("fltp 48kHz", AV_SAMPLE_FMT_FLTP, &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO); }
+static void bench_fltp_5_1(void) {
+  bench("fltp 5.1 48kHz", AV_SAMPLE_FMT_FLTP, &(AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1_BACK);
+}
+
+TEST_LIST = {
+    {"bench_s16", bench_s16},
+    {"bench_fltp", bench_fltp},
+    {"bench_fltp_5_1", bench_fltp_5_1},
+    {NULL, NULL},
+};
@@ -3,6 +3,7 @@
 #include "ffmpeg.h"
 #include "now.h"
 #include "progress.h"
+#include "tpool.h"
 
 #include "ovthreads.h"
 
@@ -12,36 +13,278 @@
 #  include <ovprintf.h>
 #endif
 
+#include <assert.h>
 #include <ovutil/win32.h>
 #include <stdatomic.h>
+#include <string.h>
 
-struct item {
-  int64_t key;
-  int64_t pos;
+// Packets are stored in blocks as 32-bit offsets from the first packet of the block.
+// The indexer only appends, and publishes a batch of packets at once with atomic stores of the block count,
+// so lookups read the published packets without locking.
+enum {
+  block_entries = 1024,
+  segment_blocks = 1024,
+  max_segments = 1024,
+  batch_entries = 256,
+};
+
+static uint32_t const unknown_byte_pos = UINT32_MAX;
+
+struct entry {
+  uint32_t pts;
+  uint32_t pos;
+  uint32_t byte_pos;
+};
+
+struct block {
+  struct audioidx_entry base;
+  atomic_size_t len;
+  struct entry entries[block_entries];
 };
 
 struct audioidx {
   struct wstr filepath;
   void *handle;
 
-  struct hmap ptsmap;
+  // Blocks are found through fixed segments, so published blocks never move.
+  struct block **segments[max_segments];
+  atomic_size_t num_blocks;
+  // Packets are in demuxing order, so pos always increases.
+  // pts also increases in well-formed files, lookups by pts are given up when it does not.
+  atomic_bool pts_sorted;
+  // Only used by the indexer, packets are appended up to here but may not be published yet.
+  size_t appended_blocks;
+  size_t appended_len;
+  int64_t last_pts;
+  // Microseconds the indexer has spent on the current index.
+  _Atomic int64_t build_time;
   mtx_t mtx;
   cnd_t cnd;
-  int64_t video_start_time;
-  int64_t created_pts;
-  thrd_t indexer;
-  bool indexer_running;
+  // Readers waiting for packets that are not published yet, the indexer only locks the mutex when there are some.
+  atomic_int waiters;
+  _Atomic int64_t created_pts;
+  struct tpool_group group;
+  // Set when the indexer is started, until audioidx_reset discards its index.
+  atomic_bool indexer_started;
+  // Cleared when the indexer finishes, or to make it stop.
+  atomic_bool indexer_running;
+  // Lookups in progress. Blocks are freed without waiting for readers, so there must be none by then.
+  atomic_int readers;
 };
 
-struct indexer_context {
-  struct audioidx *ip;
-  error err;
-};
+static inline struct block *get_block(struct audioidx const *const ip, size_t const i) {
+  return ip->segments[i / segment_blocks][i % segment_blocks];
+}
+
+static bool fits(struct block const *const b, size_t const len, struct audioidx_entry const *const e) {
+  if (len == block_entries) {
+    return false;
+  }
+  int64_t const pts = e->pts - b->base.pts;
+  int64_t const pos = e->pos - b->base.pos;
+  if (pts < b->entries[len - 1].pts || pts > UINT32_MAX || pos > UINT32_MAX) {
+    return false;
+  }
+  if (e->byte_pos < 0) {
+    return true;
+  }
+  int64_t const byte_pos = e->byte_pos - b->base.byte_pos;
+  return b->base.byte_pos >= 0 && byte_pos >= 0 && byte_pos < unknown_byte_pos;
+}
+
+static struct entry encode(struct block const *const b, struct audioidx_entry const *const e) {
+  return (struct entry){
+      .pts = (uint32_t)(e->pts - b->base.pts),
+      .pos = (uint32_t)(e->pos - b->base.pos),
+      .byte_pos = e->byte_pos < 0 ? unknown_byte_pos : (uint32_t)(e->byte_pos - b->base.byte_pos),
+  };
+}
+
+static struct audioidx_entry decode(struct block const *const b, size_t const i) {
+  struct entry const *const e = b->entries + i;
+  return (struct audioidx_entry){
+      .pts = b->base.pts + e->pts,
+      .pos = b->base.pos + e->pos,
+      .byte_pos = e->byte_pos == unknown_byte_pos ? -1 : b->base.byte_pos + e->byte_pos,
+  };
+}
+
+// Appends a packet without publishing it, only the indexer calls this.
+static NODISCARD error append(struct audioidx *const ip, struct audioidx_entry const *const e) {
+  size_t const n = ip->appended_blocks;
+  if (n) {
+    struct block *const b = get_block(ip, n - 1);
+    if (fits(b, ip->appended_len, e)) {
+      b->entries[ip->appended_len++] = encode(b, e);
+      ip->last_pts = e->pts;
+      return eok();
+    }
+    // The block is complete by the time it is published with the next one.
+    atomic_store(&b->len, ip->appended_len);
+  }
+  if (n == (size_t)max_segments * segment_blocks) {
+    return emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("audio index is full")));
+  }
+  struct block **segment = ip->segments[n / segment_blocks];
+  if (!segment) {
+    error err = mem(&segment, segment_blocks, sizeof(struct block *));
+    if (efailed(err)) {
+      return ethru(err);
+    }
+    ip->segments[n / segment_blocks] = segment;
+  }
+  struct block *b = NULL;
+  error err = mem(&b, 1, sizeof(struct block));
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  b->base = *e;
+  b->entries[0] = encode(b, e);
+  atomic_init(&b->len, 1);
+  if (n && e->pts < ip->last_pts) {
+    atomic_store(&ip->pts_sorted, false);
+  }
+  ip->last_pts = e->pts;
+  segment[n % segment_blocks] = b;
+  ip->appended_blocks = n + 1;
+  ip->appended_len = 1;
+  return eok();
+}
+
+// Makes the appended packets visible to lookups and wakes the readers waiting for them.
+static void publish(struct audioidx *const ip, int64_t const created_pts, double const build_time) {
+  size_t const n = ip->appended_blocks;
+  if (n) {
+    atomic_store(&get_block(ip, n - 1)->len, ip->appended_len);
+  }
+  atomic_store(&ip->num_blocks, n);
+  atomic_store(&ip->build_time, (int64_t)(build_time * 1e6));
+  atomic_store(&ip->created_pts, created_pts);
+  if (atomic_load(&ip->waiters)) {
+    mtx_lock(&ip->mtx);
+    cnd_broadcast(&ip->cnd);
+    mtx_unlock(&ip->mtx);
+  }
+}
+
+static void free_blocks(struct audioidx *const ip) {
+  size_t const n = ip->appended_blocks;
+  for (size_t i = 0; i < n; ++i) {
+    struct block *b = get_block(ip, i);
+    ereport(mem_free(&b));
+  }
+  for (size_t i = 0; i < max_segments && ip->segments[i]; ++i) {
+    ereport(mem_free(&ip->segments[i]));
+  }
+  atomic_store(&ip->num_blocks, 0);
+  atomic_store(&ip->pts_sorted, true);
+  ip->appended_blocks = 0;
+  ip->appended_len = 0;
+}
+
+static inline int64_t get_key(struct audioidx_entry const *const e, bool const by_pts) {
+  return by_pts ? e->pts : e->pos;
+}
 
-static int indexer(void *userdata) {
-  struct indexer_context *ictx = userdata;
-  struct audioidx *ip = ictx->ip;
+// Finds the last published packet whose pts or pos is at or before value.
+static bool find_floor(struct audioidx const *const ip,
+                       int64_t const value,
+                       bool const by_pts,
+                       struct audioidx_entry *const e) {
+  size_t const n = atomic_load(&ip->num_blocks);
+  if (!n || (by_pts && !atomic_load(&ip->pts_sorted))) {
+    return false;
+  }
+  size_t lo = 0;
+  size_t hi = n;
+  while (hi - lo > 1) {
+    size_t const mid = lo + (hi - lo) / 2;
+    if (get_key(&get_block(ip, mid)->base, by_pts) <= value) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  struct block const *const b = get_block(ip, lo);
+  int64_t const offset = value - get_key(&b->base, by_pts);
+  if (offset < 0) {
+    return false;
+  }
+  size_t l = 0;
+  size_t h = atomic_load(&b->len);
+  while (h - l > 1) {
+    size_t const mid = l + (h - l) / 2;
+    if ((int64_t)(by_pts ? b->entries[mid].pts : b->entries[mid].pos) <= offset) {
+      l = mid;
+    } else {
+      h = mid;
+    }
+  }
+  *e = decode(b, l);
+  return true;
+}
+
+// Returns whether the published packets reach the sample, the last packet only does once the next one is indexed.
+static bool covers(struct audioidx const *const ip, int64_t const sample) {
+  if (atomic_load(&ip->created_pts) == INT64_MAX) {
+    return true;
+  }
+  size_t const n = atomic_load(&ip->num_blocks);
+  if (!n) {
+    return false;
+  }
+  struct block const *const b = get_block(ip, n - 1);
+  struct audioidx_entry const last = decode(b, atomic_load(&b->len) - 1);
+  return sample < last.pos;
+}
+
+// MP4/MOV sample tables and AVI idx1 list every packet, and libavformat has read them into the stream's index on open.
+// Matroska Cues only list some keyframes, so such files are indexed by demuxing.
+static bool has_packet_index(AVFormatContext const *const fctx, AVStream *const stream, int64_t const end) {
+  if (strcmp(fctx->iformat->name, "mov,mp4,m4a,3gp,3g2,mj2") != 0 && strcmp(fctx->iformat->name, "avi") != 0) {
+    return false;
+  }
+  int const n = avformat_index_get_entries_count(stream);
+  if (n < 1) {
+    return false;
+  }
+  // Fragmented files may have only some of their fragments indexed.
+  int64_t const tolerance = av_rescale_q(1, av_make_q(1, 1), stream->time_base);
+  return avformat_index_get_entry(stream, n - 1)->timestamp + tolerance >= end;
+}
+
+// Publishes the packets of the container index without reading the file.
+static NODISCARD error index_from_container(struct audioidx *const ip,
+                                            struct ffmpeg_stream *const fs,
+                                            int64_t const start_time,
+                                            double const started) {
+  AVRational const sample_tb = av_make_q(1, fs->stream->codecpar->sample_rate);
+  int const n = avformat_index_get_entries_count(fs->stream);
+  for (int i = 0; i < n && atomic_load(&ip->indexer_running); ++i) {
+    AVIndexEntry const *const ie = avformat_index_get_entry(fs->stream, i);
+    if ((ie->flags & AVINDEX_DISCARD_FRAME) || ie->timestamp == AV_NOPTS_VALUE) {
+      continue;
+    }
+    error err = append(ip,
+                       &(struct audioidx_entry){
+                           .pts = ie->timestamp,
+                           .pos = av_rescale_q(ie->timestamp - start_time, fs->stream->time_base, sample_tb),
+                           .byte_pos = ie->pos,
+                       });
+    if (efailed(err)) {
+      return ethru(err);
+    }
+    if (i % batch_entries == batch_entries - 1) {
+      publish(ip, ie->timestamp, now() - started);
+    }
+  }
+  return eok();
+}
+
+static void indexer(void *const userdata) {
+  struct audioidx *ip = userdata;
   struct ffmpeg_stream fs = {0};
+  double started = now();
   error err = ffmpeg_open_without_codec(&fs,
                                         &(struct ffmpeg_open_options){
                                             .filepath = ip->filepath.ptr,
@@ -55,21 +298,23 @@ static int indexer(void *userdata) {
   int const stream_index = av_find_best_stream(fs.fctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
   fs.stream = fs.fctx->streams[stream_index];
 
-  int64_t const video_start_time = av_rescale_q(ip->video_start_time, AV_TIME_BASE_Q, fs.stream->time_base);
+  // Positions are relative to the start time of the stream, as the reader counts them.
+  int64_t const start_time = fs.stream->start_time == AV_NOPTS_VALUE ? 0 : fs.stream->start_time;
   int64_t const duration = av_rescale_q(fs.fctx->duration, AV_TIME_BASE_Q, fs.stream->time_base);
 
-  mtx_lock(&ip->mtx);
-  ictx->err = eok();
-  ictx->ip = NULL;
-  ictx = NULL;
-  cnd_signal(&ip->cnd);
-  mtx_unlock(&ip->mtx);
-
   int64_t samples = AV_NOPTS_VALUE;
   static double const interval = 0.05;
-  double time = now() + interval;
-  bool indexer_running = true;
-  while (indexer_running) {
+  started = now();
+  double time = started + interval;
+  if (fs.fctx->duration != AV_NOPTS_VALUE && has_packet_index(fs.fctx, fs.stream, start_time + duration)) {
+    err = index_from_container(ip, &fs, start_time, started);
+    if (efailed(err)) {
+      err = ethru(err);
+    }
+    goto cleanup;
+  }
+  size_t pending = 0;
+  while (atomic_load(&ip->indexer_running)) {
     int r = ffmpeg_read_packet(&fs);
     if (r < 0) {
       if (r == AVERROR_EOF) {
@@ -78,6 +323,19 @@ static int indexer(void *userdata) {
       err = errffmpeg(r);
       goto cleanup;
     }
+    int64_t const packet_samples = av_get_audio_frame_duration2(
+        fs.stream->codecpar, fs.packet->size ? fs.packet->size : fs.stream->codecpar->frame_size);
+    if (!packet_samples) {
+      err = errg(err_fail);
+      goto cleanup;
+    }
+    if (fs.packet->pts == AV_NOPTS_VALUE) {
+      // The packet cannot be looked up, but its samples still move the following packets.
+      if (samples != AV_NOPTS_VALUE) {
+        samples += packet_samples;
+      }
+      continue;
+    }
     if (samples == AV_NOPTS_VALUE) {
 #if SHOWLOG_PROGRESS
       char s[256];
@@ -85,21 +343,14 @@ static int indexer(void *userdata) {
       ov_snprintf(s,
                   256,
                   NULL,
-                  "aidx start_time: pts: %lld / global: %lld / a: %lld / v: %lld",
+                  "aidx start_time: pts: %lld / global: %lld / a: %lld",
                   fs.packet->pts,
                   fstart_time,
-                  fs.stream->start_time,
-                  video_start_time);
+                  start_time);
       OutputDebugStringA(s);
 #endif
       samples = av_rescale_q(
-          fs.packet->pts - video_start_time, fs.stream->time_base, av_make_q(1, fs.stream->codecpar->sample_rate));
-    }
-    int64_t const packet_samples = av_get_audio_frame_duration2(
-        fs.stream->codecpar, fs.packet->size ? fs.packet->size : fs.stream->codecpar->frame_size);
-    if (!packet_samples) {
-      err = errg(err_fail);
-      goto cleanup;
+          fs.packet->pts - start_time, fs.stream->time_base, av_make_q(1, fs.stream->codecpar->sample_rate));
     }
 #if SHOWLOG_PROGRESS
     if (fs.packet->pts < 1000) {
@@ -108,31 +359,32 @@ static int indexer(void *userdata) {
       OutputDebugStringA(s);
     }
 #endif
-    bool update_progress = false;
+    err = append(ip,
+                 &(struct audioidx_entry){
+                     .pts = fs.packet->pts,
+                     .pos = samples,
+                     .byte_pos = fs.packet->pos,
+                 });
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+    samples += packet_samples;
+    // Packets are published in batches, or at once while a reader is waiting for them.
     double const n = now();
+    if (++pending == batch_entries || n > time || atomic_load(&ip->waiters)) {
+      publish(ip, fs.packet->pts, n - started);
+      pending = 0;
+    }
     if (n > time) {
       progress_set(ip, (size_t)((10000 * fs.packet->pts) / duration));
       time = n + interval;
-      update_progress = true;
 #if SHOWLOG_PROGRESS
       char s[256];
       wsprintfA(s, "aidx: %d%%", (int)((100 * fs.packet->pts) / duration));
       OutputDebugStringA(s);
 #endif
     }
-    mtx_lock(&ip->mtx);
-    err = hmset(&ip->ptsmap, (&(struct item){.key = fs.packet->pts, .pos = samples}), NULL);
-    ip->created_pts = fs.packet->pts;
-    indexer_running = ip->indexer_running;
-    if (update_progress) {
-      cnd_signal(&ip->cnd);
-    }
-    mtx_unlock(&ip->mtx);
-    if (efailed(err)) {
-      err = ethru(err);
-      goto cleanup;
-    }
-    samples += packet_samples;
   }
 cleanup:
   progress_set(ip, 10000);
@@ -140,18 +392,20 @@ cleanup:
   OutputDebugStringA("index completed");
 #endif
   ffmpeg_close(&fs);
+  // Readers waiting for the index are woken up even if the file could not be indexed.
+  publish(ip, INT64_MAX, now() - started);
+  ereport(err);
+  atomic_store(&ip->indexer_running, false);
+}
+
+static void stop_indexer(struct audioidx *const ip) {
   mtx_lock(&ip->mtx);
-  ip->created_pts = INT64_MAX;
-  if (ictx) {
-    ictx->err = err;
-    ictx->ip = NULL;
-    ictx = NULL;
-    err = eok();
-  }
-  cnd_signal(&ip->cnd);
+  bool const already_running = atomic_load(&ip->indexer_running);
+  atomic_store(&ip->indexer_running, false);
   mtx_unlock(&ip->mtx);
-  ereport(err);
-  return 0;
+  if (already_running) {
+    tpool_group_wait(&ip->group);
+  }
 }
 
 NODISCARD error audioidx_create(struct audioidx **const ipp, struct audioidx_create_options const *const opt) {
@@ -166,17 +420,18 @@ NODISCARD error audioidx_create(struct audioidx **const ipp, struct audioidx_cre
   struct audioidx *ip = *ipp;
   *ip = (struct audioidx){
       .handle = opt->handle,
-      .video_start_time = opt->video_start_time,
-      .indexer_running = false,
   };
+  atomic_init(&ip->num_blocks, 0);
+  atomic_init(&ip->pts_sorted, true);
+  atomic_init(&ip->build_time, 0);
+  atomic_init(&ip->waiters, 0);
+  atomic_init(&ip->created_pts, AV_NOPTS_VALUE);
+  atomic_init(&ip->indexer_started, false);
+  atomic_init(&ip->indexer_running, false);
+  atomic_init(&ip->readers, 0);
   mtx_init(&ip->mtx, mtx_plain);
   cnd_init(&ip->cnd);
-  ip->created_pts = AV_NOPTS_VALUE;
-  err = hmnews(&ip->ptsmap, sizeof(struct item), 128, sizeof(int64_t));
-  if (efailed(err)) {
-    err = ethru(err);
-    goto cleanup;
-  }
+  tpool_group_init(&ip->group);
   if (opt->filepath) {
     err = scpy(&ip->filepath, opt->filepath);
     if (efailed(err)) {
@@ -198,67 +453,142 @@ void audioidx_destroy(struct audioidx **const ipp) {
     return;
   }
   struct audioidx *ip = *ipp;
-  mtx_lock(&ip->mtx);
-  bool const already_running = ip->indexer_running;
-  ip->indexer_running = false;
-  mtx_unlock(&ip->mtx);
-  if (already_running) {
-    thrd_join(ip->indexer, NULL);
-  }
-  ereport(hmfree(&ip->ptsmap));
+  assert(atomic_load(&ip->readers) == 0 && "audioidx_destroy must not run concurrently with lookups");
+  stop_indexer(ip);
+  // The indexer may have finished but not yet returned from its task.
+  tpool_group_wait(&ip->group);
+  free_blocks(ip);
   ereport(sfree(&ip->filepath));
+  tpool_group_exit(&ip->group);
   cnd_destroy(&ip->cnd);
   mtx_destroy(&ip->mtx);
   ereport(mem_free(ipp));
 }
 
+// Does not wait for the indexer to be scheduled, the pool may be busy with other indexers.
+// Readers that need the index wait for published packets instead.
 static NODISCARD error start_thread(struct audioidx *const ip) {
-  struct indexer_context ictx = {
-      .ip = ip,
-      .err = eok(),
-  };
-  ip->indexer_running = true;
-  if (thrd_create(&ip->indexer, indexer, &ictx) != thrd_success) {
-    ip->indexer_running = false;
-    goto cleanup;
-  }
-  while (ictx.ip) {
-    cnd_wait(&ip->cnd, &ip->mtx);
+  atomic_store(&ip->indexer_started, true);
+  atomic_store(&ip->indexer_running, true);
+  error err = tpool_submit(tpool_priority_indexing, &ip->group, indexer, ip);
+  if (efailed(err)) {
+    atomic_store(&ip->indexer_running, false);
+    atomic_store(&ip->indexer_started, false);
+    return ethru(err);
   }
-cleanup:
-  return ictx.err;
+  return eok();
 }
 
-int64_t audioidx_get(struct audioidx *const ip, int64_t const pts, bool const wait_index) {
-#if SHOWLOG_PROGRESS
-  OutputDebugStringA(wait_index ? "audioidx_get wait_index" : "audioidx_get fast");
-#endif
+// The indexer starts on the first seek, so files that are never sought do not pay for it.
+static NODISCARD error ensure_indexer(struct audioidx *const ip) {
+  if (atomic_load(&ip->indexer_started)) {
+    return eok();
+  }
   error err = eok();
-  int64_t pos = -1;
   mtx_lock(&ip->mtx);
-  if (!ip->indexer_running) {
+  if (!atomic_load(&ip->indexer_started)) {
     err = start_thread(ip);
-    if (efailed(err)) {
-      err = ethru(err);
-      goto cleanup;
-    }
   }
-  if (wait_index) {
-    while (ip->created_pts < pts) {
+  mtx_unlock(&ip->mtx);
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  return eok();
+}
+
+static bool
+find_pts(struct audioidx *const ip, int64_t const pts, bool const wait_index, struct audioidx_entry *const e) {
+  if (wait_index && atomic_load(&ip->created_pts) < pts) {
+    mtx_lock(&ip->mtx);
+    atomic_fetch_add(&ip->waiters, 1);
+    while (atomic_load(&ip->created_pts) < pts) {
       cnd_wait(&ip->cnd, &ip->mtx);
     }
+    atomic_fetch_sub(&ip->waiters, 1);
+    mtx_unlock(&ip->mtx);
   }
-  struct item *p = NULL;
-  err = hmget(&ip->ptsmap, (&(struct item){.key = pts}), &p);
+  return find_floor(ip, pts, true, e);
+}
+
+bool audioidx_find_pts(struct audioidx *const ip,
+                       int64_t const pts,
+                       bool const wait_index,
+                       struct audioidx_entry *const e) {
+  error err = ensure_indexer(ip);
   if (efailed(err)) {
-    err = ethru(err);
-    goto cleanup;
+    ereport(err);
+    return false;
   }
-  if (p) {
-    pos = p->pos;
+  atomic_fetch_add(&ip->readers, 1);
+  bool const found = find_pts(ip, pts, wait_index, e);
+  atomic_fetch_sub(&ip->readers, 1);
+  return found;
+}
+
+int64_t audioidx_get(struct audioidx *const ip, int64_t const pts, bool const wait_index) {
+#if SHOWLOG_PROGRESS
+  OutputDebugStringA(wait_index ? "audioidx_get wait_index" : "audioidx_get fast");
+#endif
+  // Positions of decoded frames are looked up on every read, they must not start the indexer.
+  if (!atomic_load(&ip->indexer_started)) {
+    return -1;
+  }
+  struct audioidx_entry e;
+  atomic_fetch_add(&ip->readers, 1);
+  bool const found = find_pts(ip, pts, wait_index, &e);
+  atomic_fetch_sub(&ip->readers, 1);
+  if (!found || e.pts != pts) {
+    return -1;
+  }
+  return e.pos;
+}
+
+bool audioidx_find(struct audioidx *const ip,
+                   int64_t const sample,
+                   bool const wait_index,
+                   struct audioidx_entry *const e) {
+  error err = ensure_indexer(ip);
+  if (efailed(err)) {
+    ereport(err);
+    return false;
+  }
+  atomic_fetch_add(&ip->readers, 1);
+  bool found = false;
+  if (!covers(ip, sample)) {
+    if (!wait_index) {
+      goto cleanup;
+    }
+    mtx_lock(&ip->mtx);
+    // Once registered as a waiter, a notification cannot be missed because the indexer checks waiters after
+    // publishing and needs the mutex to signal.
+    atomic_fetch_add(&ip->waiters, 1);
+    while (!covers(ip, sample)) {
+      cnd_wait(&ip->cnd, &ip->mtx);
+    }
+    atomic_fetch_sub(&ip->waiters, 1);
+    mtx_unlock(&ip->mtx);
   }
+  found = find_floor(ip, sample, false, e);
 cleanup:
+  atomic_fetch_sub(&ip->readers, 1);
+  return found;
+}
+
+size_t audioidx_get_memory_usage(struct audioidx *const ip) {
+  size_t const n = atomic_load(&ip->num_blocks);
+  size_t const segments = (n + segment_blocks - 1) / segment_blocks;
+  return n * sizeof(struct block) + segments * segment_blocks * sizeof(struct block *);
+}
+
+double audioidx_get_build_time(struct audioidx *const ip) { return (double)atomic_load(&ip->build_time) * 1e-6; }
+
+void audioidx_reset(struct audioidx *const ip) {
+  assert(atomic_load(&ip->readers) == 0 && "audioidx_reset must not run concurrently with lookups");
+  stop_indexer(ip);
+  mtx_lock(&ip->mtx);
+  free_blocks(ip);
+  atomic_store(&ip->build_time, 0);
+  atomic_store(&ip->created_pts, AV_NOPTS_VALUE);
+  atomic_store(&ip->indexer_started, false);
   mtx_unlock(&ip->mtx);
-  ereport(err);
-  return pos;
 }
@@ -7,9 +7,43 @@ struct audioidx;
 struct audioidx_create_options {
   wchar_t const *const filepath;
   void *handle;
-  int64_t const video_start_time;
 };
 
 NODISCARD error audioidx_create(struct audioidx **const ipp, struct audioidx_create_options const *const opt);
+// Must not be called while a lookup is running on another thread.
 void audioidx_destroy(struct audioidx **const ipp);
+
+struct audioidx_entry {
+  int64_t pts;
+  // Samples from the start time of the stream in the original sample rate.
+  int64_t pos;
+  // Position of the packet in the file, -1 if unknown.
+  int64_t byte_pos;
+};
+
+// Lookups do not lock, they read the packets the indexer has published so far.
+// With wait_index, they wait until the indexer reaches the requested position.
+
+// Returns the position in samples of the packet with the pts, or -1 if it is not indexed.
+// It does not start the indexer, it returns -1 until a seek has started it.
 int64_t audioidx_get(struct audioidx *const ip, int64_t const pts, bool const wait_index);
+// The lookups below start the indexer if it is not running.
+
+// Finds the last packet at or before the pts.
+bool audioidx_find_pts(struct audioidx *const ip,
+                       int64_t const pts,
+                       bool const wait_index,
+                       struct audioidx_entry *const e);
+// Finds the packet that contains the sample.
+// Without wait_index, it returns false if the indexer has not reached the sample yet.
+bool audioidx_find(struct audioidx *const ip,
+                   int64_t const sample,
+                   bool const wait_index,
+                   struct audioidx_entry *const e);
+// Returns the bytes used by the index.
+size_t audioidx_get_memory_usage(struct audioidx *const ip);
+// Returns the seconds spent on building the index so far, it is lost with the index.
+double audioidx_get_build_time(struct audioidx *const ip);
+// Stops the indexer and discards the index, it is rebuilt by the next lookup.
+// Lookups read the blocks without locking, so this must not be called while a lookup is running on another thread.
+void audioidx_reset(struct audioidx *const ip);
@@ -11,9 +11,17 @@ struct config {
   enum audio_index_mode audio_index_mode;
   enum audio_sample_rate audio_sample_rate;
   int number_of_stream;
+  int idle_timeout;
+  int memory_budget;
+  int convert_bands;
+  int max_resolution;
   bool need_postfix;
+  bool output_yc48;
+  bool dither;
+  bool fast_preview;
   bool audio_use_sox;
   bool audio_invert_phase;
+  bool audio_decode_track;
   bool modified;
 };
 
@@ -39,12 +47,26 @@ enum config_handle_manage_mode config_get_handle_manage_mode(struct config const
 
 int config_get_number_of_stream(struct config const *const c) { return c->number_of_stream; }
 
+int config_get_idle_timeout(struct config const *const c) { return c->idle_timeout; }
+
+int config_get_memory_budget(struct config const *const c) { return c->memory_budget; }
+
 char const *config_get_preferred_decoders(struct config const *const c) {
   return c->preferred_decoders.ptr ? c->preferred_decoders.ptr : "";
 }
 
 enum video_format_scaling_algorithm config_get_scaling(struct config const *const c) { return c->scaling; }
 
+int config_get_convert_bands(struct config const *const c) { return c->convert_bands; }
+
+bool config_get_output_yc48(struct config const *const c) { return c->output_yc48; }
+
+bool config_get_dither(struct config const *const c) { return c->dither; }
+
+int config_get_max_resolution(struct config const *const c) { return c->max_resolution; }
+
+bool config_get_fast_preview(struct config const *const c) { return c->fast_preview; }
+
 bool config_get_need_postfix(struct config const *const c) { return c->need_postfix; }
 
 enum audio_index_mode config_get_audio_index_mode(struct config const *const c) { return c->audio_index_mode; }
@@ -55,6 +77,8 @@ bool config_get_audio_use_sox(struct config const *const c) { return c->audio_us
 
 bool config_get_audio_invert_phase(struct config const *const c) { return c->audio_invert_phase; }
 
+bool config_get_audio_decode_track(struct config const *const c) { return c->audio_decode_track; }
+
 NODISCARD error config_set_handle_manage_mode(struct config *const c,
                                               enum config_handle_manage_mode handle_manage_mode) {
   if (!c) {
@@ -94,6 +118,36 @@ NODISCARD error config_set_number_of_stream(struct config *const c, int number_o
   return eok();
 }
 
+NODISCARD error config_set_idle_timeout(struct config *const c, int idle_timeout) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (idle_timeout < 0) {
+    idle_timeout = 0;
+  }
+  if (c->idle_timeout == idle_timeout) {
+    return eok();
+  }
+  c->idle_timeout = idle_timeout;
+  c->modified = true;
+  return eok();
+}
+
+NODISCARD error config_set_memory_budget(struct config *const c, int memory_budget) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (memory_budget < 0) {
+    memory_budget = 0;
+  }
+  if (c->memory_budget == memory_budget) {
+    return eok();
+  }
+  c->memory_budget = memory_budget;
+  c->modified = true;
+  return eok();
+}
+
 NODISCARD error config_set_preferred_decoders(struct config *const c, char const *const preferred_decoders) {
   if (!c || !preferred_decoders) {
     return errg(err_invalid_arugment);
@@ -152,6 +206,74 @@ NODISCARD error config_set_scaling(struct config *const c, enum video_format_sca
   return eok();
 }
 
+NODISCARD error config_set_convert_bands(struct config *const c, int convert_bands) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (convert_bands < 0) {
+    convert_bands = 0;
+  } else if (convert_bands > 16) {
+    convert_bands = 16;
+  }
+  if (c->convert_bands == convert_bands) {
+    return eok();
+  }
+  c->convert_bands = convert_bands;
+  c->modified = true;
+  return eok();
+}
+
+NODISCARD error config_set_output_yc48(struct config *const c, bool const output_yc48) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (c->output_yc48 == !!output_yc48) {
+    return eok();
+  }
+  c->output_yc48 = !!output_yc48;
+  c->modified = true;
+  return eok();
+}
+
+NODISCARD error config_set_dither(struct config *const c, bool const dither) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (c->dither == !!dither) {
+    return eok();
+  }
+  c->dither = !!dither;
+  c->modified = true;
+  return eok();
+}
+
+NODISCARD error config_set_max_resolution(struct config *const c, int max_resolution) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (max_resolution < 0) {
+    max_resolution = 0;
+  }
+  if (c->max_resolution == max_resolution) {
+    return eok();
+  }
+  c->max_resolution = max_resolution;
+  c->modified = true;
+  return eok();
+}
+
+NODISCARD error config_set_fast_preview(struct config *const c, bool const fast_preview) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (c->fast_preview == !!fast_preview) {
+    return eok();
+  }
+  c->fast_preview = !!fast_preview;
+  c->modified = true;
+  return eok();
+}
+
 NODISCARD error config_set_audio_index_mode(struct config *const c, enum audio_index_mode audio_index_mode) {
   if (!c) {
     return errg(err_invalid_arugment);
@@ -232,6 +354,18 @@ NODISCARD error config_set_audio_invert_phase(struct config *const c, bool const
   return eok();
 }
 
+NODISCARD error config_set_audio_decode_track(struct config *const c, bool const decode_track) {
+  if (!c) {
+    return errg(err_invalid_arugment);
+  }
+  if (c->audio_decode_track == !!decode_track) {
+    return eok();
+  }
+  c->audio_decode_track = !!decode_track;
+  c->modified = true;
+  return eok();
+}
+
 static NODISCARD error get_config_filename(struct str *const dest) {
   struct wstr ws = {0};
   error err = get_module_file_name(get_hinstance(), &ws);
@@ -289,6 +423,16 @@ static NODISCARD error load(struct config *c) {
     err = ethru(err);
     goto cleanup;
   }
+  err = config_set_idle_timeout(c, (int)(GetPrivateProfileIntA("global", "idle_timeout", 0, filepath.ptr)));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = config_set_memory_budget(c, (int)(GetPrivateProfileIntA("global", "memory_budget", 0, filepath.ptr)));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
   len = GetPrivateProfileStringA(
       "global",
       "preferred_decoders",
@@ -316,6 +460,31 @@ static NODISCARD error load(struct config *c) {
     err = ethru(err);
     goto cleanup;
   }
+  err = config_set_convert_bands(c, (int)(GetPrivateProfileIntA("video", "convert_bands", 0, filepath.ptr)));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = config_set_output_yc48(c, GetPrivateProfileIntA("video", "output_yc48", 0, filepath.ptr) != 0);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = config_set_dither(c, GetPrivateProfileIntA("video", "dither", 0, filepath.ptr) != 0);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = config_set_max_resolution(c, (int)(GetPrivateProfileIntA("video", "max_resolution", 0, filepath.ptr)));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = config_set_fast_preview(c, GetPrivateProfileIntA("video", "fast_preview", 0, filepath.ptr) != 0);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
   err = config_set_audio_index_mode(
       c, (enum audio_index_mode)(GetPrivateProfileIntA("audio", "audio_index_mode", 0, filepath.ptr)));
   if (efailed(err)) {
@@ -338,6 +507,11 @@ static NODISCARD error load(struct config *c) {
     err = ethru(err);
     goto cleanup;
   }
+  err = config_set_audio_decode_track(c, GetPrivateProfileIntA("audio", "decode_track", 0, filepath.ptr) != 0);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
 cleanup:
   ereport(sfree(&filepath));
   return err;
@@ -361,14 +535,22 @@ NODISCARD error config_load(struct config *c) {
   ereport(sfree(&c->preferred_decoders));
   c->handle_manage_mode = tmp->handle_manage_mode;
   c->number_of_stream = tmp->number_of_stream;
+  c->idle_timeout = tmp->idle_timeout;
+  c->memory_budget = tmp->memory_budget;
   c->preferred_decoders = tmp->preferred_decoders;
   tmp->preferred_decoders = (struct str){0};
   c->need_postfix = tmp->need_postfix;
   c->scaling = tmp->scaling;
+  c->convert_bands = tmp->convert_bands;
+  c->output_yc48 = tmp->output_yc48;
+  c->dither = tmp->dither;
+  c->max_resolution = tmp->max_resolution;
+  c->fast_preview = tmp->fast_preview;
   c->audio_index_mode = tmp->audio_index_mode;
   c->audio_sample_rate = tmp->audio_sample_rate;
   c->audio_use_sox = tmp->audio_use_sox;
   c->audio_invert_phase = tmp->audio_invert_phase;
+  c->audio_decode_track = tmp->audio_decode_track;
   c->modified = false;
 cleanup:
   config_destroy(&tmp);
@@ -399,6 +581,16 @@ NODISCARD error config_save(struct config *c) {
     err = errhr(HRESULT_FROM_WIN32(GetLastError()));
     goto cleanup;
   }
+  if (!WritePrivateProfileStringA(
+          "global", "idle_timeout", ov_itoa((int64_t)(config_get_idle_timeout(c)), buf), filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+  if (!WritePrivateProfileStringA(
+          "global", "memory_budget", ov_itoa((int64_t)(config_get_memory_budget(c)), buf), filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
   if (!WritePrivateProfileStringA("global", "preferred_decoders", config_get_preferred_decoders(c), filepath.ptr)) {
     err = errhr(HRESULT_FROM_WIN32(GetLastError()));
     goto cleanup;
@@ -411,6 +603,28 @@ NODISCARD error config_save(struct config *c) {
     err = errhr(HRESULT_FROM_WIN32(GetLastError()));
     goto cleanup;
   }
+  if (!WritePrivateProfileStringA(
+          "video", "convert_bands", ov_itoa((int64_t)(config_get_convert_bands(c)), buf), filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+  if (!WritePrivateProfileStringA("video", "output_yc48", config_get_output_yc48(c) ? "1" : "0", filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+  if (!WritePrivateProfileStringA("video", "dither", config_get_dither(c) ? "1" : "0", filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+  if (!WritePrivateProfileStringA(
+          "video", "max_resolution", ov_itoa((int64_t)(config_get_max_resolution(c)), buf), filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+  if (!WritePrivateProfileStringA("video", "fast_preview", config_get_fast_preview(c) ? "1" : "0", filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
   if (!WritePrivateProfileStringA(
           "audio", "audio_index_mode", ov_itoa((int64_t)(config_get_audio_index_mode(c)), buf), filepath.ptr)) {
     err = errhr(HRESULT_FROM_WIN32(GetLastError()));
@@ -430,6 +644,11 @@ NODISCARD error config_save(struct config *c) {
     err = errhr(HRESULT_FROM_WIN32(GetLastError()));
     goto cleanup;
   }
+  if (!WritePrivateProfileStringA(
+          "audio", "decode_track", config_get_audio_decode_track(c) ? "1" : "0", filepath.ptr)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
 cleanup:
   ereport(sfree(&filepath));
   return err;
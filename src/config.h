@@ -19,21 +19,39 @@ enum config_handle_manage_mode {
 
 enum config_handle_manage_mode config_get_handle_manage_mode(struct config const *const c);
 int config_get_number_of_stream(struct config const *const c);
+// Seconds without access before an idle decoder is closed, 0 means never.
+int config_get_idle_timeout(struct config const *const c);
+// Upper limit of the memory used by all handles in MiB, 0 means no limit.
+int config_get_memory_budget(struct config const *const c);
 char const *config_get_preferred_decoders(struct config const *const c);
 bool config_get_need_postfix(struct config const *const c);
 enum video_format_scaling_algorithm config_get_scaling(struct config const *const c);
+int config_get_convert_bands(struct config const *const c);
+bool config_get_output_yc48(struct config const *const c);
+bool config_get_dither(struct config const *const c);
+int config_get_max_resolution(struct config const *const c);
+bool config_get_fast_preview(struct config const *const c);
 enum audio_index_mode config_get_audio_index_mode(struct config const *const c);
 enum audio_sample_rate config_get_audio_sample_rate(struct config const *const c);
 bool config_get_audio_use_sox(struct config const *const c);
 bool config_get_audio_invert_phase(struct config const *const c);
+bool config_get_audio_decode_track(struct config const *const c);
 
 NODISCARD error config_set_handle_manage_mode(struct config *const c,
                                               enum config_handle_manage_mode handle_manage_mode);
 NODISCARD error config_set_number_of_stream(struct config *const c, int number_of_stream);
+NODISCARD error config_set_idle_timeout(struct config *const c, int idle_timeout);
+NODISCARD error config_set_memory_budget(struct config *const c, int memory_budget);
 NODISCARD error config_set_preferred_decoders(struct config *const c, char const *const preferred_decoders);
 NODISCARD error config_set_need_postfix(struct config *const c, bool const need_postfix);
 NODISCARD error config_set_scaling(struct config *const c, enum video_format_scaling_algorithm scaling);
+NODISCARD error config_set_convert_bands(struct config *const c, int convert_bands);
+NODISCARD error config_set_output_yc48(struct config *const c, bool const output_yc48);
+NODISCARD error config_set_dither(struct config *const c, bool const dither);
+NODISCARD error config_set_max_resolution(struct config *const c, int max_resolution);
+NODISCARD error config_set_fast_preview(struct config *const c, bool const fast_preview);
 NODISCARD error config_set_audio_index_mode(struct config *const c, enum audio_index_mode audio_index_mode);
 NODISCARD error config_set_audio_sample_rate(struct config *const c, enum audio_sample_rate audio_sample_rate);
 NODISCARD error config_set_audio_use_sox(struct config *const c, bool const use_sox);
 NODISCARD error config_set_audio_invert_phase(struct config *const c, bool const invert_phase);
+NODISCARD error config_set_audio_decode_track(struct config *const c, bool const decode_track);
@@ -0,0 +1,559 @@
+#include "convert.h"
+
+#include <ovutil/win32.h>
+
+#include <libavutil/pixdesc.h>
+
+#include "pixconv.h"
+#include "tpool.h"
+
+enum mode {
+  mode_sws,
+  mode_passthrough,
+  mode_pixconv,
+  mode_pixconv_rgb,
+};
+
+struct band {
+  struct convert *c;
+  // Each band has its own context because SwsContext keeps per-call state.
+  struct SwsContext *sws;
+  int y_begin;
+  int y_end;
+};
+
+struct convert {
+  struct band *bands;
+  size_t num_bands;
+  struct tpool_group group;
+
+  // Arguments of the conversion in progress.
+  AVFrame const *frame;
+  uint8_t *dest;
+  enum mode mode;
+
+  int width;
+  int height;
+  int pix_fmt;
+  int dst_width;
+  int dst_height;
+  enum convert_format format;
+
+  // The decoder already outputs the destination format, rows are copied as is.
+  bool passthrough;
+  // Same size YUV to YUY2 or YC48 conversion does not need swscale.
+  bool pixconv;
+  bool pixconv_full_range;
+  bool dither;
+  enum pixconv_layout pixconv_layout;
+  enum pixconv_isa pixconv_isa;
+  // Same size RGB to BGR24 conversion does not need swscale either.
+  bool pixconv_rgb;
+  enum pixconv_rgb_layout pixconv_rgb_layout;
+
+  // swscale converts the frame, the output may be smaller than the source.
+  // Every band takes its own output rows from the whole source through the slice API,
+  // so chroma rows are interpolated across band boundaries as they are without bands.
+  bool sws;
+  // Wraps the destination for the slice API of swscale while a conversion is in progress.
+  AVFrame *dst_frame;
+  // swscale cannot write YC48, it writes yuv444p16 here first and each band fills its own rows.
+  uint8_t *sws_tmp;
+};
+
+enum {
+  cache_size = 4,
+};
+
+struct convert_cache {
+  // Options of new converters, the source size and the pixel format are taken from the frame.
+  struct convert_options opt;
+  struct convert *entries[cache_size];
+  uint64_t last_used[cache_size];
+  uint64_t clock;
+};
+
+static void free_nothing(void *opaque, uint8_t *data) {
+  (void)opaque;
+  (void)data;
+}
+
+static int get_processor_count(void) {
+  static int count = 0;
+  if (count == 0) {
+    SYSTEM_INFO si = {0};
+    GetSystemInfo(&si);
+    count = si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+  }
+  return count;
+}
+
+static bool get_pixconv_layout(int const pix_fmt, enum pixconv_layout *const layout, bool *const full_range) {
+  // yuvj formats are full range, swscale converts them to limited range when writing YUY2.
+  *full_range = pix_fmt == AV_PIX_FMT_YUVJ420P || pix_fmt == AV_PIX_FMT_YUVJ422P;
+  if (pix_fmt == AV_PIX_FMT_YUV420P || pix_fmt == AV_PIX_FMT_YUVJ420P) {
+    *layout = pixconv_layout_yuv420p;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_YUV422P || pix_fmt == AV_PIX_FMT_YUVJ422P) {
+    *layout = pixconv_layout_yuv422p;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_NV12) {
+    *layout = pixconv_layout_nv12;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_YUV420P10) {
+    *layout = pixconv_layout_yuv420p10;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_YUV422P10) {
+    *layout = pixconv_layout_yuv422p10;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_P010) {
+    *layout = pixconv_layout_p010;
+    return true;
+  }
+  return false;
+}
+
+// Names are in byte order, so AV_PIX_FMT_RGB32 is bgrx on little endian.
+static bool get_pixconv_rgb_layout(int const pix_fmt, enum pixconv_rgb_layout *const layout) {
+  if (pix_fmt == AV_PIX_FMT_RGB24) {
+    *layout = pixconv_rgb_layout_rgb24;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_RGBA || pix_fmt == AV_PIX_FMT_RGB0) {
+    *layout = pixconv_rgb_layout_rgbx;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_BGRA || pix_fmt == AV_PIX_FMT_BGR0) {
+    *layout = pixconv_rgb_layout_bgrx;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_ARGB || pix_fmt == AV_PIX_FMT_0RGB) {
+    *layout = pixconv_rgb_layout_xrgb;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_ABGR || pix_fmt == AV_PIX_FMT_0BGR) {
+    *layout = pixconv_rgb_layout_xbgr;
+    return true;
+  }
+  if (pix_fmt == AV_PIX_FMT_GBRP) {
+    *layout = pixconv_rgb_layout_gbrp;
+    return true;
+  }
+  return false;
+}
+
+// Band boundaries are aligned to the chroma subsampling so that no chroma row is shared by two bands.
+// A band smaller than a quarter of 1080p costs more to dispatch than it saves.
+static size_t get_num_bands(struct convert_options const *const opt, int const rows, int const align) {
+  int n = opt->bands;
+  if (n <= 0) {
+    n = (opt->width * opt->height) / (960 * 540);
+    int const procs = get_processor_count();
+    n = n > procs ? procs : n;
+  }
+  int const max = rows / align;
+  n = n > max ? max : n;
+  return n < 1 ? 1 : (size_t)n;
+}
+
+int convert_get_bit_depth(enum convert_format const format) {
+  switch (format) {
+  case convert_format_bgr24:
+    return 24;
+  case convert_format_yuy2:
+    return 16;
+  case convert_format_yc48:
+    return 48;
+  }
+  return 0;
+}
+
+static void convert_band_sws(struct band *const b) {
+  struct convert *const c = b->c;
+  int r = sws_frame_start(b->sws, c->dst_frame, c->frame);
+  if (r >= 0) {
+    r = sws_send_slice(b->sws, 0, (unsigned int)c->height);
+  }
+  if (r >= 0) {
+    r = sws_receive_slice(b->sws, (unsigned int)b->y_begin, (unsigned int)(b->y_end - b->y_begin));
+  }
+  sws_frame_end(b->sws);
+  if (r < 0) {
+    ereport(emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("sws_receive_slice failed"))));
+    return;
+  }
+  if (c->format != convert_format_yc48) {
+    return;
+  }
+  int const width = c->dst_width;
+  ptrdiff_t const plane_size = (ptrdiff_t)width * 2 * c->dst_height;
+  pixconv_yuv444p16_to_yc48(
+      &(struct pixconv_yuv){
+          .width = width,
+          .height = c->dst_height,
+          .planes = {c->sws_tmp, c->sws_tmp + plane_size, c->sws_tmp + plane_size * 2},
+          .strides = {width * 2, width * 2, width * 2},
+      },
+      c->dest,
+      width * 6,
+      b->y_begin,
+      b->y_end);
+}
+
+static void convert_band(struct band *const b) {
+  struct convert *const c = b->c;
+  AVFrame const *const frame = c->frame;
+  int const width = c->width;
+  int const height = c->height;
+  switch (c->mode) {
+  case mode_passthrough: {
+    bool const bgr = c->format == convert_format_bgr24;
+    size_t const row = (size_t)(width * (bgr ? 3 : 2));
+    for (int y = b->y_begin; y < b->y_end; ++y) {
+      // BGR24 is stored bottom-up.
+      size_t const dy = (size_t)(bgr ? height - 1 - y : y);
+      memcpy(c->dest + row * dy, frame->data[0] + (ptrdiff_t)frame->linesize[0] * y, row);
+    }
+    return;
+  }
+  case mode_pixconv: {
+    struct pixconv_yuv const src = {
+        .layout = c->pixconv_layout,
+        .full_range = c->pixconv_full_range,
+        .dither = c->dither,
+        .width = width,
+        .height = height,
+        .planes = {frame->data[0], frame->data[1], frame->data[2]},
+        .strides = {frame->linesize[0], frame->linesize[1], frame->linesize[2]},
+    };
+    if (c->format == convert_format_yc48) {
+      pixconv_yuv_to_yc48(&src, c->dest, width * 6, b->y_begin, b->y_end, c->pixconv_isa);
+    } else {
+      pixconv_yuv_to_yuy2(&src, c->dest, width * 2, b->y_begin, b->y_end, c->pixconv_isa);
+    }
+    return;
+  }
+  case mode_pixconv_rgb: {
+    struct pixconv_rgb const src = {
+        .layout = c->pixconv_rgb_layout,
+        .width = width,
+        .height = height,
+        .planes = {frame->data[0], frame->data[1], frame->data[2]},
+        .strides = {frame->linesize[0], frame->linesize[1], frame->linesize[2]},
+    };
+    // BGR24 is stored bottom-up.
+    ptrdiff_t const linesize = width * 3;
+    pixconv_rgb_to_bgr24(&src, c->dest + linesize * (height - 1), -linesize, b->y_begin, b->y_end, c->pixconv_isa);
+    return;
+  }
+  case mode_sws:
+    convert_band_sws(b);
+    return;
+  }
+}
+
+static void band_task(void *const userdata) { convert_band(userdata); }
+
+static NODISCARD error wrap_dest(struct convert *const c, uint8_t *const dest) {
+  int const width = c->dst_width;
+  int const height = c->dst_height;
+  AVFrame *const f = c->dst_frame;
+  uint8_t *const p = c->sws_tmp ? c->sws_tmp : dest;
+  size_t const size = (size_t)(width * height * (c->sws_tmp ? 6 : convert_get_bit_depth(c->format) / 8));
+  f->buf[0] = av_buffer_create(p, size, free_nothing, NULL, 0);
+  if (!f->buf[0]) {
+    return errg(err_out_of_memory);
+  }
+  f->width = width;
+  f->height = height;
+  switch (c->format) {
+  case convert_format_bgr24:
+    // BGR24 is stored bottom-up.
+    f->format = AV_PIX_FMT_BGR24;
+    f->data[0] = p + (ptrdiff_t)width * 3 * (height - 1);
+    f->linesize[0] = -width * 3;
+    break;
+  case convert_format_yuy2:
+    f->format = AV_PIX_FMT_YUYV422;
+    f->data[0] = p;
+    f->linesize[0] = width * 2;
+    break;
+  case convert_format_yc48:
+    f->format = AV_PIX_FMT_YUV444P16;
+    for (size_t i = 0; i < 3; ++i) {
+      f->data[i] = p + (ptrdiff_t)width * 2 * height * (ptrdiff_t)i;
+      f->linesize[i] = width * 2;
+    }
+    break;
+  }
+  return eok();
+}
+
+size_t convert_frame(struct convert *const c, AVFrame const *const frame, void *const dest) {
+  size_t written = 0;
+  c->frame = frame;
+  c->dest = dest;
+  if (frame->format != c->pix_fmt || frame->width != c->width || frame->height != c->height) {
+    ereport(emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("the frame does not match the converter"))));
+    goto cleanup;
+  }
+  c->mode = c->passthrough   ? mode_passthrough
+            : c->pixconv     ? mode_pixconv
+            : c->pixconv_rgb ? mode_pixconv_rgb
+                             : mode_sws;
+  if (c->mode == mode_sws) {
+    error err = wrap_dest(c, dest);
+    if (efailed(err)) {
+      ereport(err);
+      goto cleanup;
+    }
+  }
+  // The calling thread converts the first band itself instead of sleeping until the others finish.
+  for (size_t i = 1; i < c->num_bands; ++i) {
+    error err = tpool_submit(tpool_priority_foreground, &c->group, band_task, c->bands + i);
+    if (efailed(err)) {
+      ereport(err);
+      convert_band(c->bands + i);
+    }
+  }
+  convert_band(c->bands);
+  tpool_group_wait(&c->group);
+  written = (size_t)(c->dst_width * c->dst_height * convert_get_bit_depth(c->format) / 8);
+cleanup:
+  if (c->dst_frame) {
+    av_frame_unref(c->dst_frame);
+  }
+  c->frame = NULL;
+  c->dest = NULL;
+  return written;
+}
+
+void convert_destroy(struct convert **const cp) {
+  if (!cp || !*cp) {
+    return;
+  }
+  struct convert *const c = *cp;
+  if (c->bands) {
+    for (size_t i = 0; i < c->num_bands; ++i) {
+      if (c->bands[i].sws) {
+        sws_freeContext(c->bands[i].sws);
+      }
+    }
+    ereport(mem_free(&c->bands));
+  }
+  if (c->sws_tmp) {
+    ereport(mem_free(&c->sws_tmp));
+  }
+  av_frame_free(&c->dst_frame);
+  tpool_group_exit(&c->group);
+  ereport(mem_free(cp));
+}
+
+NODISCARD error convert_create(struct convert **const cp, struct convert_options const *const opt) {
+  if (!cp || *cp || !opt || opt->width <= 0 || opt->height <= 0 || opt->dst_width < 0 || opt->dst_height < 0) {
+    return errg(err_invalid_arugment);
+  }
+  AVPixFmtDescriptor const *const desc = av_pix_fmt_desc_get(opt->pix_fmt);
+  if (!desc) {
+    return errg(err_invalid_arugment);
+  }
+  struct convert *c = NULL;
+  struct SwsContext *first = NULL;
+  error err = mem(&c, 1, sizeof(struct convert));
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  *c = (struct convert){
+      .width = opt->width,
+      .height = opt->height,
+      .pix_fmt = opt->pix_fmt,
+      .dst_width = opt->dst_width ? opt->dst_width : opt->width,
+      .dst_height = opt->dst_height ? opt->dst_height : opt->height,
+      .format = opt->format,
+      .dither = opt->dither,
+      .pixconv_isa = pixconv_get_isa(),
+  };
+  tpool_group_init(&c->group);
+  bool const scaled = c->dst_width != c->width || c->dst_height != c->height;
+  c->passthrough = !scaled && ((opt->format == convert_format_yuy2 && opt->pix_fmt == AV_PIX_FMT_YUYV422) ||
+                               (opt->format == convert_format_bgr24 && opt->pix_fmt == AV_PIX_FMT_BGR24));
+  c->pixconv = !scaled && opt->format != convert_format_bgr24 && opt->width % 2 == 0 &&
+               get_pixconv_layout(opt->pix_fmt, &c->pixconv_layout, &c->pixconv_full_range);
+  c->pixconv_rgb = !scaled && opt->format == convert_format_bgr24 &&
+                   get_pixconv_rgb_layout(opt->pix_fmt, &c->pixconv_rgb_layout);
+  c->sws = !c->passthrough && !c->pixconv && !c->pixconv_rgb;
+
+  static int const sws_formats[] = {
+      [convert_format_bgr24] = AV_PIX_FMT_BGR24,
+      [convert_format_yuy2] = AV_PIX_FMT_YUYV422,
+      [convert_format_yc48] = AV_PIX_FMT_YUV444P16,
+  };
+  int align = 1;
+  size_t num_bands = 1;
+  if (c->sws) {
+    c->dst_frame = av_frame_alloc();
+    if (!c->dst_frame) {
+      err = errg(err_out_of_memory);
+      goto cleanup;
+    }
+    if (opt->format == convert_format_yc48) {
+      err = mem(&c->sws_tmp, (size_t)(c->dst_width * c->dst_height * 6), 1);
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+    }
+    // Output rows are split instead of source rows, swscale tells how they must be aligned.
+    first = sws_getContext(c->width,
+                           c->height,
+                           opt->pix_fmt,
+                           c->dst_width,
+                           c->dst_height,
+                           sws_formats[opt->format],
+                           opt->sws_flags,
+                           NULL,
+                           NULL,
+                           NULL);
+    if (!first) {
+      err = emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("sws_getContext failed")));
+      goto cleanup;
+    }
+    align = (int)sws_receive_slice_alignment(first);
+    num_bands = get_num_bands(opt, c->dst_height, align);
+  } else {
+    // The row copies and pixconv convert each band from its own source rows.
+    align = 1 << desc->log2_chroma_h;
+    num_bands = get_num_bands(opt, c->height, align);
+  }
+  err = mem(&c->bands, num_bands, sizeof(struct band));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  c->num_bands = num_bands;
+  int const units = (c->dst_height + align - 1) / align;
+  for (size_t i = 0; i < num_bands; ++i) {
+    int const y_begin = align * (int)((size_t)units * i / num_bands);
+    int const y_end = i + 1 == num_bands ? c->dst_height : align * (int)((size_t)units * (i + 1) / num_bands);
+    c->bands[i] = (struct band){
+        .c = c,
+        .y_begin = y_begin,
+        .y_end = y_end,
+    };
+    if (c->sws) {
+      if (first) {
+        c->bands[i].sws = first;
+        first = NULL;
+      } else {
+        c->bands[i].sws = sws_getContext(c->width,
+                                         c->height,
+                                         opt->pix_fmt,
+                                         c->dst_width,
+                                         c->dst_height,
+                                         sws_formats[opt->format],
+                                         opt->sws_flags,
+                                         NULL,
+                                         NULL,
+                                         NULL);
+      }
+      if (!c->bands[i].sws) {
+        err = emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("sws_getContext failed")));
+        goto cleanup;
+      }
+    }
+  }
+  *cp = c;
+cleanup:
+  if (first) {
+    sws_freeContext(first);
+  }
+  if (efailed(err)) {
+    convert_destroy(&c);
+  }
+  return err;
+}
+
+NODISCARD error convert_cache_create(struct convert_cache **const ccp, struct convert_options const *const opt) {
+  if (!ccp || *ccp || !opt) {
+    return errg(err_invalid_arugment);
+  }
+  struct convert_cache *cc = NULL;
+  error err = mem(&cc, 1, sizeof(struct convert_cache));
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  *cc = (struct convert_cache){
+      .opt = *opt,
+  };
+  // The output size must not follow the source after it changes.
+  if (!cc->opt.dst_width || !cc->opt.dst_height) {
+    cc->opt.dst_width = opt->width;
+    cc->opt.dst_height = opt->height;
+  }
+  // The initial format is created up front so that unsupported sources fail here instead of on the first frame.
+  err = convert_create(cc->entries, &cc->opt);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  cc->last_used[0] = ++cc->clock;
+  *ccp = cc;
+  cc = NULL;
+cleanup:
+  if (cc) {
+    convert_cache_destroy(&cc);
+  }
+  return err;
+}
+
+void convert_cache_destroy(struct convert_cache **const ccp) {
+  if (!ccp || !*ccp) {
+    return;
+  }
+  struct convert_cache *const cc = *ccp;
+  for (size_t i = 0; i < cache_size; ++i) {
+    convert_destroy(cc->entries + i);
+  }
+  ereport(mem_free(ccp));
+}
+
+static struct convert *find_convert(struct convert_cache *const cc, AVFrame const *const frame) {
+  size_t lru = 0;
+  for (size_t i = 0; i < cache_size; ++i) {
+    struct convert *const c = cc->entries[i];
+    if (c && c->pix_fmt == frame->format && c->width == frame->width && c->height == frame->height) {
+      cc->last_used[i] = ++cc->clock;
+      return c;
+    }
+    if (cc->last_used[i] < cc->last_used[lru]) {
+      lru = i;
+    }
+  }
+  // Empty slots have never been used, so they are chosen before any converter is evicted.
+  convert_destroy(cc->entries + lru);
+  cc->last_used[lru] = 0;
+  struct convert_options opt = cc->opt;
+  opt.width = frame->width;
+  opt.height = frame->height;
+  opt.pix_fmt = frame->format;
+  error err = convert_create(cc->entries + lru, &opt);
+  if (efailed(err)) {
+    ereport(err);
+    return NULL;
+  }
+  cc->last_used[lru] = ++cc->clock;
+  return cc->entries[lru];
+}
+
+size_t convert_cache_frame(struct convert_cache *const cc, AVFrame const *const frame, void *const dest) {
+  struct convert *const c = find_convert(cc, frame);
+  if (!c) {
+    return 0;
+  }
+  return convert_frame(c, frame, dest);
+}
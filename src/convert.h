@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ovbase.h"
+
+#include "ffmpeg.h"
+
+// Converts decoded frames into one of the formats AviUtl accepts from input plugins.
+// The frame is split into horizontal bands that are converted concurrently on the thread pool.
+// The output can be smaller than the source, swscale then scales in the same pass as the format conversion.
+
+struct convert;
+
+enum convert_format {
+  // bottom-up BGR24
+  convert_format_bgr24,
+  convert_format_yuy2,
+  // AviUtl's internal format, AviUtl does not need to convert it again.
+  convert_format_yc48,
+};
+
+struct convert_options {
+  int width;
+  int height;
+  int pix_fmt;
+  // Output size, 0 means the same as the source.
+  int dst_width;
+  int dst_height;
+  enum convert_format format;
+  int sws_flags;
+  // 0 chooses the number of bands from the frame size and the number of processors.
+  int bands;
+  // Uses ordered dithering instead of rounding when 10-bit sources are reduced to 8 bits.
+  bool dither;
+};
+
+// Returns the number of bits per pixel.
+int convert_get_bit_depth(enum convert_format const format);
+
+NODISCARD error convert_create(struct convert **const cp, struct convert_options const *const opt);
+void convert_destroy(struct convert **const cp);
+// Returns the number of bytes written to dest, or 0 if the frame differs from the source of the options.
+// A converter must not be used from multiple threads at the same time.
+size_t convert_frame(struct convert *const c, AVFrame const *const frame, void *const dest);
+
+// Keeps converters for the recently seen combinations of source size and pixel format,
+// so frames whose format or resolution changes mid-stream are converted without reopening the stream.
+// Every converter writes the output size of the options the cache was created with.
+struct convert_cache;
+
+NODISCARD error convert_cache_create(struct convert_cache **const ccp, struct convert_options const *const opt);
+void convert_cache_destroy(struct convert_cache **const ccp);
+// Returns the number of bytes written to dest, or 0 if no converter could be created for the frame.
+// A cache must not be used from multiple threads at the same time.
+size_t convert_cache_frame(struct convert_cache *const cc, AVFrame const *const frame, void *const dest);
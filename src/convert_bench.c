@@ -0,0 +1,385 @@
+#include "convert.h"
+#include "ffmpeg.h"
+#include "now.h"
+#include "pixconv.h"
+#include "tpool.h"
+
+#include <libavutil/pixdesc.h>
+#include <ovprintf.h>
+#include <ovutil/win32.h>
+#include <stdio.h>
+
+#ifndef FFMPEGDIR
+#  define FFMPEGDIR L"."
+#endif
+
+static void initdll(void) { SetDllDirectoryW(FFMPEGDIR); }
+#define TEST_MY_INIT initdll()
+#include "ovtest.h"
+
+enum {
+  iterations = 100,
+};
+
+static void report(char const *const name,
+                   char const *const impl,
+                   int const width,
+                   int const height,
+                   double const elapsed) {
+  char s[256];
+  ov_snprintf(s,
+              256,
+              NULL,
+              "%s %dx%d %s: %0.3fms/frame",
+              name,
+              width,
+              height,
+              impl,
+              elapsed * 1000 / (double)iterations);
+  puts(s);
+}
+
+// Fills every plane with a mid-range value that is valid for the bit depth of the format.
+static void fill_frame(AVFrame *const frame) {
+  AVPixFmtDescriptor const *const desc = av_pix_fmt_desc_get(frame->format);
+  int const depth = desc->comp[0].depth;
+  for (int p = 0; p < 3 && frame->data[p]; ++p) {
+    int const v = 0x80 + p * 16;
+    int const h = p == 0 ? frame->height : AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+    size_t const bytes = (size_t)(frame->linesize[p] * h);
+    if (depth <= 8) {
+      memset(frame->data[p], v, bytes);
+      continue;
+    }
+    uint16_t const v16 = (uint16_t)((v << (depth - 8)) << desc->comp[0].shift);
+    for (size_t i = 0; i < bytes; i += 2) {
+      memcpy(frame->data[p] + i, &v16, sizeof(v16));
+    }
+  }
+}
+
+static char const *const isa_names[] = {"c", "sse2", "ssse3", "avx2"};
+
+static void bench(char const *const name, enum AVPixelFormat const pix_fmt, enum pixconv_layout const layout) {
+  static int const sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    int const width = sizes[i][0];
+    int const height = sizes[i][1];
+    AVFrame *frame = av_frame_alloc();
+    struct SwsContext *sws = NULL;
+    void *buf = NULL;
+    if (!TEST_CHECK(frame != NULL)) {
+      goto cleanup;
+    }
+    frame->format = pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    if (!TEST_CHECK(av_frame_get_buffer(frame, 0) == 0)) {
+      goto cleanup;
+    }
+    fill_frame(frame);
+    // large enough for YC48.
+    if (!TEST_SUCCEEDED_F(mem(&buf, (size_t)(width * height * 6), 1))) {
+      goto cleanup;
+    }
+    sws = sws_getContext(width, height, pix_fmt, width, height, AV_PIX_FMT_YUYV422, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!TEST_CHECK(sws != NULL)) {
+      goto cleanup;
+    }
+
+    double start = now();
+    for (int n = 0; n < iterations; ++n) {
+      sws_scale(sws,
+                (const uint8_t *const *)frame->data,
+                frame->linesize,
+                0,
+                height,
+                (uint8_t *[4]){buf, NULL, NULL, NULL},
+                (int[4]){width * 2, 0, 0, 0});
+    }
+    report(name, "sws_scale", width, height, now() - start);
+
+    struct pixconv_yuv const src = {
+        .layout = layout,
+        .full_range = pix_fmt == AV_PIX_FMT_YUVJ420P,
+        .width = width,
+        .height = height,
+        .planes = {frame->data[0], frame->data[1], frame->data[2]},
+        .strides = {frame->linesize[0], frame->linesize[1], frame->linesize[2]},
+    };
+    for (int isa = pixconv_isa_c; isa <= (int)pixconv_get_isa(); ++isa) {
+      start = now();
+      for (int n = 0; n < iterations; ++n) {
+        pixconv_yuv_to_yuy2(&src, buf, width * 2, 0, height, (enum pixconv_isa)isa);
+      }
+      report(name, isa_names[isa], width, height, now() - start);
+    }
+    if (layout == pixconv_layout_yuv420p10 || layout == pixconv_layout_yuv422p10 || layout == pixconv_layout_p010) {
+      struct pixconv_yuv dithered = src;
+      dithered.dither = true;
+      for (int isa = pixconv_isa_c; isa <= (int)pixconv_get_isa(); ++isa) {
+        start = now();
+        for (int n = 0; n < iterations; ++n) {
+          pixconv_yuv_to_yuy2(&dithered, buf, width * 2, 0, height, (enum pixconv_isa)isa);
+        }
+        char impl[32];
+        ov_snprintf(impl, 32, NULL, "dither %s", isa_names[isa]);
+        report(name, impl, width, height, now() - start);
+      }
+    }
+    for (int isa = pixconv_isa_c; isa <= (int)pixconv_get_isa(); ++isa) {
+      start = now();
+      for (int n = 0; n < iterations; ++n) {
+        pixconv_yuv_to_yc48(&src, buf, width * 6, 0, height, (enum pixconv_isa)isa);
+      }
+      char impl[32];
+      ov_snprintf(impl, 32, NULL, "yc48 %s", isa_names[isa]);
+      report(name, impl, width, height, now() - start);
+    }
+  cleanup:
+    if (sws) {
+      sws_freeContext(sws);
+    }
+    if (buf) {
+      ereport(mem_free(&buf));
+    }
+    av_frame_free(&frame);
+  }
+}
+
+static void bench_yuv420p(void) { bench("yuv420p", AV_PIX_FMT_YUV420P, pixconv_layout_yuv420p); }
+static void bench_yuvj420p(void) { bench("yuvj420p", AV_PIX_FMT_YUVJ420P, pixconv_layout_yuv420p); }
+static void bench_yuv422p(void) { bench("yuv422p", AV_PIX_FMT_YUV422P, pixconv_layout_yuv422p); }
+static void bench_nv12(void) { bench("nv12", AV_PIX_FMT_NV12, pixconv_layout_nv12); }
+static void bench_yuv420p10(void) { bench("yuv420p10", AV_PIX_FMT_YUV420P10, pixconv_layout_yuv420p10); }
+static void bench_yuv422p10(void) { bench("yuv422p10", AV_PIX_FMT_YUV422P10, pixconv_layout_yuv422p10); }
+static void bench_p010(void) { bench("p010", AV_PIX_FMT_P010, pixconv_layout_p010); }
+
+// Screen capture codecs decode to RGB, the output is bottom-up BGR24.
+static void bench_rgb(char const *const name, enum AVPixelFormat const pix_fmt, enum pixconv_rgb_layout const layout) {
+  static int const sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    int const width = sizes[i][0];
+    int const height = sizes[i][1];
+    int const linesize = width * 3;
+    AVFrame *frame = av_frame_alloc();
+    struct SwsContext *sws = NULL;
+    uint8_t *buf = NULL;
+    if (!TEST_CHECK(frame != NULL)) {
+      goto cleanup;
+    }
+    frame->format = pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    if (!TEST_CHECK(av_frame_get_buffer(frame, 0) == 0)) {
+      goto cleanup;
+    }
+    fill_frame(frame);
+    if (!TEST_SUCCEEDED_F(mem(&buf, (size_t)(linesize * height), 1))) {
+      goto cleanup;
+    }
+    sws = sws_getContext(width, height, pix_fmt, width, height, AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!TEST_CHECK(sws != NULL)) {
+      goto cleanup;
+    }
+
+    double start = now();
+    for (int n = 0; n < iterations; ++n) {
+      sws_scale(sws,
+                (const uint8_t *const *)frame->data,
+                frame->linesize,
+                0,
+                height,
+                (uint8_t *[4]){buf + linesize * (height - 1), NULL, NULL, NULL},
+                (int[4]){-linesize, 0, 0, 0});
+    }
+    report(name, "sws_scale", width, height, now() - start);
+
+    struct pixconv_rgb const src = {
+        .layout = layout,
+        .width = width,
+        .height = height,
+        .planes = {frame->data[0], frame->data[1], frame->data[2]},
+        .strides = {frame->linesize[0], frame->linesize[1], frame->linesize[2]},
+    };
+    for (int isa = pixconv_isa_c; isa <= (int)pixconv_get_isa(); ++isa) {
+      start = now();
+      for (int n = 0; n < iterations; ++n) {
+        pixconv_rgb_to_bgr24(&src, buf + linesize * (height - 1), -linesize, 0, height, (enum pixconv_isa)isa);
+      }
+      report(name, isa_names[isa], width, height, now() - start);
+    }
+  cleanup:
+    if (sws) {
+      sws_freeContext(sws);
+    }
+    if (buf) {
+      ereport(mem_free(&buf));
+    }
+    av_frame_free(&frame);
+  }
+}
+
+static void bench_rgb24(void) { bench_rgb("rgb24", AV_PIX_FMT_RGB24, pixconv_rgb_layout_rgb24); }
+static void bench_bgr0(void) { bench_rgb("bgr0", AV_PIX_FMT_BGR0, pixconv_rgb_layout_bgrx); }
+static void bench_argb(void) { bench_rgb("argb", AV_PIX_FMT_ARGB, pixconv_rgb_layout_xrgb); }
+static void bench_gbrp(void) { bench_rgb("gbrp", AV_PIX_FMT_GBRP, pixconv_rgb_layout_gbrp); }
+
+// Reports the conversion time against the number of bands.
+// yuv444p has no dedicated kernel, so it measures banded swscale.
+// A non-zero dst_height scales the output down in the same pass.
+static void bench_bands(char const *const name, enum AVPixelFormat const pix_fmt, int const dst_height) {
+  static int const sizes[][2] = {{3840, 2160}, {7680, 4320}};
+  static int const bands[] = {1, 2, 4, 8, 16};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    int const width = sizes[i][0];
+    int const height = sizes[i][1];
+    int const dst_width = dst_height ? width * dst_height / height : 0;
+    AVFrame *frame = av_frame_alloc();
+    void *buf = NULL;
+    if (!TEST_CHECK(frame != NULL)) {
+      goto cleanup;
+    }
+    frame->format = pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    if (!TEST_CHECK(av_frame_get_buffer(frame, 0) == 0)) {
+      goto cleanup;
+    }
+    fill_frame(frame);
+    if (!TEST_SUCCEEDED_F(mem(&buf, (size_t)(width * height * 2), 1))) {
+      goto cleanup;
+    }
+    for (size_t j = 0; j < sizeof(bands) / sizeof(bands[0]); ++j) {
+      struct convert *c = NULL;
+      if (!TEST_SUCCEEDED_F(convert_create(&c,
+                                           &(struct convert_options){
+                                               .width = width,
+                                               .height = height,
+                                               .pix_fmt = pix_fmt,
+                                               .dst_width = dst_width,
+                                               .dst_height = dst_height,
+                                               .format = convert_format_yuy2,
+                                               .sws_flags = SWS_FAST_BILINEAR,
+                                               .bands = bands[j],
+                                           }))) {
+        goto cleanup;
+      }
+      // The first call starts the thread pool.
+      convert_frame(c, frame, buf);
+      double const start = now();
+      for (int n = 0; n < iterations; ++n) {
+        convert_frame(c, frame, buf);
+      }
+      double const elapsed = now() - start;
+      convert_destroy(&c);
+      char impl[32];
+      if (dst_height) {
+        ov_snprintf(impl, 32, NULL, "to %dx%d %d bands", dst_width, dst_height, bands[j]);
+      } else {
+        ov_snprintf(impl, 32, NULL, "%d bands", bands[j]);
+      }
+      report(name, impl, width, height, elapsed);
+    }
+  cleanup:
+    if (buf) {
+      ereport(mem_free(&buf));
+    }
+    av_frame_free(&frame);
+  }
+  tpool_exit();
+}
+
+static void bench_bands_yuv420p(void) { bench_bands("yuv420p", AV_PIX_FMT_YUV420P, 0); }
+static void bench_bands_yuv444p(void) { bench_bands("yuv444p", AV_PIX_FMT_YUV444P, 0); }
+static void bench_scale_yuv420p(void) { bench_bands("yuv420p", AV_PIX_FMT_YUV420P, 1080); }
+
+// Alternates between two source sizes, as streams with resolution switches do.
+// Recreating the converter on every switch is compared with looking it up in the cache.
+static void bench_resolution_switch(void) {
+  static int const sizes[][2] = {{1920, 1080}, {1280, 720}};
+  enum {
+    num_sizes = sizeof(sizes) / sizeof(sizes[0]),
+  };
+  struct convert_options const opt = {
+      .width = sizes[0][0],
+      .height = sizes[0][1],
+      .pix_fmt = AV_PIX_FMT_YUV420P,
+      .format = convert_format_yuy2,
+      .sws_flags = SWS_FAST_BILINEAR,
+  };
+  AVFrame *frames[num_sizes] = {0};
+  struct convert_cache *cc = NULL;
+  void *buf = NULL;
+  for (size_t i = 0; i < num_sizes; ++i) {
+    frames[i] = av_frame_alloc();
+    if (!TEST_CHECK(frames[i] != NULL)) {
+      goto cleanup;
+    }
+    frames[i]->format = AV_PIX_FMT_YUV420P;
+    frames[i]->width = sizes[i][0];
+    frames[i]->height = sizes[i][1];
+    if (!TEST_CHECK(av_frame_get_buffer(frames[i], 0) == 0)) {
+      goto cleanup;
+    }
+    fill_frame(frames[i]);
+  }
+  if (!TEST_SUCCEEDED_F(mem(&buf, (size_t)(opt.width * opt.height * 2), 1))) {
+    goto cleanup;
+  }
+
+  double start = now();
+  for (int n = 0; n < iterations; ++n) {
+    AVFrame const *const frame = frames[n % num_sizes];
+    struct convert *c = NULL;
+    struct convert_options o = opt;
+    o.width = frame->width;
+    o.height = frame->height;
+    o.dst_width = opt.width;
+    o.dst_height = opt.height;
+    if (!TEST_SUCCEEDED_F(convert_create(&c, &o))) {
+      goto cleanup;
+    }
+    convert_frame(c, frame, buf);
+    convert_destroy(&c);
+  }
+  report("yuv420p", "recreate", opt.width, opt.height, now() - start);
+
+  if (!TEST_SUCCEEDED_F(convert_cache_create(&cc, &opt))) {
+    goto cleanup;
+  }
+  start = now();
+  for (int n = 0; n < iterations; ++n) {
+    TEST_CHECK(convert_cache_frame(cc, frames[n % num_sizes], buf) == (size_t)(opt.width * opt.height * 2));
+  }
+  report("yuv420p", "cache", opt.width, opt.height, now() - start);
+
+cleanup:
+  convert_cache_destroy(&cc);
+  if (buf) {
+    ereport(mem_free(&buf));
+  }
+  for (size_t i = 0; i < num_sizes; ++i) {
+    av_frame_free(frames + i);
+  }
+  tpool_exit();
+}
+
+TEST_LIST = {
+    {"bench_yuv420p", bench_yuv420p},
+    {"bench_yuvj420p", bench_yuvj420p},
+    {"bench_yuv422p", bench_yuv422p},
+    {"bench_nv12", bench_nv12},
+    {"bench_yuv420p10", bench_yuv420p10},
+    {"bench_yuv422p10", bench_yuv422p10},
+    {"bench_p010", bench_p010},
+    {"bench_rgb24", bench_rgb24},
+    {"bench_bgr0", bench_bgr0},
+    {"bench_argb", bench_argb},
+    {"bench_gbrp", bench_gbrp},
+    {"bench_bands_yuv420p", bench_bands_yuv420p},
+    {"bench_bands_yuv444p", bench_bands_yuv444p},
+    {"bench_scale_yuv420p", bench_scale_yuv420p},
+    {"bench_resolution_switch", bench_resolution_switch},
+    {NULL, NULL},
+};
@@ -278,7 +278,9 @@ static NODISCARD error open_codec(AVCodec const *const codec,
                                   AVCodecParameters const *const codec_params,
                                   AVDictionary **const options,
                                   struct ffmpeg_stream *const fs,
-                                  bool const try_grab) {
+                                  bool const try_grab,
+                                  int const thread_count,
+                                  int const thread_type) {
   error err = eok();
   AVCodecContext *ctx = avcodec_alloc_context3(codec);
   if (!ctx) {
@@ -291,6 +293,12 @@ static NODISCARD error open_codec(AVCodec const *const codec,
     goto cleanup;
   }
   ctx->pkt_timebase = fs->stream->time_base;
+  if (thread_count > 0) {
+    ctx->thread_count = thread_count;
+  }
+  if (thread_type > 0) {
+    ctx->thread_type = thread_type;
+  }
   r = avcodec_open2(ctx, codec, options);
   if (r < 0) {
     err = errffmpeg(r);
@@ -321,7 +329,7 @@ static NODISCARD error open_preferred_codec(char const *const decoders,
                                             AVCodecParameters const *const codec_params,
                                             AVDictionary **const options,
                                             struct ffmpeg_stream *const fs,
-                                            bool const try_grab) {
+                                            struct ffmpeg_open_options const *const opt) {
   if (!codec || !codec_params || !fs) {
     return errg(err_invalid_arugment);
   }
@@ -330,7 +338,7 @@ static NODISCARD error open_preferred_codec(char const *const decoders,
     size_t pos = 0;
     AVCodec const *preferred = NULL;
     while ((preferred = find_preferred(avcodec_find_decoder_by_name, decoders, codec, &pos)) != NULL) {
-      err = open_codec(preferred, codec_params, options, fs, try_grab);
+      err = open_codec(preferred, codec_params, options, fs, opt->try_grab, opt->thread_count, opt->thread_type);
       if (efailed(err)) {
         err = ethru(err);
         wchar_t buf[1024];
@@ -348,7 +356,7 @@ static NODISCARD error open_preferred_codec(char const *const decoders,
       goto cleanup;
     }
   }
-  err = open_codec(codec, codec_params, options, fs, try_grab);
+  err = open_codec(codec, codec_params, options, fs, opt->try_grab, opt->thread_count, opt->thread_type);
   if (efailed(err)) {
     err = ethru(err);
     goto cleanup;
@@ -357,6 +365,14 @@ cleanup:
   return err;
 }
 
+static void apply_codec_workarounds(struct ffmpeg_stream *const fs) {
+  // workaround for h264_qsv
+  if (strcmp(fs->codec->name, "h264_qsv") == 0 && fs->cctx->pix_fmt == 0) {
+    // It seems that the correct format is not set, so set it manually.
+    fs->cctx->pix_fmt = AV_PIX_FMT_NV12;
+  }
+}
+
 void ffmpeg_close(struct ffmpeg_stream *const fs) {
   if (fs->packet) {
     av_packet_free(&fs->packet);
@@ -378,6 +394,20 @@ void ffmpeg_close(struct ffmpeg_stream *const fs) {
   }
 }
 
+size_t ffmpeg_get_memory_usage(struct ffmpeg_stream const *const fs) {
+  size_t r = 0;
+  if (fs->fctx && fs->fctx->pb) {
+    r += (size_t)fs->fctx->pb->buffer_size;
+  }
+  if (fs->stream) {
+    r += (size_t)avformat_index_get_entries_count(fs->stream) * sizeof(AVIndexEntry);
+  }
+  if (fs->packet && fs->packet->buf) {
+    r += fs->packet->buf->size;
+  }
+  return r;
+}
+
 NODISCARD error ffmpeg_open_without_codec(struct ffmpeg_stream *const fs, struct ffmpeg_open_options const *const opt) {
   if (!opt || (!opt->filepath && (opt->handle == NULL || opt->handle == INVALID_HANDLE_VALUE))) {
     return errg(err_invalid_arugment);
@@ -453,7 +483,8 @@ NODISCARD error ffmpeg_open(struct ffmpeg_stream *const fs, struct ffmpeg_open_o
   }
   fs->stream = fs->fctx->streams[stream_index];
   if (opt->codec != NULL) {
-    err = open_codec(opt->codec, fs->stream->codecpar, &options, fs, opt->try_grab);
+    err = open_codec(
+        opt->codec, fs->stream->codecpar, &options, fs, opt->try_grab, opt->thread_count, opt->thread_type);
     if (efailed(err)) {
       err = ethru(err);
       goto cleanup;
@@ -464,17 +495,13 @@ NODISCARD error ffmpeg_open(struct ffmpeg_stream *const fs, struct ffmpeg_open_o
       err = emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("decoder not found")));
       goto cleanup;
     }
-    err = open_preferred_codec(opt->preferred_decoders, orig_codec, fs->stream->codecpar, &options, fs, opt->try_grab);
+    err = open_preferred_codec(opt->preferred_decoders, orig_codec, fs->stream->codecpar, &options, fs, opt);
     if (efailed(err)) {
       err = ethru(err);
       goto cleanup;
     }
   }
-  // workaround for h264_qsv
-  if (strcmp(fs->codec->name, "h264_qsv") == 0 && fs->cctx->pix_fmt == 0) {
-    // It seems that the correct format is not set, so set it manually.
-    fs->cctx->pix_fmt = AV_PIX_FMT_NV12;
-  }
+  apply_codec_workarounds(fs);
 cleanup:
   if (options) {
     av_dict_free(&options);
@@ -485,6 +512,43 @@ cleanup:
   return err;
 }
 
+NODISCARD error ffmpeg_reopen_codec(struct ffmpeg_stream *const fs,
+                                    int const thread_count,
+                                    int const thread_type,
+                                    int const lowres) {
+  if (!fs || !fs->codec || !fs->cctx || !fs->stream || lowres < 0) {
+    return errg(err_invalid_arugment);
+  }
+  AVCodec const *const codec = fs->codec;
+  AVCodecContext *old_cctx = fs->cctx;
+  AVDictionary *options = NULL;
+  error err = eok();
+  int const lr = lowres < codec->max_lowres ? lowres : codec->max_lowres;
+  if (lr > 0) {
+    int const r = av_dict_set_int(&options, "lowres", lr, 0);
+    if (r < 0) {
+      err = errffmpeg(r);
+      goto cleanup;
+    }
+  }
+  // open_codec clears fs->cctx on failure, so keep the current decoder until the new one is ready.
+  err = open_codec(codec, fs->stream->codecpar, &options, fs, false, thread_count, thread_type);
+  if (efailed(err)) {
+    fs->codec = codec;
+    fs->cctx = old_cctx;
+    err = ethru(err);
+    goto cleanup;
+  }
+  avcodec_free_context(&old_cctx);
+  av_frame_unref(fs->frame);
+  apply_codec_workarounds(fs);
+cleanup:
+  if (options) {
+    av_dict_free(&options);
+  }
+  return err;
+}
+
 NODISCARD error ffmpeg_seek(struct ffmpeg_stream *const fs, int64_t const timestamp_in_stream_time_base) {
   int r = avformat_seek_file(
       fs->fctx, fs->stream->index, INT64_MIN, timestamp_in_stream_time_base, timestamp_in_stream_time_base, 0);
@@ -63,11 +63,25 @@ struct ffmpeg_open_options {
   // Sometimes, even if opening is successful, grabbing fails.
   // If this is set to true, it will test if grabbing is successful.
   bool try_grab;
+  // Decoder threading, 0 means libavcodec's default.
+  int thread_count;
+  int thread_type;
 };
 
 NODISCARD error ffmpeg_open_without_codec(struct ffmpeg_stream *const fs, struct ffmpeg_open_options const *const opt);
 NODISCARD error ffmpeg_open(struct ffmpeg_stream *const fs, struct ffmpeg_open_options const *const opt);
 void ffmpeg_close(struct ffmpeg_stream *const fs);
+// Recreates the decoder with different threading settings.
+// lowres decodes at 1/2^lowres of the size, it is limited to what the decoder supports.
+// The demuxer position is not changed, so the caller must seek before decoding again.
+NODISCARD error ffmpeg_reopen_codec(struct ffmpeg_stream *const fs,
+                                    int const thread_count,
+                                    int const thread_type,
+                                    int const lowres);
+
+// Returns the bytes held by the demuxer: the I/O buffer, the seek index and the current packet.
+// The memory used inside the decoder cannot be measured and is not included.
+size_t ffmpeg_get_memory_usage(struct ffmpeg_stream const *const fs);
 
 NODISCARD error ffmpeg_seek(struct ffmpeg_stream *const fs, int64_t const timestamp_in_stream_time_base);
 NODISCARD error ffmpeg_seek_bytes(struct ffmpeg_stream *const fs, int64_t const pos);
@@ -0,0 +1,274 @@
+#include "framepool.h"
+
+#include <ovthreads.h>
+#include <stdatomic.h>
+
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+enum {
+  max_classes = 16,
+  // Sizes are rounded up to a multiple of this, so frames of nearly the same size share a class.
+  class_granularity = 64 * 1024,
+  // Matches the padding avcodec_default_get_buffer2 adds for SIMD reads past the end of a plane.
+  plane_padding = 16 + 64 - 1,
+};
+
+// Idle buffers are linked through their own first bytes.
+struct idle {
+  struct idle *next;
+};
+
+struct size_class {
+  struct framepool *fp;
+  size_t size;
+  struct idle *idle;
+};
+
+struct framepool {
+  // One reference for the owner and one for each buffer in use, the last one frees the pool.
+  atomic_size_t refs;
+  // Bytes of buffers in use and idle buffers.
+  atomic_size_t allocated;
+  // Bytes of buffers allocated outside the pool that are still in use.
+  atomic_size_t unpooled;
+  size_t ceiling;
+  mtx_t mtx;
+  struct size_class classes[max_classes];
+  size_t num_classes;
+  // Set by framepool_destroy, buffers released after that are freed instead of kept.
+  bool closed;
+};
+
+static void release(struct framepool *fp) {
+  if (atomic_fetch_sub(&fp->refs, 1) != 1) {
+    return;
+  }
+  mtx_destroy(&fp->mtx);
+  ereport(mem_free(&fp));
+}
+
+// Frees the idle buffers of sc, the caller must hold fp->mtx.
+static void free_idle(struct size_class *const sc) {
+  while (sc->idle) {
+    struct idle *const next = sc->idle->next;
+    av_free(sc->idle);
+    atomic_fetch_sub(&sc->fp->allocated, sc->size);
+    sc->idle = next;
+  }
+}
+
+static void return_buffer(void *opaque, uint8_t *data) {
+  struct size_class *const sc = opaque;
+  struct framepool *const fp = sc->fp;
+  mtx_lock(&fp->mtx);
+  if (fp->closed) {
+    av_free(data);
+    atomic_fetch_sub(&fp->allocated, sc->size);
+  } else {
+    struct idle *const idle = (struct idle *)(void *)data;
+    idle->next = sc->idle;
+    sc->idle = idle;
+  }
+  mtx_unlock(&fp->mtx);
+  release(fp);
+}
+
+static struct size_class *find_class(struct framepool *const fp, size_t const size) {
+  for (size_t i = 0; i < fp->num_classes; ++i) {
+    if (fp->classes[i].size == size) {
+      return fp->classes + i;
+    }
+  }
+  if (fp->num_classes == max_classes) {
+    return NULL;
+  }
+  struct size_class *const sc = fp->classes + fp->num_classes++;
+  *sc = (struct size_class){
+      .fp = fp,
+      .size = size,
+  };
+  return sc;
+}
+
+// Takes an idle buffer or allocates a new one, the caller must hold fp->mtx.
+static uint8_t *take(struct framepool *const fp, struct size_class *const sc) {
+  if (sc->idle) {
+    struct idle *const idle = sc->idle;
+    sc->idle = idle->next;
+    return (uint8_t *)(void *)idle;
+  }
+  // Idle buffers of other sizes are not going to be used soon, for example after the resolution has changed.
+  for (size_t i = 0; i < fp->num_classes && atomic_load(&fp->allocated) + sc->size > fp->ceiling; ++i) {
+    free_idle(fp->classes + i);
+  }
+  if (atomic_load(&fp->allocated) + sc->size > fp->ceiling) {
+    return NULL;
+  }
+  uint8_t *const data = av_malloc(sc->size);
+  if (data) {
+    atomic_fetch_add(&fp->allocated, sc->size);
+  }
+  return data;
+}
+
+static AVBufferRef *get_buffer(struct framepool *const fp, size_t const size) {
+  size_t const class_size = (size + class_granularity - 1) / class_granularity * class_granularity;
+  mtx_lock(&fp->mtx);
+  struct size_class *const sc = find_class(fp, class_size);
+  uint8_t *const data = sc ? take(fp, sc) : NULL;
+  mtx_unlock(&fp->mtx);
+  if (!data) {
+    return NULL;
+  }
+  atomic_fetch_add(&fp->refs, 1);
+  AVBufferRef *const buf = av_buffer_create(data, class_size, return_buffer, sc, 0);
+  if (!buf) {
+    return_buffer(sc, data);
+  }
+  return buf;
+}
+
+// Buffers allocated once the ceiling is reached are not kept, but they are counted while in use.
+struct unpooled {
+  struct framepool *fp;
+  size_t size;
+};
+
+static void free_unpooled(void *opaque, uint8_t *data) {
+  struct unpooled *const u = opaque;
+  struct framepool *const fp = u->fp;
+  av_free(data);
+  atomic_fetch_sub(&fp->unpooled, u->size);
+  av_free(u);
+  release(fp);
+}
+
+static AVBufferRef *get_unpooled(struct framepool *const fp, size_t const size) {
+  struct unpooled *const u = av_malloc(sizeof(struct unpooled));
+  uint8_t *const data = av_malloc(size);
+  if (!u || !data) {
+    av_free(u);
+    av_free(data);
+    return NULL;
+  }
+  *u = (struct unpooled){
+      .fp = fp,
+      .size = size,
+  };
+  atomic_fetch_add(&fp->refs, 1);
+  atomic_fetch_add(&fp->unpooled, size);
+  AVBufferRef *const buf = av_buffer_create(data, size, free_unpooled, u, 0);
+  if (!buf) {
+    free_unpooled(u, data);
+  }
+  return buf;
+}
+
+NODISCARD error framepool_create(struct framepool **const fpp, size_t const ceiling) {
+  if (!fpp || *fpp) {
+    return errg(err_invalid_arugment);
+  }
+  struct framepool *fp = NULL;
+  error err = mem(&fp, 1, sizeof(struct framepool));
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  *fp = (struct framepool){
+      .ceiling = ceiling,
+  };
+  atomic_init(&fp->refs, 1);
+  atomic_init(&fp->allocated, 0);
+  atomic_init(&fp->unpooled, 0);
+  mtx_init(&fp->mtx, mtx_plain);
+  *fpp = fp;
+  return eok();
+}
+
+void framepool_destroy(struct framepool **const fpp) {
+  if (!fpp || !*fpp) {
+    return;
+  }
+  struct framepool *const fp = *fpp;
+  mtx_lock(&fp->mtx);
+  fp->closed = true;
+  for (size_t i = 0; i < fp->num_classes; ++i) {
+    free_idle(fp->classes + i);
+  }
+  mtx_unlock(&fp->mtx);
+  *fpp = NULL;
+  release(fp);
+}
+
+void framepool_trim(struct framepool *const fp) {
+  if (!fp) {
+    return;
+  }
+  mtx_lock(&fp->mtx);
+  for (size_t i = 0; i < fp->num_classes; ++i) {
+    free_idle(fp->classes + i);
+  }
+  mtx_unlock(&fp->mtx);
+}
+
+size_t framepool_get_allocated(struct framepool const *const fp) { return fp ? atomic_load(&fp->allocated) : 0; }
+
+size_t framepool_get_unpooled(struct framepool const *const fp) { return fp ? atomic_load(&fp->unpooled) : 0; }
+
+int framepool_get_buffer2(struct framepool *const fp,
+                          AVCodecContext *const avctx,
+                          AVFrame *const frame,
+                          int const flags) {
+  AVPixFmtDescriptor const *const desc = av_pix_fmt_desc_get(frame->format);
+  if (!fp || !(avctx->codec->capabilities & AV_CODEC_CAP_DR1) || avctx->hw_frames_ctx || !desc ||
+      (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))) {
+    return avcodec_default_get_buffer2(avctx, frame, flags);
+  }
+  // Same layout as avcodec_default_get_buffer2, the width grows until every stride meets the decoder's alignment.
+  int w = frame->width;
+  int h = frame->height;
+  int align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(avctx, &w, &h, align);
+  int linesizes[4] = {0};
+  for (;;) {
+    if (av_image_fill_linesizes(linesizes, frame->format, w) < 0) {
+      return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+    bool aligned = true;
+    for (size_t i = 0; i < 4; ++i) {
+      aligned = aligned && linesizes[i] % align[i] == 0;
+    }
+    if (aligned) {
+      break;
+    }
+    w += w & ~(w - 1);
+  }
+  ptrdiff_t const strides[4] = {linesizes[0], linesizes[1], linesizes[2], linesizes[3]};
+  size_t sizes[4] = {0};
+  if (av_image_fill_plane_sizes(sizes, frame->format, h, strides) < 0) {
+    return avcodec_default_get_buffer2(avctx, frame, flags);
+  }
+  for (size_t i = 0; i < 4 && sizes[i]; ++i) {
+    frame->buf[i] = get_buffer(fp, sizes[i] + plane_padding);
+    if (!frame->buf[i]) {
+      // The ceiling was reached, the plane is allocated outside the pool.
+      frame->buf[i] = get_unpooled(fp, sizes[i] + plane_padding);
+    }
+    if (!frame->buf[i]) {
+      goto fallback;
+    }
+    frame->data[i] = frame->buf[i]->data;
+    frame->linesize[i] = linesizes[i];
+  }
+  frame->extended_data = frame->data;
+  return 0;
+
+fallback:
+  // Out of memory, the default allocator gets the last chance.
+  for (size_t i = 0; i < 4; ++i) {
+    av_buffer_unref(&frame->buf[i]);
+    frame->data[i] = NULL;
+    frame->linesize[i] = 0;
+  }
+  return avcodec_default_get_buffer2(avctx, frame, flags);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ovbase.h"
+
+#include "ffmpeg.h"
+
+// Decoder frame buffers shared by all decoders of a file.
+// Buffers are grouped by size and reused after a frame is released, so seeks and flushes do not fault in new memory.
+// Once the pool holds ceiling bytes, idle buffers of other sizes are freed first,
+// and frames that still do not fit are allocated outside the pool and freed when they are released.
+
+struct framepool;
+
+NODISCARD error framepool_create(struct framepool **const fpp, size_t const ceiling);
+// Buffers still referenced by frames stay valid, the memory is freed when the last one is released.
+void framepool_destroy(struct framepool **const fpp);
+// Frees the buffers that are not in use, for example after decoders have been closed.
+void framepool_trim(struct framepool *const fp);
+// Returns the number of bytes allocated by the pool, including buffers that are not in use.
+size_t framepool_get_allocated(struct framepool const *const fp);
+// Returns the number of bytes of frames allocated outside the pool that are still in use.
+size_t framepool_get_unpooled(struct framepool const *const fp);
+// get_buffer2 implementation, fp can be NULL.
+// Decoders without AV_CODEC_CAP_DR1, hardware frames and palette formats use avcodec_default_get_buffer2.
+int framepool_get_buffer2(struct framepool *const fp,
+                          AVCodecContext *const avctx,
+                          AVFrame *const frame,
+                          int const flags);
@@ -0,0 +1,148 @@
+#include "framepool.c"
+
+#include <ovutil/win32.h>
+
+#ifndef FFMPEGDIR
+#  define FFMPEGDIR L"."
+#endif
+
+static void initdll(void) { SetDllDirectoryW(FFMPEGDIR); }
+#define TEST_MY_INIT initdll()
+#include "ovtest.h"
+
+static AVCodecContext *open_decoder(void) {
+  AVCodec const *const codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+  if (!TEST_CHECK(codec != NULL)) {
+    return NULL;
+  }
+  AVCodecContext *cctx = avcodec_alloc_context3(codec);
+  if (!TEST_CHECK(cctx != NULL)) {
+    return NULL;
+  }
+  cctx->pix_fmt = AV_PIX_FMT_YUV420P;
+  if (!TEST_CHECK(avcodec_open2(cctx, codec, NULL) == 0)) {
+    avcodec_free_context(&cctx);
+  }
+  return cctx;
+}
+
+static AVFrame *get_frame(struct framepool *const fp, AVCodecContext *const cctx) {
+  AVFrame *frame = av_frame_alloc();
+  if (!TEST_CHECK(frame != NULL)) {
+    return NULL;
+  }
+  frame->format = AV_PIX_FMT_YUV420P;
+  frame->width = 1920;
+  frame->height = 1080;
+  if (!TEST_CHECK(framepool_get_buffer2(fp, cctx, frame, 0) == 0)) {
+    av_frame_free(&frame);
+    return NULL;
+  }
+  // Every plane must be writable up to its last row.
+  memset(frame->data[0], 0, (size_t)(frame->linesize[0] * frame->height));
+  memset(frame->data[1], 0, (size_t)(frame->linesize[1] * frame->height / 2));
+  memset(frame->data[2], 0, (size_t)(frame->linesize[2] * frame->height / 2));
+  return frame;
+}
+
+static void test_reuse(void) {
+  struct framepool *fp = NULL;
+  AVCodecContext *cctx = open_decoder();
+  AVFrame *frame = NULL;
+  if (!cctx || !TEST_SUCCEEDED_F(framepool_create(&fp, 64 * 1024 * 1024))) {
+    goto cleanup;
+  }
+  frame = get_frame(fp, cctx);
+  if (!frame) {
+    goto cleanup;
+  }
+  uint8_t const *const first = frame->data[0];
+  size_t const allocated = framepool_get_allocated(fp);
+  TEST_CHECK(allocated > 0);
+  av_frame_free(&frame);
+  TEST_CHECK(framepool_get_allocated(fp) == allocated);
+
+  frame = get_frame(fp, cctx);
+  if (!frame) {
+    goto cleanup;
+  }
+  TEST_CHECK(frame->data[0] == first);
+  TEST_CHECK(framepool_get_allocated(fp) == allocated);
+cleanup:
+  av_frame_free(&frame);
+  framepool_destroy(&fp);
+  avcodec_free_context(&cctx);
+}
+
+static void test_ceiling(void) {
+  struct framepool *fp = NULL;
+  AVCodecContext *cctx = open_decoder();
+  AVFrame *frame = NULL;
+  // Too small for a single plane, every frame must be allocated outside the pool.
+  if (!cctx || !TEST_SUCCEEDED_F(framepool_create(&fp, 1024))) {
+    goto cleanup;
+  }
+  frame = get_frame(fp, cctx);
+  TEST_CHECK(frame != NULL);
+  TEST_CHECK(framepool_get_allocated(fp) == 0);
+  // They are still counted while they are in use.
+  TEST_CHECK(framepool_get_unpooled(fp) > 0);
+  av_frame_free(&frame);
+  TEST_CHECK(framepool_get_unpooled(fp) == 0);
+cleanup:
+  av_frame_free(&frame);
+  framepool_destroy(&fp);
+  avcodec_free_context(&cctx);
+}
+
+static void test_trim(void) {
+  struct framepool *fp = NULL;
+  AVCodecContext *cctx = open_decoder();
+  AVFrame *frame = NULL;
+  if (!cctx || !TEST_SUCCEEDED_F(framepool_create(&fp, 64 * 1024 * 1024))) {
+    goto cleanup;
+  }
+  frame = get_frame(fp, cctx);
+  if (!frame) {
+    goto cleanup;
+  }
+  size_t const allocated = framepool_get_allocated(fp);
+  // Buffers in use are kept.
+  framepool_trim(fp);
+  TEST_CHECK(framepool_get_allocated(fp) == allocated);
+  av_frame_free(&frame);
+  framepool_trim(fp);
+  TEST_CHECK(framepool_get_allocated(fp) == 0);
+cleanup:
+  av_frame_free(&frame);
+  framepool_destroy(&fp);
+  avcodec_free_context(&cctx);
+}
+
+static void test_frame_outlives_pool(void) {
+  struct framepool *fp = NULL;
+  AVCodecContext *cctx = open_decoder();
+  AVFrame *frame = NULL;
+  if (!cctx || !TEST_SUCCEEDED_F(framepool_create(&fp, 64 * 1024 * 1024))) {
+    goto cleanup;
+  }
+  frame = get_frame(fp, cctx);
+  framepool_destroy(&fp);
+  TEST_CHECK(fp == NULL);
+  if (!frame) {
+    goto cleanup;
+  }
+  memset(frame->data[0], 1, (size_t)frame->linesize[0]);
+cleanup:
+  av_frame_free(&frame);
+  framepool_destroy(&fp);
+  avcodec_free_context(&cctx);
+}
+
+TEST_LIST = {
+    {"test_reuse", test_reuse},
+    {"test_ceiling", test_ceiling},
+    {"test_trim", test_trim},
+    {"test_frame_outlives_pool", test_frame_outlives_pool},
+    {NULL, NULL},
+};
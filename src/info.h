@@ -8,6 +8,7 @@ struct info_video {
   int32_t height;
   int32_t bit_depth;
   int32_t is_rgb;
+  int32_t is_yc48;
   int32_t frame_rate;
   int32_t frame_scale;
 };
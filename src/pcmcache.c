@@ -0,0 +1,216 @@
+#include "pcmcache.h"
+
+#include <string.h>
+
+enum {
+  // 85ms at 48kHz, AviUtl reads about one video frame of samples at a time.
+  block_samples = 4096,
+};
+
+struct slot {
+  int64_t index;
+  // The cached samples are [lo, hi) in the block, writes that do not touch them replace them.
+  int lo;
+  int hi;
+  uint64_t used;
+  uint8_t *data;
+};
+
+struct blockitem {
+  int64_t index;
+  size_t slot;
+};
+
+struct pcmcache {
+  struct hmap map;
+  struct slot *slots;
+  // Number of blocks the budget allows.
+  size_t cap;
+  size_t len;
+  size_t sample_size;
+  uint64_t clock;
+};
+
+static inline int imin(int const a, int const b) { return a > b ? b : a; }
+static inline int imax(int const a, int const b) { return a > b ? a : b; }
+
+NODISCARD error pcmcache_create(struct pcmcache **const pcp, size_t const sample_size, size_t const budget) {
+  if (!pcp || *pcp || !sample_size || budget < (size_t)block_samples * sample_size) {
+    return errg(err_invalid_arugment);
+  }
+  struct pcmcache *pc = NULL;
+  error err = mem(&pc, 1, sizeof(struct pcmcache));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  *pc = (struct pcmcache){
+      .cap = budget / ((size_t)block_samples * sample_size),
+      .sample_size = sample_size,
+  };
+  err = mem(&pc->slots, pc->cap, sizeof(struct slot));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = hmnews(&pc->map, sizeof(struct blockitem), 64, sizeof(int64_t));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  *pcp = pc;
+cleanup:
+  if (efailed(err)) {
+    pcmcache_destroy(&pc);
+  }
+  return err;
+}
+
+void pcmcache_destroy(struct pcmcache **const pcp) {
+  if (!pcp || !*pcp) {
+    return;
+  }
+  struct pcmcache *const pc = *pcp;
+  for (size_t i = 0; i < pc->len; ++i) {
+    ereport(mem_free(&pc->slots[i].data));
+  }
+  if (pc->slots) {
+    ereport(mem_free(&pc->slots));
+  }
+  ereport(hmfree(&pc->map));
+  ereport(mem_free(pcp));
+}
+
+static struct slot *find_slot(struct pcmcache *const pc, int64_t const index) {
+  struct blockitem *bi = NULL;
+  error err = hmget(&pc->map, &((struct blockitem){.index = index}), &bi);
+  if (efailed(err)) {
+    ereport(err);
+    return NULL;
+  }
+  return bi ? pc->slots + bi->slot : NULL;
+}
+
+// Allocates a block while the budget allows, then reuses the least recently used one.
+static NODISCARD error new_slot(struct pcmcache *const pc, int64_t const index, struct slot **const sp) {
+  error err = eok();
+  struct slot *s = NULL;
+  if (pc->len < pc->cap) {
+    s = pc->slots + pc->len;
+    *s = (struct slot){0};
+    err = mem(&s->data, block_samples, pc->sample_size);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+    ++pc->len;
+  } else {
+    s = pc->slots;
+    for (size_t i = 1; i < pc->len; ++i) {
+      if (pc->slots[i].used < s->used) {
+        s = pc->slots + i;
+      }
+    }
+    err = hmdelete(&pc->map, &((struct blockitem){.index = s->index}), NULL);
+    if (efailed(err)) {
+      // A block whose hmset failed is not in the map.
+      if (!eisg(err, err_not_found)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+      efree(&err);
+    }
+  }
+  s->index = index;
+  s->lo = 0;
+  s->hi = 0;
+  err = hmset(&pc->map,
+              &((struct blockitem){
+                  .index = index,
+                  .slot = (size_t)(s - pc->slots),
+              }),
+              NULL);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  *sp = s;
+cleanup:
+  return err;
+}
+
+int pcmcache_read(struct pcmcache *const pc, int64_t const pos, int const samples, void *const dest) {
+  if (!pc || pos < 0) {
+    return 0;
+  }
+  uint8_t *d = dest;
+  int read = 0;
+  while (read < samples) {
+    int64_t const p = pos + read;
+    struct slot *const s = find_slot(pc, p / block_samples);
+    int const offset = (int)(p % block_samples);
+    if (!s || offset < s->lo || offset >= s->hi) {
+      break;
+    }
+    int const n = imin(s->hi - offset, samples - read);
+    memcpy(d, s->data + (size_t)offset * pc->sample_size, (size_t)n * pc->sample_size);
+    s->used = ++pc->clock;
+    d += (size_t)n * pc->sample_size;
+    read += n;
+  }
+  return read;
+}
+
+NODISCARD error pcmcache_write(struct pcmcache *const pc, int64_t const pos, int const samples, void const *const src) {
+  if (!pc || pos < 0 || samples < 0 || !src) {
+    return errg(err_invalid_arugment);
+  }
+  error err = eok();
+  uint8_t const *s = src;
+  int written = 0;
+  while (written < samples) {
+    int64_t const p = pos + written;
+    int64_t const index = p / block_samples;
+    int const lo = (int)(p % block_samples);
+    int const n = imin(block_samples - lo, samples - written);
+    struct slot *sl = find_slot(pc, index);
+    if (!sl) {
+      err = new_slot(pc, index, &sl);
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+    }
+    if (sl->lo < sl->hi && lo <= sl->hi && lo + n >= sl->lo) {
+      sl->lo = imin(sl->lo, lo);
+      sl->hi = imax(sl->hi, lo + n);
+    } else {
+      sl->lo = lo;
+      sl->hi = lo + n;
+    }
+    memcpy(sl->data + (size_t)lo * pc->sample_size, s, (size_t)n * pc->sample_size);
+    sl->used = ++pc->clock;
+    s += (size_t)n * pc->sample_size;
+    written += n;
+  }
+cleanup:
+  return err;
+}
+
+void pcmcache_clear(struct pcmcache *const pc) {
+  if (!pc) {
+    return;
+  }
+  for (size_t i = 0; i < pc->len; ++i) {
+    ereport(hmdelete(&pc->map, &((struct blockitem){.index = pc->slots[i].index}), NULL));
+    ereport(mem_free(&pc->slots[i].data));
+  }
+  pc->len = 0;
+}
+
+size_t pcmcache_get_memory_usage(struct pcmcache const *const pc) {
+  if (!pc) {
+    return 0;
+  }
+  return pc->len * (size_t)block_samples * pc->sample_size + pc->cap * sizeof(struct slot);
+}
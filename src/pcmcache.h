@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ovbase.h"
+
+// Keeps the resampled output of a file in fixed-size blocks keyed by the output sample position,
+// so overlapping and repeated reads are copied without seeking or decoding.
+// Once the cache holds budget bytes, the least recently used blocks are reused.
+
+struct pcmcache;
+
+NODISCARD error pcmcache_create(struct pcmcache **const pcp, size_t const sample_size, size_t const budget);
+void pcmcache_destroy(struct pcmcache **const pcp);
+// Copies the cached samples from pos to dest and returns the number of samples copied.
+// It stops at the first sample that is not cached.
+int pcmcache_read(struct pcmcache *const pc, int64_t const pos, int const samples, void *const dest);
+// Stores the samples from pos.
+NODISCARD error pcmcache_write(struct pcmcache *const pc, int64_t const pos, int const samples, void const *const src);
+// Discards every block and frees their memory.
+void pcmcache_clear(struct pcmcache *const pc);
+// Returns the bytes used by the cache.
+size_t pcmcache_get_memory_usage(struct pcmcache const *const pc);
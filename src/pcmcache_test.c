@@ -0,0 +1,115 @@
+#include "pcmcache.c"
+
+#include "ovtest.h"
+
+enum {
+  sample_size = 4,
+};
+
+static void fill(int32_t *const buf, int64_t const pos, int const samples) {
+  for (int i = 0; i < samples; ++i) {
+    buf[i] = (int32_t)(pos + i);
+  }
+}
+
+static bool verify(int32_t const *const buf, int64_t const pos, int const samples) {
+  for (int i = 0; i < samples; ++i) {
+    if (buf[i] != (int32_t)(pos + i)) {
+      TEST_MSG("want %lld got %d at %d", (long long)(pos + i), buf[i], i);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void test_read_write(void) {
+  struct pcmcache *pc = NULL;
+  static int32_t buf[block_samples * 3];
+  if (!TEST_SUCCEEDED_F(pcmcache_create(&pc, sample_size, 1024 * 1024))) {
+    goto cleanup;
+  }
+  TEST_CHECK(pcmcache_read(pc, 0, 100, buf) == 0);
+
+  // Spans three blocks.
+  int64_t const pos = block_samples - 100;
+  int const samples = block_samples * 2;
+  fill(buf, pos, samples);
+  if (!TEST_SUCCEEDED_F(pcmcache_write(pc, pos, samples, buf))) {
+    goto cleanup;
+  }
+  memset(buf, 0, sizeof(buf));
+  TEST_CHECK(pcmcache_read(pc, pos, samples, buf) == samples);
+  TEST_CHECK(verify(buf, pos, samples));
+
+  // Overlapping reads stop at the end of the cached range.
+  memset(buf, 0, sizeof(buf));
+  TEST_CHECK(pcmcache_read(pc, pos + 10, samples, buf) == samples - 10);
+  TEST_CHECK(verify(buf, pos + 10, samples - 10));
+  TEST_CHECK(pcmcache_read(pc, pos - 1, samples, buf) == 0);
+cleanup:
+  pcmcache_destroy(&pc);
+}
+
+static void test_extend(void) {
+  struct pcmcache *pc = NULL;
+  static int32_t buf[block_samples];
+  if (!TEST_SUCCEEDED_F(pcmcache_create(&pc, sample_size, 1024 * 1024))) {
+    goto cleanup;
+  }
+  // Adjacent writes in a block are joined.
+  fill(buf, 100, 100);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, 100, 100, buf)));
+  fill(buf, 200, 100);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, 200, 100, buf)));
+  fill(buf, 50, 60);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, 50, 60, buf)));
+  memset(buf, 0, sizeof(buf));
+  TEST_CHECK(pcmcache_read(pc, 50, 1000, buf) == 250);
+  TEST_CHECK(verify(buf, 50, 250));
+
+  // A write that does not touch the cached range replaces it.
+  fill(buf, 1000, 10);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, 1000, 10, buf)));
+  TEST_CHECK(pcmcache_read(pc, 50, 10, buf) == 0);
+  TEST_CHECK(pcmcache_read(pc, 1000, 100, buf) == 10);
+  TEST_CHECK(verify(buf, 1000, 10));
+cleanup:
+  pcmcache_destroy(&pc);
+}
+
+static void test_budget(void) {
+  struct pcmcache *pc = NULL;
+  static int32_t buf[block_samples];
+  if (!TEST_SUCCEEDED_F(pcmcache_create(&pc, sample_size, block_samples * sample_size * 2))) {
+    goto cleanup;
+  }
+  fill(buf, 0, block_samples);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, 0, block_samples, buf)));
+  fill(buf, block_samples, block_samples);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, block_samples, block_samples, buf)));
+  size_t const usage = pcmcache_get_memory_usage(pc);
+
+  // The first block is read again, so the second one is reused.
+  TEST_CHECK(pcmcache_read(pc, 0, 1, buf) == 1);
+  fill(buf, block_samples * 5, block_samples);
+  TEST_CHECK(TEST_SUCCEEDED_F(pcmcache_write(pc, block_samples * 5, block_samples, buf)));
+  TEST_CHECK(pcmcache_get_memory_usage(pc) == usage);
+  TEST_CHECK(pcmcache_read(pc, block_samples, 1, buf) == 0);
+  TEST_CHECK(pcmcache_read(pc, 0, block_samples, buf) == block_samples);
+  TEST_CHECK(verify(buf, 0, block_samples));
+  TEST_CHECK(pcmcache_read(pc, block_samples * 5, block_samples, buf) == block_samples);
+  TEST_CHECK(verify(buf, block_samples * 5, block_samples));
+
+  pcmcache_clear(pc);
+  TEST_CHECK(pcmcache_read(pc, 0, 1, buf) == 0);
+  TEST_CHECK(pcmcache_get_memory_usage(pc) < usage);
+cleanup:
+  pcmcache_destroy(&pc);
+}
+
+TEST_LIST = {
+    {"test_read_write", test_read_write},
+    {"test_extend", test_extend},
+    {"test_budget", test_budget},
+    {NULL, NULL},
+};
@@ -0,0 +1,252 @@
+#include "pcmconv.h"
+
+#include "pixconv.h"
+
+#include <math.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#  define PCMCONV_X86 1
+#  include <immintrin.h>
+#else
+#  define PCMCONV_X86 0
+#endif
+
+// swresample converts float to 16-bit by lrintf(v * 32768) and clipping.
+// Clipping before rounding gives the same result and keeps large values out of the range cvtps2dq can convert.
+static float const scale = 32768.f;
+static float const clip_lo = -32768.f;
+static float const clip_hi = 32767.f;
+
+// Downmix coefficients of swresample for 5.1 to stereo without any options.
+// Front is 1, center and surround are sqrt(1/2), then every row is divided by 1 + 2 * sqrt(1/2).
+static float const mix_front = (float)0.41421356237309503;
+static float const mix_other = (float)0.29289321881345248;
+
+typedef void (*fltp_func)(int16_t *const dst, float const *const *const planes, size_t const samples);
+
+// Every kernel clips with the operand order of maxps and minps so that NaN is converted the same way.
+static inline int16_t to_s16(float const v) {
+  float c = v * scale;
+  c = c > clip_lo ? c : clip_lo;
+  c = c < clip_hi ? c : clip_hi;
+  long const r = lrintf(c);
+  return (int16_t)r;
+}
+
+static inline float downmix(float const front, float const center, float const surround) {
+  float v = front * mix_front;
+  v += center * mix_other;
+  v += surround * mix_other;
+  return v;
+}
+
+static void stereo_c(int16_t *const dst, float const *const *const planes, size_t const samples) {
+  float const *const l = planes[0];
+  float const *const r = planes[1];
+  for (size_t i = 0; i < samples; ++i) {
+    dst[i * 2 + 0] = to_s16(l[i]);
+    dst[i * 2 + 1] = to_s16(r[i]);
+  }
+}
+
+static void downmix_5_1_c(int16_t *const dst, float const *const *const planes, size_t const samples) {
+  for (size_t i = 0; i < samples; ++i) {
+    dst[i * 2 + 0] = to_s16(downmix(planes[0][i], planes[2][i], planes[4][i]));
+    dst[i * 2 + 1] = to_s16(downmix(planes[1][i], planes[2][i], planes[5][i]));
+  }
+}
+
+#if PCMCONV_X86
+
+__attribute__((target("sse2"))) static inline __m128i to_s32_sse2(__m128 const v) {
+  __m128 c = _mm_mul_ps(v, _mm_set1_ps(scale));
+  c = _mm_max_ps(c, _mm_set1_ps(clip_lo));
+  c = _mm_min_ps(c, _mm_set1_ps(clip_hi));
+  return _mm_cvtps_epi32(c);
+}
+
+__attribute__((target("sse2"))) static inline __m128
+downmix_sse2(float const *const front, float const *const center, float const *const surround) {
+  __m128 v = _mm_mul_ps(_mm_loadu_ps(front), _mm_set1_ps(mix_front));
+  v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(center), _mm_set1_ps(mix_other)));
+  v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(surround), _mm_set1_ps(mix_other)));
+  return v;
+}
+
+__attribute__((target("sse2"))) static inline void store_sse2(int16_t *const dst, __m128i const l, __m128i const r) {
+  _mm_storeu_si128((void *)dst, _mm_unpacklo_epi16(l, r));
+  _mm_storeu_si128((void *)(dst + 8), _mm_unpackhi_epi16(l, r));
+}
+
+__attribute__((target("sse2"))) static void
+stereo_sse2(int16_t *const dst, float const *const *const planes, size_t const samples) {
+  float const *const l = planes[0];
+  float const *const r = planes[1];
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i const l0 = to_s32_sse2(_mm_loadu_ps(l + i));
+    __m128i const l1 = to_s32_sse2(_mm_loadu_ps(l + i + 4));
+    __m128i const r0 = to_s32_sse2(_mm_loadu_ps(r + i));
+    __m128i const r1 = to_s32_sse2(_mm_loadu_ps(r + i + 4));
+    store_sse2(dst + i * 2, _mm_packs_epi32(l0, l1), _mm_packs_epi32(r0, r1));
+  }
+  stereo_c(dst + i * 2, (float const *const[2]){l + i, r + i}, samples - i);
+}
+
+__attribute__((target("sse2"))) static void
+downmix_5_1_sse2(int16_t *const dst, float const *const *const planes, size_t const samples) {
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    float const *const fl = planes[0] + i;
+    float const *const fr = planes[1] + i;
+    float const *const fc = planes[2] + i;
+    float const *const sl = planes[4] + i;
+    float const *const sr = planes[5] + i;
+    __m128i const l0 = to_s32_sse2(downmix_sse2(fl, fc, sl));
+    __m128i const l1 = to_s32_sse2(downmix_sse2(fl + 4, fc + 4, sl + 4));
+    __m128i const r0 = to_s32_sse2(downmix_sse2(fr, fc, sr));
+    __m128i const r1 = to_s32_sse2(downmix_sse2(fr + 4, fc + 4, sr + 4));
+    store_sse2(dst + i * 2, _mm_packs_epi32(l0, l1), _mm_packs_epi32(r0, r1));
+  }
+  downmix_5_1_c(dst + i * 2,
+                (float const *const[6]){
+                    planes[0] + i,
+                    planes[1] + i,
+                    planes[2] + i,
+                    NULL,
+                    planes[4] + i,
+                    planes[5] + i,
+                },
+                samples - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i to_s32_avx2(__m256 const v) {
+  __m256 c = _mm256_mul_ps(v, _mm256_set1_ps(scale));
+  c = _mm256_max_ps(c, _mm256_set1_ps(clip_lo));
+  c = _mm256_min_ps(c, _mm256_set1_ps(clip_hi));
+  return _mm256_cvtps_epi32(c);
+}
+
+__attribute__((target("avx2"))) static inline __m256
+downmix_avx2(float const *const front, float const *const center, float const *const surround) {
+  __m256 v = _mm256_mul_ps(_mm256_loadu_ps(front), _mm256_set1_ps(mix_front));
+  v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(center), _mm256_set1_ps(mix_other)));
+  v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(surround), _mm256_set1_ps(mix_other)));
+  return v;
+}
+
+// packs and unpack work in 128-bit lanes, so packing samples 0-7 with 8-15 and interleaving
+// puts samples 0-3 and 4-7 in the lanes of the first vector and 8-11 and 12-15 in the second.
+__attribute__((target("avx2"))) static inline void store_avx2(int16_t *const dst, __m256i const l, __m256i const r) {
+  _mm256_storeu_si256((void *)dst, _mm256_unpacklo_epi16(l, r));
+  _mm256_storeu_si256((void *)(dst + 16), _mm256_unpackhi_epi16(l, r));
+}
+
+__attribute__((target("avx2"))) static void
+stereo_avx2(int16_t *const dst, float const *const *const planes, size_t const samples) {
+  float const *const l = planes[0];
+  float const *const r = planes[1];
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i const l0 = to_s32_avx2(_mm256_loadu_ps(l + i));
+    __m256i const l1 = to_s32_avx2(_mm256_loadu_ps(l + i + 8));
+    __m256i const r0 = to_s32_avx2(_mm256_loadu_ps(r + i));
+    __m256i const r1 = to_s32_avx2(_mm256_loadu_ps(r + i + 8));
+    store_avx2(dst + i * 2, _mm256_packs_epi32(l0, l1), _mm256_packs_epi32(r0, r1));
+  }
+  stereo_sse2(dst + i * 2, (float const *const[2]){l + i, r + i}, samples - i);
+}
+
+__attribute__((target("avx2"))) static void
+downmix_5_1_avx2(int16_t *const dst, float const *const *const planes, size_t const samples) {
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    float const *const fl = planes[0] + i;
+    float const *const fr = planes[1] + i;
+    float const *const fc = planes[2] + i;
+    float const *const sl = planes[4] + i;
+    float const *const sr = planes[5] + i;
+    __m256i const l0 = to_s32_avx2(downmix_avx2(fl, fc, sl));
+    __m256i const l1 = to_s32_avx2(downmix_avx2(fl + 8, fc + 8, sl + 8));
+    __m256i const r0 = to_s32_avx2(downmix_avx2(fr, fc, sr));
+    __m256i const r1 = to_s32_avx2(downmix_avx2(fr + 8, fc + 8, sr + 8));
+    store_avx2(dst + i * 2, _mm256_packs_epi32(l0, l1), _mm256_packs_epi32(r0, r1));
+  }
+  downmix_5_1_sse2(dst + i * 2,
+                   (float const *const[6]){
+                       planes[0] + i,
+                       planes[1] + i,
+                       planes[2] + i,
+                       NULL,
+                       planes[4] + i,
+                       planes[5] + i,
+                   },
+                   samples - i);
+}
+
+#endif
+
+enum pcmconv_isa pcmconv_get_isa(void) {
+  // pixconv already detects the CPU, these kernels only need SSE2 or AVX2.
+  switch (pixconv_get_isa()) {
+  case pixconv_isa_c:
+    break;
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return pcmconv_isa_sse2;
+  case pixconv_isa_avx2:
+    return pcmconv_isa_avx2;
+  }
+  return pcmconv_isa_c;
+}
+
+static fltp_func get_stereo(enum pcmconv_isa const isa) {
+  switch (isa) {
+  case pcmconv_isa_c:
+    break;
+#if PCMCONV_X86
+  case pcmconv_isa_sse2:
+    return stereo_sse2;
+  case pcmconv_isa_avx2:
+    return stereo_avx2;
+#else
+  case pcmconv_isa_sse2:
+  case pcmconv_isa_avx2:
+    break;
+#endif
+  }
+  return stereo_c;
+}
+
+static fltp_func get_downmix_5_1(enum pcmconv_isa const isa) {
+  switch (isa) {
+  case pcmconv_isa_c:
+    break;
+#if PCMCONV_X86
+  case pcmconv_isa_sse2:
+    return downmix_5_1_sse2;
+  case pcmconv_isa_avx2:
+    return downmix_5_1_avx2;
+#else
+  case pcmconv_isa_sse2:
+  case pcmconv_isa_avx2:
+    break;
+#endif
+  }
+  return downmix_5_1_c;
+}
+
+void pcmconv_fltp_to_s16(enum pcmconv_layout const layout,
+                         float const *const *const planes,
+                         int16_t *const dst,
+                         size_t const samples,
+                         enum pcmconv_isa const isa) {
+  switch (layout) {
+  case pcmconv_layout_fltp_stereo:
+    get_stereo(isa)(dst, planes, samples);
+    return;
+  case pcmconv_layout_fltp_5_1:
+    get_downmix_5_1(isa)(dst, planes, samples);
+    return;
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ovbase.h"
+
+// Sample format conversion kernels that do not need swresample.
+// They only convert float to 16-bit and downmix with a fixed matrix, so the source must be at the output rate.
+
+enum pcmconv_isa {
+  pcmconv_isa_c,
+  pcmconv_isa_sse2,
+  pcmconv_isa_avx2,
+};
+
+enum pcmconv_layout {
+  // Float planes of front left and front right.
+  pcmconv_layout_fltp_stereo,
+  // Float planes of FL, FR, FC, LFE and the left and right surround channels, side or back.
+  pcmconv_layout_fltp_5_1,
+};
+
+// Returns the best instruction set supported by the running CPU.
+enum pcmconv_isa pcmconv_get_isa(void);
+
+// Converts samples of planes into interleaved 16-bit stereo.
+// Samples are scaled by 32768, clipped and rounded to nearest even as swresample does.
+// 5.1 is downmixed with the matrix swresample builds by default:
+// the center and surround channels are mixed at -3dB, LFE is dropped and the result is normalized to avoid clipping.
+// The result does not depend on isa, every implementation produces the same samples.
+void pcmconv_fltp_to_s16(enum pcmconv_layout const layout,
+                         float const *const *const planes,
+                         int16_t *const dst,
+                         size_t const samples,
+                         enum pcmconv_isa const isa);
@@ -0,0 +1,131 @@
+#include "pcmconv.c"
+
+#include "ffmpeg.h"
+
+#include <ovutil/win32.h>
+#include <stdlib.h>
+
+#ifndef FFMPEGDIR
+#  define FFMPEGDIR L"."
+#endif
+
+static void initdll(void) { SetDllDirectoryW(FFMPEGDIR); }
+#define TEST_MY_INIT initdll()
+#include "ovtest.h"
+
+enum {
+  max_channels = 6,
+  max_samples = 1031,
+};
+
+// Mostly in range, with some samples that clip.
+static void fill_planes(float planes[max_channels][max_samples]) {
+  for (size_t c = 0; c < max_channels; ++c) {
+    for (size_t i = 0; i < max_samples; ++i) {
+      planes[c][i] = ((float)rand() / (float)RAND_MAX - 0.5f) * 2.5f;
+    }
+  }
+}
+
+static void test_rounding(void) {
+  static float const l[8] = {
+      0.5f / 32768.f, 1.5f / 32768.f, 2.5f / 32768.f, -0.5f / 32768.f, 1.f, -1.f, 100.f, -100.f,
+  };
+  static int16_t const want_l[8] = {0, 2, 2, 0, 32767, -32768, 32767, -32768};
+  float r[8] = {0};
+  r[0] = NAN;
+  int16_t got[16] = {0};
+  for (int isa = pcmconv_isa_c; isa <= (int)pcmconv_get_isa(); ++isa) {
+    pcmconv_fltp_to_s16(pcmconv_layout_fltp_stereo, (float const *const[2]){l, r}, got, 8, (enum pcmconv_isa)isa);
+    for (size_t i = 0; i < 8; ++i) {
+      TEST_CHECK(got[i * 2] == want_l[i]);
+      TEST_MSG("isa: %d index: %zu want %d got %d", isa, i, want_l[i], got[i * 2]);
+    }
+    // NaN is clipped to the minimum.
+    TEST_CHECK(got[1] == -32768);
+    TEST_MSG("isa: %d got %d", isa, got[1]);
+  }
+}
+
+static void test_isa_matches_c(void) {
+  static size_t const sizes[] = {1, 7, 8, 9, 15, 16, 17, 33, max_samples};
+  static float planes[max_channels][max_samples];
+  static int16_t want[max_samples * 2];
+  static int16_t got[max_samples * 2];
+  fill_planes(planes);
+  float const *const p[max_channels] = {planes[0], planes[1], planes[2], planes[3], planes[4], planes[5]};
+  for (int isa = pcmconv_isa_sse2; isa <= (int)pcmconv_get_isa(); ++isa) {
+    for (int layout = pcmconv_layout_fltp_stereo; layout <= pcmconv_layout_fltp_5_1; ++layout) {
+      for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        pcmconv_fltp_to_s16((enum pcmconv_layout)layout, p, want, sizes[s], pcmconv_isa_c);
+        pcmconv_fltp_to_s16((enum pcmconv_layout)layout, p, got, sizes[s], (enum pcmconv_isa)isa);
+        TEST_CHECK(memcmp(want, got, sizes[s] * 2 * sizeof(int16_t)) == 0);
+        TEST_MSG("isa: %d layout: %d samples: %zu", isa, layout, sizes[s]);
+      }
+    }
+  }
+}
+
+// Compares the C kernel with swresample, which is what the resampler uses when no kernel applies.
+// Stereo must match exactly, the 5.1 downmix may differ by 1 because swresample can sum in a different order.
+static void compare_with_swr(enum pcmconv_layout const layout,
+                             AVChannelLayout const *const ch_layout,
+                             int const tolerance) {
+  static float planes[max_channels][max_samples];
+  static int16_t want[max_samples * 2];
+  static int16_t got[max_samples * 2];
+  SwrContext *swr = NULL;
+  fill_planes(planes);
+  float const *const p[max_channels] = {planes[0], planes[1], planes[2], planes[3], planes[4], planes[5]};
+  uint8_t *in[max_channels];
+  for (size_t c = 0; c < max_channels; ++c) {
+    in[c] = (void *)planes[c];
+  }
+  int r = swr_alloc_set_opts2(&swr,
+                              &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO,
+                              AV_SAMPLE_FMT_S16,
+                              48000,
+#if LIBSWRESAMPLE_VERSION_INT < AV_VERSION_INT(5, 0, 0)
+                              ov_deconster_(ch_layout),
+#else
+                              ch_layout,
+#endif
+                              AV_SAMPLE_FMT_FLTP,
+                              48000,
+                              0,
+                              NULL);
+  if (!TEST_CHECK(r >= 0) || !TEST_CHECK(swr_init(swr) >= 0)) {
+    goto cleanup;
+  }
+  r = swr_convert(swr, (uint8_t *[1]){(uint8_t *)want}, max_samples, (void *)in, max_samples);
+  if (!TEST_CHECK(r == max_samples)) {
+    TEST_MSG("want %d got %d", max_samples, r);
+    goto cleanup;
+  }
+  pcmconv_fltp_to_s16(layout, p, got, max_samples, pcmconv_isa_c);
+  for (size_t i = 0; i < max_samples * 2; ++i) {
+    if (!TEST_CHECK(abs(want[i] - got[i]) <= tolerance)) {
+      TEST_MSG("index: %zu want %d got %d", i, want[i], got[i]);
+      break;
+    }
+  }
+cleanup:
+  swr_free(&swr);
+}
+
+static void test_stereo_matches_swr(void) {
+  compare_with_swr(pcmconv_layout_fltp_stereo, &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO, 0);
+}
+
+static void test_5_1_matches_swr(void) {
+  compare_with_swr(pcmconv_layout_fltp_5_1, &(AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1, 1);
+  compare_with_swr(pcmconv_layout_fltp_5_1, &(AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1_BACK, 1);
+}
+
+TEST_LIST = {
+    {"test_rounding", test_rounding},
+    {"test_isa_matches_c", test_isa_matches_c},
+    {"test_stereo_matches_swr", test_stereo_matches_swr},
+    {"test_5_1_matches_swr", test_5_1_matches_swr},
+    {NULL, NULL},
+};
@@ -0,0 +1,377 @@
+#include "pcmfile.h"
+
+#include <ovthreads.h>
+#include <ovutil/win32.h>
+#include <stdatomic.h>
+
+#include "resampler.h"
+
+// Tracks up to this size are decoded into memory, about 3 minutes of 48kHz stereo.
+static size_t const max_memory_size = 32 * 1024 * 1024;
+// Views of the temporary file are mapped in windows of this size.
+static int64_t const window_size = 32 * 1024 * 1024;
+
+struct window {
+  void *ptr;
+  int64_t base;
+  size_t size;
+};
+
+struct pcmfile {
+  struct wstr filepath;
+  void *handle;
+  AVCodec const *codec;
+  int out_rate;
+  bool use_sox;
+  int64_t samples;
+
+  // Either memory or a mapping of the temporary file holds the output.
+  uint8_t *memory;
+  HANDLE file;
+  HANDLE map;
+  // The worker writes through its own window, readers read through theirs.
+  struct window write_window;
+  struct window read_window;
+
+  // Samples decoded from the start, they are not modified after they are published.
+  _Atomic int64_t decoded;
+  atomic_bool running;
+  // The worker runs for as long as the track takes to decode, so it has its own thread
+  // instead of holding a slot of the pool the indexers and prefetch share.
+  thrd_t thread;
+};
+
+static inline int64_t i64min(int64_t const a, int64_t const b) { return a > b ? b : a; }
+
+static NODISCARD error map_window(struct pcmfile *const pf,
+                                  struct window *const w,
+                                  int64_t const offset,
+                                  bool const writable) {
+  if (w->ptr && offset >= w->base && offset < w->base + (int64_t)w->size) {
+    return eok();
+  }
+  SYSTEM_INFO si = {0};
+  GetSystemInfo(&si);
+  int64_t const granularity = (int64_t)si.dwAllocationGranularity;
+  LARGE_INTEGER const base = {
+      .QuadPart = (offset / granularity) * granularity,
+  };
+  size_t const size = (size_t)i64min(pf->samples * resampler_out_sample_size - base.QuadPart, window_size);
+  void *const ptr =
+      MapViewOfFile(pf->map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, (DWORD)base.HighPart, base.LowPart, size);
+  if (!ptr) {
+    return errhr(HRESULT_FROM_WIN32(GetLastError()));
+  }
+  if (w->ptr) {
+    UnmapViewOfFile(w->ptr);
+  }
+  *w = (struct window){
+      .ptr = ptr,
+      .base = base.QuadPart,
+      .size = size,
+  };
+  return eok();
+}
+
+static void unmap_window(struct window *const w) {
+  if (w->ptr) {
+    UnmapViewOfFile(w->ptr);
+  }
+  *w = (struct window){0};
+}
+
+// Copies between buf and the output at offset, windows are remapped as needed.
+static NODISCARD error copy(struct pcmfile *const pf,
+                            struct window *const w,
+                            int64_t offset,
+                            uint8_t *buf,
+                            size_t bytes,
+                            bool const writing) {
+  if (pf->memory) {
+    if (writing) {
+      memcpy(pf->memory + offset, buf, bytes);
+    } else {
+      memcpy(buf, pf->memory + offset, bytes);
+    }
+    return eok();
+  }
+  while (bytes) {
+    error err = map_window(pf, w, offset, writing);
+    if (efailed(err)) {
+      return ethru(err);
+    }
+    uint8_t *const p = (uint8_t *)w->ptr + (offset - w->base);
+    size_t const n = (size_t)i64min((int64_t)bytes, w->base + (int64_t)w->size - offset);
+    if (writing) {
+      memcpy(p, buf, n);
+    } else {
+      memcpy(buf, p, n);
+    }
+    offset += (int64_t)n;
+    buf += n;
+    bytes -= n;
+  }
+  return eok();
+}
+
+// Appends samples from the worker, samples past the end of the track are dropped.
+static NODISCARD error append(struct pcmfile *const pf, void const *const src, int64_t const samples) {
+  int64_t const decoded = atomic_load(&pf->decoded);
+  int64_t const n = i64min(samples, pf->samples - decoded);
+  if (n <= 0) {
+    return eok();
+  }
+  error err = eok();
+  size_t const bytes = (size_t)(n * resampler_out_sample_size);
+  if (src) {
+    err = copy(pf, &pf->write_window, decoded * resampler_out_sample_size, ov_deconster_(src), bytes, true);
+  } else {
+    static uint8_t const silence[4096] = {0};
+    for (size_t written = 0; written < bytes && esucceeded(err);) {
+      size_t const len = bytes - written < sizeof(silence) ? bytes - written : sizeof(silence);
+      err = copy(pf,
+                 &pf->write_window,
+                 decoded * resampler_out_sample_size + (int64_t)written,
+                 ov_deconster_(silence),
+                 len,
+                 true);
+      written += len;
+    }
+  }
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  atomic_store(&pf->decoded, decoded + n);
+  return eok();
+}
+
+static int worker(void *const userdata) {
+  struct pcmfile *const pf = userdata;
+  struct ffmpeg_stream fs = {0};
+  struct resampler *r = NULL;
+  error err = ffmpeg_open(&fs,
+                          &(struct ffmpeg_open_options){
+                              .filepath = pf->filepath.ptr,
+                              .handle = pf->handle,
+                              .media_type = AVMEDIA_TYPE_AUDIO,
+                              .codec = pf->codec,
+                          });
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = resampler_create(&r,
+                         &(struct resampler_options){
+                             .out_rate = pf->out_rate,
+                             .codecpar = fs.stream->codecpar,
+                             .use_sox = pf->use_sox,
+                         });
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  int64_t const start_time = fs.stream->start_time == AV_NOPTS_VALUE ? 0 : fs.stream->start_time;
+  // Differences within one tick of the timebase are rounding, not gaps.
+  int64_t const tolerance = av_rescale_q(1, fs.cctx->pkt_timebase, av_make_q(1, pf->out_rate)) + 1;
+  while (atomic_load(&pf->running)) {
+    int ret = ffmpeg_grab(&fs);
+    if (ret == AVERROR_EOF) {
+      break;
+    }
+    if (ret < 0) {
+      err = errffmpeg(ret);
+      goto cleanup;
+    }
+    err = resampler_set_input(r, fs.frame);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+    // Samples are placed by the pts of the frame as the reader positions frames when it seeks,
+    // relative to the start time of the stream. The samples the resampler is still holding come out first.
+    int64_t skip = 0;
+    if (fs.frame->pts != AV_NOPTS_VALUE) {
+      int64_t const pos =
+          av_rescale_q(fs.frame->pts - start_time, fs.cctx->pkt_timebase, av_make_q(1, pf->out_rate)) -
+          (r->ctx ? swr_get_delay(r->ctx, pf->out_rate) : 0);
+      int64_t const decoded = atomic_load(&pf->decoded);
+      if (pos - decoded > tolerance) {
+        // Fills the gap with silence.
+        err = append(pf, NULL, pos - decoded);
+        if (efailed(err)) {
+          err = ethru(err);
+          goto cleanup;
+        }
+      } else if (decoded - pos > tolerance) {
+        // Published samples are not modified, the overlapping samples are dropped.
+        skip = decoded - pos;
+      }
+    }
+    int written = r->samples;
+    err = resampler_resample(r, fs.frame->data, fs.frame->nb_samples, r->buf, &written);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+    if (skip < written) {
+      err = append(pf, r->buf + skip * resampler_out_sample_size, written - skip);
+      if (efailed(err)) {
+        err = ethru(err);
+        goto cleanup;
+      }
+    }
+  }
+  // Takes out the samples the resampler is still holding.
+  int written = r->samples;
+  err = resampler_resample(r, NULL, 0, r->buf, &written);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = append(pf, r->buf, written);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+cleanup:
+  unmap_window(&pf->write_window);
+  resampler_destroy(&r);
+  ffmpeg_close(&fs);
+  ereport(err);
+  return 0;
+}
+
+static NODISCARD error create_file(struct pcmfile *const pf, int64_t const size) {
+  wchar_t dir[MAX_PATH];
+  wchar_t path[MAX_PATH];
+  error err = eok();
+  if (!GetTempPathW(MAX_PATH, dir) || !GetTempFileNameW(dir, L"ffi", 0, path)) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+  pf->file = CreateFileW(path,
+                         GENERIC_READ | GENERIC_WRITE,
+                         0,
+                         NULL,
+                         CREATE_ALWAYS,
+                         FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                         NULL);
+  if (pf->file == INVALID_HANDLE_VALUE) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    DeleteFileW(path);
+    goto cleanup;
+  }
+  LARGE_INTEGER const li = {
+      .QuadPart = size,
+  };
+  pf->map = CreateFileMappingW(pf->file, NULL, PAGE_READWRITE, (DWORD)li.HighPart, li.LowPart, NULL);
+  if (!pf->map) {
+    err = errhr(HRESULT_FROM_WIN32(GetLastError()));
+    goto cleanup;
+  }
+cleanup:
+  return err;
+}
+
+NODISCARD error pcmfile_create(struct pcmfile **const pfp, struct pcmfile_options const *const opt) {
+  if (!pfp || *pfp || !opt || (!opt->filepath && (opt->handle == NULL || opt->handle == INVALID_HANDLE_VALUE)) ||
+      !opt->codec || opt->out_rate <= 0 || opt->samples <= 0) {
+    return errg(err_invalid_arugment);
+  }
+  struct pcmfile *pf = NULL;
+  error err = mem(&pf, 1, sizeof(struct pcmfile));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  *pf = (struct pcmfile){
+      .handle = opt->handle,
+      .codec = opt->codec,
+      .out_rate = opt->out_rate,
+      .use_sox = opt->use_sox,
+      .samples = opt->samples,
+      .file = INVALID_HANDLE_VALUE,
+  };
+  atomic_init(&pf->decoded, 0);
+  atomic_init(&pf->running, false);
+  if (opt->filepath) {
+    err = scpy(&pf->filepath, opt->filepath);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+  }
+  int64_t const size = opt->samples * resampler_out_sample_size;
+  if (size <= (int64_t)max_memory_size) {
+    err = mem(&pf->memory, (size_t)size, 1);
+  } else {
+    err = create_file(pf, size);
+  }
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  atomic_store(&pf->running, true);
+  if (thrd_create(&pf->thread, worker, pf) != thrd_success) {
+    atomic_store(&pf->running, false);
+    err = emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("failed to start new thread")));
+    goto cleanup;
+  }
+  *pfp = pf;
+cleanup:
+  if (efailed(err)) {
+    pcmfile_destroy(&pf);
+  }
+  return err;
+}
+
+void pcmfile_destroy(struct pcmfile **const pfp) {
+  if (!pfp || !*pfp) {
+    return;
+  }
+  struct pcmfile *const pf = *pfp;
+  if (atomic_load(&pf->running)) {
+    atomic_store(&pf->running, false);
+    thrd_join(pf->thread, NULL);
+  }
+  unmap_window(&pf->read_window);
+  if (pf->map) {
+    CloseHandle(pf->map);
+  }
+  if (pf->file != INVALID_HANDLE_VALUE) {
+    CloseHandle(pf->file);
+  }
+  if (pf->memory) {
+    ereport(mem_free(&pf->memory));
+  }
+  ereport(sfree(&pf->filepath));
+  ereport(mem_free(pfp));
+}
+
+int pcmfile_read(struct pcmfile *const pf, int64_t const pos, int const samples, void *const dest) {
+  if (!pf || pos < 0 || samples <= 0) {
+    return 0;
+  }
+  int64_t const n = i64min(samples, atomic_load(&pf->decoded) - pos);
+  if (n <= 0) {
+    return 0;
+  }
+  error err = copy(
+      pf, &pf->read_window, pos * resampler_out_sample_size, dest, (size_t)(n * resampler_out_sample_size), false);
+  if (efailed(err)) {
+    ereport(err);
+    return 0;
+  }
+  return (int)n;
+}
+
+size_t pcmfile_get_memory_usage(struct pcmfile const *const pf) {
+  if (!pf) {
+    return 0;
+  }
+  if (pf->memory) {
+    return (size_t)(pf->samples * resampler_out_sample_size);
+  }
+  // The window of the worker is counted even after it has finished.
+  return pf->read_window.size + (size_t)window_size;
+}
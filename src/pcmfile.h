@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ovbase.h"
+
+#include "ffmpeg.h"
+
+// Decodes and resamples the whole audio track once on its own thread, so any decoded range is copied without seeking.
+// Small tracks are kept in memory, larger ones in a temporary file that is mapped in windows,
+// so a long track does not exhaust the address space of a 32-bit process.
+// Samples are placed at the pts of their frames, gaps between frames are filled with silence.
+
+struct pcmfile;
+
+struct pcmfile_options {
+  wchar_t const *filepath;
+  void *handle;
+  AVCodec const *codec;
+  int out_rate;
+  bool use_sox;
+  // Length of the track in output samples, the output is cut there.
+  int64_t samples;
+};
+
+// The worker starts right away.
+NODISCARD error pcmfile_create(struct pcmfile **const pfp, struct pcmfile_options const *const opt);
+// Stops the worker and deletes the temporary file.
+void pcmfile_destroy(struct pcmfile **const pfp);
+// Copies the samples from pos to dest and returns the number of samples copied.
+// It stops where the worker has not decoded yet, the rest must be read from the decoder.
+// It must not be called from multiple threads at the same time.
+int pcmfile_read(struct pcmfile *const pf, int64_t const pos, int const samples, void *const dest);
+// Returns the bytes of memory and mapped views used at most.
+size_t pcmfile_get_memory_usage(struct pcmfile const *const pf);
@@ -0,0 +1,369 @@
+#include "pipeline.h"
+
+#include <ovthreads.h>
+#include <ovutil/win32.h>
+#include <stdatomic.h>
+
+#include "now.h"
+
+enum {
+  packet_queue_length = 64,
+  frame_queue_length = 4,
+  output_queue_length = 4,
+};
+
+enum stage {
+  stage_demux,
+  stage_decode,
+  stage_convert,
+  stage_max,
+};
+
+// Single-producer single-consumer ring indices.
+// The slots are owned by struct pipeline, the queue only tracks positions.
+// Threads spin on the atomics on the fast path and fall back to cnd_wait only when the queue is empty or full.
+struct queue {
+  atomic_size_t read;
+  atomic_size_t write;
+  atomic_int waiters;
+  size_t cap;
+  mtx_t mtx;
+  cnd_t cnd;
+};
+
+struct pipeline {
+  struct pipeline_options opt;
+  atomic_bool stop;
+
+  struct queue packets;
+  AVPacket *packet_slots[packet_queue_length];
+  int packet_results[packet_queue_length];
+
+  struct queue frames;
+  AVFrame *frame_slots[frame_queue_length];
+  int frame_results[frame_queue_length];
+
+  struct queue outputs;
+  struct pipeline_output output_slots[output_queue_length];
+
+  thrd_t threads[stage_max];
+  bool thread_started[stage_max];
+  AVPacket *decode_packet;
+  AVFrame *decode_frame;
+
+  double started_at;
+  // Each value is written only by its own stage and read after the thread is joined.
+  double waited[stage_max];
+  double finished_at[stage_max];
+  size_t converted;
+};
+
+static void queue_init(struct queue *const q, size_t const cap) {
+  atomic_init(&q->read, 0);
+  atomic_init(&q->write, 0);
+  atomic_init(&q->waiters, 0);
+  q->cap = cap;
+  mtx_init(&q->mtx, mtx_plain);
+  cnd_init(&q->cnd);
+}
+
+static void queue_exit(struct queue *const q) {
+  cnd_destroy(&q->cnd);
+  mtx_destroy(&q->mtx);
+}
+
+static inline bool queue_ready(struct queue *const q, bool const writer) {
+  size_t const r = atomic_load(&q->read);
+  size_t const w = atomic_load(&q->write);
+  return writer ? w - r < q->cap : w != r;
+}
+
+static void queue_wake(struct queue *const q) {
+  mtx_lock(&q->mtx);
+  cnd_broadcast(&q->cnd);
+  mtx_unlock(&q->mtx);
+}
+
+// Waits until a slot can be written (writer) or read (!writer).
+// Returns false when the pipeline is stopping.
+static bool queue_wait(struct pipeline *const p, struct queue *const q, bool const writer, double *const waited) {
+  if (atomic_load(&p->stop)) {
+    return false;
+  }
+  if (queue_ready(q, writer)) {
+    return true;
+  }
+  double const start = now();
+  mtx_lock(&q->mtx);
+  atomic_fetch_add(&q->waiters, 1);
+  // Once registered as a waiter, a notification cannot be missed because the notifier checks waiters after
+  // publishing the index and needs the mutex to signal.
+  while (!atomic_load(&p->stop) && !queue_ready(q, writer)) {
+    cnd_wait(&q->cnd, &q->mtx);
+  }
+  atomic_fetch_sub(&q->waiters, 1);
+  mtx_unlock(&q->mtx);
+  *waited += now() - start;
+  return !atomic_load(&p->stop);
+}
+
+static inline size_t queue_write_index(struct queue *const q) { return atomic_load(&q->write) % q->cap; }
+static inline size_t queue_read_index(struct queue *const q) { return atomic_load(&q->read) % q->cap; }
+
+static void queue_push(struct queue *const q) {
+  atomic_fetch_add(&q->write, 1);
+  if (atomic_load(&q->waiters)) {
+    queue_wake(q);
+  }
+}
+
+static void queue_pop(struct queue *const q) {
+  atomic_fetch_add(&q->read, 1);
+  if (atomic_load(&q->waiters)) {
+    queue_wake(q);
+  }
+}
+
+static int demux(void *userdata) {
+  struct pipeline *const p = userdata;
+  struct ffmpeg_stream *const fs = p->opt.ffmpeg;
+  for (;;) {
+    if (!queue_wait(p, &p->packets, true, &p->waited[stage_demux])) {
+      break;
+    }
+    size_t const idx = queue_write_index(&p->packets);
+    AVPacket *const pkt = p->packet_slots[idx];
+    int r = 0;
+    for (;;) {
+      r = av_read_frame(fs->fctx, pkt);
+      if (r < 0 || pkt->stream_index == fs->stream->index) {
+        break;
+      }
+      av_packet_unref(pkt);
+    }
+    p->packet_results[idx] = r;
+    queue_push(&p->packets);
+    if (r < 0) {
+      break;
+    }
+  }
+  p->finished_at[stage_demux] = now();
+  return 0;
+}
+
+static void push_frame_result(struct pipeline *const p, int const result) {
+  if (!queue_wait(p, &p->frames, true, &p->waited[stage_decode])) {
+    return;
+  }
+  p->frame_results[queue_write_index(&p->frames)] = result;
+  queue_push(&p->frames);
+}
+
+// Moves all frames the decoder can output to the frame queue.
+// Returns AVERROR(EAGAIN) when the decoder needs more packets.
+static int receive_frames(struct pipeline *const p) {
+  AVFrame *const frame = p->decode_frame;
+  for (;;) {
+    int const r = avcodec_receive_frame(p->opt.ffmpeg->cctx, frame);
+    if (r < 0) {
+      return r;
+    }
+    if (!queue_wait(p, &p->frames, true, &p->waited[stage_decode])) {
+      av_frame_unref(frame);
+      return AVERROR_EXIT;
+    }
+    size_t const idx = queue_write_index(&p->frames);
+    av_frame_move_ref(p->frame_slots[idx], frame);
+    p->frame_results[idx] = 0;
+    queue_push(&p->frames);
+  }
+}
+
+static int decode(void *userdata) {
+  struct pipeline *const p = userdata;
+  AVPacket *const pkt = p->decode_packet;
+  int r = 0;
+  for (;;) {
+    if (!queue_wait(p, &p->packets, false, &p->waited[stage_decode])) {
+      r = AVERROR_EXIT;
+      break;
+    }
+    size_t const idx = queue_read_index(&p->packets);
+    bool const eof = p->packet_results[idx] < 0;
+    av_packet_move_ref(pkt, p->packet_slots[idx]);
+    queue_pop(&p->packets);
+
+    // Sending NULL enters draining mode, so the remaining frames are flushed at the end of the stream.
+    r = avcodec_send_packet(p->opt.ffmpeg->cctx, eof ? NULL : pkt);
+    while (r == AVERROR(EAGAIN)) {
+      r = receive_frames(p);
+      if (r != AVERROR(EAGAIN)) {
+        break;
+      }
+      r = avcodec_send_packet(p->opt.ffmpeg->cctx, eof ? NULL : pkt);
+    }
+    av_packet_unref(pkt);
+    if (r < 0) {
+      break;
+    }
+    r = receive_frames(p);
+    if (r != AVERROR(EAGAIN)) {
+      break;
+    }
+  }
+  if (r != AVERROR_EXIT) {
+    push_frame_result(p, r < 0 ? r : AVERROR_EOF);
+  }
+  p->finished_at[stage_decode] = now();
+  return 0;
+}
+
+static int convert(void *userdata) {
+  struct pipeline *const p = userdata;
+  for (;;) {
+    if (!queue_wait(p, &p->frames, false, &p->waited[stage_convert])) {
+      break;
+    }
+    if (!queue_wait(p, &p->outputs, true, &p->waited[stage_convert])) {
+      break;
+    }
+    size_t const idx = queue_read_index(&p->frames);
+    int const result = p->frame_results[idx];
+    struct pipeline_output *const out = p->output_slots + queue_write_index(&p->outputs);
+    out->result = result;
+    if (result == 0) {
+      AVFrame *const frame = p->frame_slots[idx];
+      out->written = p->opt.convert(p->opt.userdata, frame, out->buf);
+      out->pts = frame->pts;
+      av_frame_unref(frame);
+      ++p->converted;
+    }
+    queue_pop(&p->frames);
+    queue_push(&p->outputs);
+    if (result < 0) {
+      break;
+    }
+  }
+  p->finished_at[stage_convert] = now();
+  return 0;
+}
+
+static double stage_busy(struct pipeline const *const p, enum stage const s) {
+  return p->finished_at[s] - p->started_at - p->waited[s];
+}
+
+void pipeline_destroy(struct pipeline **const pp, struct pipeline_stats *const stats) {
+  if (!pp || !*pp) {
+    return;
+  }
+  struct pipeline *const p = *pp;
+  atomic_store(&p->stop, true);
+  queue_wake(&p->packets);
+  queue_wake(&p->frames);
+  queue_wake(&p->outputs);
+  for (size_t i = 0; i < stage_max; ++i) {
+    if (p->thread_started[i]) {
+      thrd_join(p->threads[i], NULL);
+    }
+  }
+  if (stats) {
+    *stats = (struct pipeline_stats){
+        .elapsed = now() - p->started_at,
+        .demux = stage_busy(p, stage_demux),
+        .decode = stage_busy(p, stage_decode),
+        .convert = stage_busy(p, stage_convert),
+        .frames = p->converted,
+    };
+  }
+  for (size_t i = 0; i < packet_queue_length; ++i) {
+    av_packet_free(&p->packet_slots[i]);
+  }
+  for (size_t i = 0; i < frame_queue_length; ++i) {
+    av_frame_free(&p->frame_slots[i]);
+  }
+  for (size_t i = 0; i < output_queue_length; ++i) {
+    if (p->output_slots[i].buf) {
+      ereport(mem_free(&p->output_slots[i].buf));
+    }
+  }
+  av_packet_free(&p->decode_packet);
+  av_frame_free(&p->decode_frame);
+  queue_exit(&p->outputs);
+  queue_exit(&p->frames);
+  queue_exit(&p->packets);
+  ereport(mem_free(pp));
+}
+
+NODISCARD error pipeline_create(struct pipeline **const pp, struct pipeline_options const *const opt) {
+  if (!pp || *pp || !opt || !opt->ffmpeg || !opt->frame_size || !opt->convert) {
+    return errg(err_invalid_arugment);
+  }
+  struct pipeline *p = NULL;
+  error err = mem(&p, 1, sizeof(struct pipeline));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  *p = (struct pipeline){
+      .opt = *opt,
+  };
+  atomic_init(&p->stop, false);
+  queue_init(&p->packets, packet_queue_length);
+  queue_init(&p->frames, frame_queue_length);
+  queue_init(&p->outputs, output_queue_length);
+
+  for (size_t i = 0; i < packet_queue_length; ++i) {
+    p->packet_slots[i] = av_packet_alloc();
+    if (!p->packet_slots[i]) {
+      err = errg(err_out_of_memory);
+      goto cleanup;
+    }
+  }
+  for (size_t i = 0; i < frame_queue_length; ++i) {
+    p->frame_slots[i] = av_frame_alloc();
+    if (!p->frame_slots[i]) {
+      err = errg(err_out_of_memory);
+      goto cleanup;
+    }
+  }
+  for (size_t i = 0; i < output_queue_length; ++i) {
+    err = mem(&p->output_slots[i].buf, opt->frame_size, 1);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+  }
+  p->decode_packet = av_packet_alloc();
+  p->decode_frame = av_frame_alloc();
+  if (!p->decode_packet || !p->decode_frame) {
+    err = errg(err_out_of_memory);
+    goto cleanup;
+  }
+
+  p->started_at = now();
+  static int (*const funcs[stage_max])(void *) = {demux, decode, convert};
+  for (size_t i = 0; i < stage_max; ++i) {
+    if (thrd_create(&p->threads[i], funcs[i], p) != thrd_success) {
+      err = errg(err_fail);
+      goto cleanup;
+    }
+    p->thread_started[i] = true;
+  }
+  *pp = p;
+cleanup:
+  if (efailed(err)) {
+    pipeline_destroy(&p, NULL);
+  }
+  return err;
+}
+
+int pipeline_peek(struct pipeline *const p, struct pipeline_output const **const out) {
+  double waited = 0;
+  if (!queue_wait(p, &p->outputs, false, &waited)) {
+    return AVERROR_EXIT;
+  }
+  *out = p->output_slots + queue_read_index(&p->outputs);
+  return (*out)->result;
+}
+
+void pipeline_pop(struct pipeline *const p) { queue_pop(&p->outputs); }
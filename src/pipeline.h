@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ovbase.h"
+
+#include "ffmpeg.h"
+
+struct pipeline;
+
+// Converts the decoded frame into dest and returns the number of bytes written.
+typedef size_t (*pipeline_convert_func)(void *const userdata, AVFrame const *const frame, void *const dest);
+
+struct pipeline_options {
+  // The stream is used exclusively by the pipeline until pipeline_destroy is called.
+  // Demuxing and decoding continue from the current position.
+  struct ffmpeg_stream *ffmpeg;
+  size_t frame_size;
+  pipeline_convert_func convert;
+  void *userdata;
+};
+
+struct pipeline_output {
+  void *buf;
+  size_t written;
+  int64_t pts;
+  // negative value means the end of the stream or an error.
+  int result;
+};
+
+struct pipeline_stats {
+  double elapsed;
+  double demux;
+  double decode;
+  double convert;
+  size_t frames;
+};
+
+NODISCARD error pipeline_create(struct pipeline **const pp, struct pipeline_options const *const opt);
+// Stops all stages. If stats is not NULL, the busy time of each stage is stored.
+void pipeline_destroy(struct pipeline **const pp, struct pipeline_stats *const stats);
+// Waits until the next converted frame is available and returns its result.
+// The returned output remains valid until pipeline_pop is called.
+int pipeline_peek(struct pipeline *const p, struct pipeline_output const **const out);
+void pipeline_pop(struct pipeline *const p);
@@ -0,0 +1,1359 @@
+#include "pixconv.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#  define PIXCONV_X86 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#else
+#  define PIXCONV_X86 0
+#endif
+
+// Full range to limited range in 8.8 fixed point, (v * 256 * mul) >> 16 matches _mm_mulhi_epu16.
+// y: 16 + v * 219 / 255
+// c: 128 + (v - 128) * 224 / 255
+enum {
+  range_y_mul = 56284,
+  range_y_add = 16 * 256 + 128,
+  range_c_mul = 57568,
+  range_c_add = 3984 + 128,
+};
+
+// YC48 is 16-bit 4:4:4, the nominal range is 0-4096 for Y and -2048-2048 for Cb and Cr.
+// Limited range input uses the same integer formulas as L-SMASH Works, shown for 8-bit input:
+// y: ((v * 1197) >> 6) - 299
+// c: ((v - 128) * 4681 + 164) >> 8
+// Full range input:
+// y: (v * 1028) >> 6
+// c: ((v - 128) * 4112 + 128) >> 8
+// For n-bit input, the shifts grow by n - 8 and the chroma offsets are scaled by 1 << (n - 8).
+enum {
+  yc48_y_mul = 1197,
+  yc48_y_sub = 299,
+  yc48_c_mul = 4681,
+  yc48_c_add = 164,
+  yc48_full_y_mul = 1028,
+  yc48_full_c_mul = 4112,
+  yc48_full_c_add = 128,
+};
+
+// 10-bit rows use 16-bit sample pointers, p010 samples are shifted down to the low bits on load.
+// dither holds the thresholds added before 10-bit samples are reduced to 8 bits, for even and odd samples.
+typedef void (*planar16_row_func)(uint8_t *const dst,
+                                  uint16_t const *const y,
+                                  uint16_t const *const u0,
+                                  uint16_t const *const u1,
+                                  uint16_t const *const v0,
+                                  uint16_t const *const v1,
+                                  size_t const width,
+                                  uint8_t const *const dither);
+typedef void (*semiplanar16_row_func)(uint8_t *const dst,
+                                      uint16_t const *const y,
+                                      uint16_t const *const uv0,
+                                      uint16_t const *const uv1,
+                                      size_t const width,
+                                      uint8_t const *const dither);
+
+typedef void (*planar_row_func)(uint8_t *const dst,
+                                uint8_t const *const y,
+                                uint8_t const *const u0,
+                                uint8_t const *const u1,
+                                uint8_t const *const v0,
+                                uint8_t const *const v1,
+                                size_t const width,
+                                bool const full_range);
+typedef void (*semiplanar_row_func)(uint8_t *const dst,
+                                    uint8_t const *const y,
+                                    uint8_t const *const uv0,
+                                    uint8_t const *const uv1,
+                                    size_t const width,
+                                    bool const full_range);
+
+static inline uint8_t avg(uint8_t const a, uint8_t const b) { return (uint8_t)((a + b + 1) >> 1); }
+
+// 4:2:0 chroma is sited between two luma rows, so the nearer chroma row gets 3/4 of the weight.
+// Written as nested averages to be bit-exact with _mm_avg_epu8.
+static inline uint8_t interp(uint8_t const near, uint8_t const far) { return avg(near, avg(near, far)); }
+
+static inline uint8_t range(uint8_t const v, uint32_t const mul, uint32_t const add) {
+  return (uint8_t)(((((uint32_t)v << 8) * mul >> 16) + add) >> 8);
+}
+
+static void planar_row_c(uint8_t *const dst,
+                         uint8_t const *const y,
+                         uint8_t const *const u0,
+                         uint8_t const *const u1,
+                         uint8_t const *const v0,
+                         uint8_t const *const v1,
+                         size_t const width,
+                         bool const full_range) {
+  for (size_t x = 0; x < width; x += 2) {
+    size_t const c = x >> 1;
+    uint8_t ya = y[x], yb = y[x + 1], u = interp(u0[c], u1[c]), v = interp(v0[c], v1[c]);
+    if (full_range) {
+      ya = range(ya, range_y_mul, range_y_add);
+      yb = range(yb, range_y_mul, range_y_add);
+      u = range(u, range_c_mul, range_c_add);
+      v = range(v, range_c_mul, range_c_add);
+    }
+    dst[x * 2 + 0] = ya;
+    dst[x * 2 + 1] = u;
+    dst[x * 2 + 2] = yb;
+    dst[x * 2 + 3] = v;
+  }
+}
+
+static void semiplanar_row_c(uint8_t *const dst,
+                             uint8_t const *const y,
+                             uint8_t const *const uv0,
+                             uint8_t const *const uv1,
+                             size_t const width,
+                             bool const full_range) {
+  for (size_t x = 0; x < width; x += 2) {
+    uint8_t ya = y[x], yb = y[x + 1], u = interp(uv0[x], uv1[x]), v = interp(uv0[x + 1], uv1[x + 1]);
+    if (full_range) {
+      ya = range(ya, range_y_mul, range_y_add);
+      yb = range(yb, range_y_mul, range_y_add);
+      u = range(u, range_c_mul, range_c_add);
+      v = range(v, range_c_mul, range_c_add);
+    }
+    dst[x * 2 + 0] = ya;
+    dst[x * 2 + 1] = u;
+    dst[x * 2 + 2] = yb;
+    dst[x * 2 + 3] = v;
+  }
+}
+
+static inline int16_t yc48_luma(int const v, int const bits, bool const full_range) {
+  return (int16_t)(full_range ? (v * yc48_full_y_mul) >> (bits - 2)
+                              : ((v * yc48_y_mul) >> (bits - 2)) - yc48_y_sub);
+}
+
+static inline int16_t yc48_chroma(int const v, int const bits, bool const full_range) {
+  int const s = bits - 8;
+  return (int16_t)(full_range ? ((v - (128 << s)) * yc48_full_c_mul + (yc48_full_c_add << s)) >> bits
+                              : ((v - (128 << s)) * yc48_c_mul + (yc48_c_add << s)) >> bits);
+}
+
+static inline void store_yc48(uint8_t *const dst, int16_t const y, int16_t const cb, int16_t const cr) {
+  int16_t const px[3] = {y, cb, cr};
+  memcpy(dst, px, sizeof(px));
+}
+
+// Chroma of odd pixels is the average of the two horizontal neighbours, the last pixel has only one.
+static void planar_yc48_row_c(uint8_t *const dst,
+                              uint8_t const *const y,
+                              uint8_t const *const u0,
+                              uint8_t const *const u1,
+                              uint8_t const *const v0,
+                              uint8_t const *const v1,
+                              size_t const width,
+                              bool const full_range) {
+  size_t const chroma_width = (width + 1) / 2;
+  for (size_t x = 0; x < width; ++x) {
+    size_t const c = x >> 1;
+    uint8_t u = interp(u0[c], u1[c]), v = interp(v0[c], v1[c]);
+    if ((x & 1) && c + 1 < chroma_width) {
+      u = avg(u, interp(u0[c + 1], u1[c + 1]));
+      v = avg(v, interp(v0[c + 1], v1[c + 1]));
+    }
+    store_yc48(
+        dst + x * 6, yc48_luma(y[x], 8, full_range), yc48_chroma(u, 8, full_range), yc48_chroma(v, 8, full_range));
+  }
+}
+
+static void semiplanar_yc48_row_c(uint8_t *const dst,
+                                  uint8_t const *const y,
+                                  uint8_t const *const uv0,
+                                  uint8_t const *const uv1,
+                                  size_t const width,
+                                  bool const full_range) {
+  size_t const chroma_width = (width + 1) / 2;
+  for (size_t x = 0; x < width; ++x) {
+    size_t const c = x & ~(size_t)1;
+    uint8_t u = interp(uv0[c], uv1[c]), v = interp(uv0[c + 1], uv1[c + 1]);
+    if ((x & 1) && (c >> 1) + 1 < chroma_width) {
+      u = avg(u, interp(uv0[c + 2], uv1[c + 2]));
+      v = avg(v, interp(uv0[c + 3], uv1[c + 3]));
+    }
+    store_yc48(
+        dst + x * 6, yc48_luma(y[x], 8, full_range), yc48_chroma(u, 8, full_range), yc48_chroma(v, 8, full_range));
+  }
+}
+
+static inline uint16_t avg16(uint16_t const a, uint16_t const b) { return (uint16_t)((a + b + 1) >> 1); }
+
+// Bit-exact with _mm_avg_epu16.
+static inline uint16_t interp16(uint16_t const near, uint16_t const far) { return avg16(near, avg16(near, far)); }
+
+static inline uint16_t p010(uint16_t const v) { return (uint16_t)(v >> 6); }
+
+// Saturates like _mm_adds_epu16 followed by _mm_packus_epi16.
+static inline uint8_t reduce10(uint16_t const v, uint8_t const d) {
+  int const r = (v + d > 0xffff ? 0xffff : v + d) >> 2;
+  return (uint8_t)(r > 255 ? 255 : r);
+}
+
+static void planar10_row_c(uint8_t *const dst,
+                           uint16_t const *const y,
+                           uint16_t const *const u0,
+                           uint16_t const *const u1,
+                           uint16_t const *const v0,
+                           uint16_t const *const v1,
+                           size_t const width,
+                           uint8_t const *const dither) {
+  for (size_t x = 0; x < width; x += 2) {
+    size_t const c = x >> 1;
+    uint8_t const dc = dither[c & 1];
+    dst[x * 2 + 0] = reduce10(y[x], dither[0]);
+    dst[x * 2 + 1] = reduce10(interp16(u0[c], u1[c]), dc);
+    dst[x * 2 + 2] = reduce10(y[x + 1], dither[1]);
+    dst[x * 2 + 3] = reduce10(interp16(v0[c], v1[c]), dc);
+  }
+}
+
+static void p010_row_c(uint8_t *const dst,
+                       uint16_t const *const y,
+                       uint16_t const *const uv0,
+                       uint16_t const *const uv1,
+                       size_t const width,
+                       uint8_t const *const dither) {
+  for (size_t x = 0; x < width; x += 2) {
+    uint8_t const dc = dither[(x >> 1) & 1];
+    dst[x * 2 + 0] = reduce10(p010(y[x]), dither[0]);
+    dst[x * 2 + 1] = reduce10(interp16(p010(uv0[x]), p010(uv1[x])), dc);
+    dst[x * 2 + 2] = reduce10(p010(y[x + 1]), dither[1]);
+    dst[x * 2 + 3] = reduce10(interp16(p010(uv0[x + 1]), p010(uv1[x + 1])), dc);
+  }
+}
+
+// YC48 keeps more than 10 bits of precision, so it does not need dithering.
+static void planar10_yc48_row_c(uint8_t *const dst,
+                                uint16_t const *const y,
+                                uint16_t const *const u0,
+                                uint16_t const *const u1,
+                                uint16_t const *const v0,
+                                uint16_t const *const v1,
+                                size_t const width,
+                                uint8_t const *const dither) {
+  (void)dither;
+  size_t const chroma_width = (width + 1) / 2;
+  for (size_t x = 0; x < width; ++x) {
+    size_t const c = x >> 1;
+    uint16_t u = interp16(u0[c], u1[c]), v = interp16(v0[c], v1[c]);
+    if ((x & 1) && c + 1 < chroma_width) {
+      u = avg16(u, interp16(u0[c + 1], u1[c + 1]));
+      v = avg16(v, interp16(v0[c + 1], v1[c + 1]));
+    }
+    store_yc48(dst + x * 6, yc48_luma(y[x], 10, false), yc48_chroma(u, 10, false), yc48_chroma(v, 10, false));
+  }
+}
+
+static void p010_yc48_row_c(uint8_t *const dst,
+                            uint16_t const *const y,
+                            uint16_t const *const uv0,
+                            uint16_t const *const uv1,
+                            size_t const width,
+                            uint8_t const *const dither) {
+  (void)dither;
+  size_t const chroma_width = (width + 1) / 2;
+  for (size_t x = 0; x < width; ++x) {
+    size_t const c = x & ~(size_t)1;
+    uint16_t u = interp16(p010(uv0[c]), p010(uv1[c])), v = interp16(p010(uv0[c + 1]), p010(uv1[c + 1]));
+    if ((x & 1) && (c >> 1) + 1 < chroma_width) {
+      u = avg16(u, interp16(p010(uv0[c + 2]), p010(uv1[c + 2])));
+      v = avg16(v, interp16(p010(uv0[c + 3]), p010(uv1[c + 3])));
+    }
+    store_yc48(dst + x * 6, yc48_luma(p010(y[x]), 10, false), yc48_chroma(u, 10, false), yc48_chroma(v, 10, false));
+  }
+}
+
+// Byte offsets of B, G and R inside a packed source pixel of bpp bytes.
+struct rgb_order {
+  size_t bpp;
+  uint8_t b;
+  uint8_t g;
+  uint8_t r;
+};
+
+typedef void (*packed_rgb_row_func)(uint8_t *const dst,
+                                    uint8_t const *const src,
+                                    size_t const width,
+                                    struct rgb_order const *const order);
+
+typedef void (*gbrp_row_func)(uint8_t *const dst,
+                              uint8_t const *const g,
+                              uint8_t const *const b,
+                              uint8_t const *const r,
+                              size_t const width);
+
+static void packed_rgb_row_c(uint8_t *const dst,
+                             uint8_t const *const src,
+                             size_t const width,
+                             struct rgb_order const *const order) {
+  for (size_t x = 0; x < width; ++x) {
+    uint8_t const *const s = src + x * order->bpp;
+    dst[x * 3 + 0] = s[order->b];
+    dst[x * 3 + 1] = s[order->g];
+    dst[x * 3 + 2] = s[order->r];
+  }
+}
+
+static void gbrp_row_c(uint8_t *const dst,
+                       uint8_t const *const g,
+                       uint8_t const *const b,
+                       uint8_t const *const r,
+                       size_t const width) {
+  for (size_t x = 0; x < width; ++x) {
+    dst[x * 3 + 0] = b[x];
+    dst[x * 3 + 1] = g[x];
+    dst[x * 3 + 2] = r[x];
+  }
+}
+
+#if PIXCONV_X86
+
+static inline int32_t load32(void const *const p) {
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+__attribute__((target("sse2"))) static inline __m128i interp_sse2(__m128i const near, __m128i const far) {
+  return _mm_avg_epu8(near, _mm_avg_epu8(near, far));
+}
+
+__attribute__((target("sse2"))) static inline __m128i range_sse2(__m128i const v, int const mul, int const add) {
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const m = _mm_set1_epi16((short)mul);
+  __m128i const a = _mm_set1_epi16((short)add);
+  __m128i const lo = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, v), m), a), 8);
+  __m128i const hi = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(_mm_unpackhi_epi8(zero, v), m), a), 8);
+  return _mm_packus_epi16(lo, hi);
+}
+
+__attribute__((target("sse2"))) static inline void
+store_yuy2_sse2(uint8_t *const dst, __m128i y, __m128i uv, bool const full_range) {
+  if (full_range) {
+    y = range_sse2(y, range_y_mul, range_y_add);
+    uv = range_sse2(uv, range_c_mul, range_c_add);
+  }
+  _mm_storeu_si128((void *)dst, _mm_unpacklo_epi8(y, uv));
+  _mm_storeu_si128((void *)(dst + 16), _mm_unpackhi_epi8(y, uv));
+}
+
+__attribute__((target("sse2"))) static void planar_row_sse2(uint8_t *const dst,
+                                                            uint8_t const *const y,
+                                                            uint8_t const *const u0,
+                                                            uint8_t const *const u1,
+                                                            uint8_t const *const v0,
+                                                            uint8_t const *const v1,
+                                                            size_t const width,
+                                                            bool const full_range) {
+  size_t const n = width & ~(size_t)15;
+  for (size_t x = 0; x < n; x += 16) {
+    size_t const c = x >> 1;
+    __m128i const u = interp_sse2(_mm_loadl_epi64((void const *)(u0 + c)), _mm_loadl_epi64((void const *)(u1 + c)));
+    __m128i const v = interp_sse2(_mm_loadl_epi64((void const *)(v0 + c)), _mm_loadl_epi64((void const *)(v1 + c)));
+    store_yuy2_sse2(dst + x * 2, _mm_loadu_si128((void const *)(y + x)), _mm_unpacklo_epi8(u, v), full_range);
+  }
+  planar_row_c(dst + n * 2, y + n, u0 + n / 2, u1 + n / 2, v0 + n / 2, v1 + n / 2, width - n, full_range);
+}
+
+__attribute__((target("sse2"))) static void semiplanar_row_sse2(uint8_t *const dst,
+                                                                uint8_t const *const y,
+                                                                uint8_t const *const uv0,
+                                                                uint8_t const *const uv1,
+                                                                size_t const width,
+                                                                bool const full_range) {
+  size_t const n = width & ~(size_t)15;
+  for (size_t x = 0; x < n; x += 16) {
+    __m128i const uv =
+        interp_sse2(_mm_loadu_si128((void const *)(uv0 + x)), _mm_loadu_si128((void const *)(uv1 + x)));
+    store_yuy2_sse2(dst + x * 2, _mm_loadu_si128((void const *)(y + x)), uv, full_range);
+  }
+  semiplanar_row_c(dst + n * 2, y + n, uv0 + n, uv1 + n, width - n, full_range);
+}
+
+// (v << (15 - bits)) * (mul << 3) >> 16 equals (v * mul) >> (bits - 2).
+__attribute__((target("sse2"))) static inline __m128i
+yc48_luma_sse2(__m128i const v, int const bits, bool const full_range) {
+  __m128i const r = _mm_mulhi_epu16(_mm_sll_epi16(v, _mm_cvtsi32_si128(15 - bits)),
+                                    _mm_set1_epi16((short)((full_range ? yc48_full_y_mul : yc48_y_mul) << 3)));
+  return full_range ? r : _mm_sub_epi16(r, _mm_set1_epi16(yc48_y_sub));
+}
+
+// The products do not fit in 16 bits, madd computes (v - center) * mul + 1 * add in 32 bits.
+__attribute__((target("sse2"))) static inline __m128i
+yc48_chroma_sse2(__m128i const v, int const bits, bool const full_range) {
+  int const s = bits - 8;
+  __m128i const d = _mm_sub_epi16(v, _mm_set1_epi16((short)(128 << s)));
+  __m128i const one = _mm_set1_epi16(1);
+  __m128i const k = full_range ? _mm_set1_epi32(((yc48_full_c_add << s) << 16) | yc48_full_c_mul)
+                               : _mm_set1_epi32(((yc48_c_add << s) << 16) | yc48_c_mul);
+  __m128i const shift = _mm_cvtsi32_si128(bits);
+  __m128i const lo = _mm_sra_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(d, one), k), shift);
+  __m128i const hi = _mm_sra_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(d, one), k), shift);
+  return _mm_packs_epi32(lo, hi);
+}
+
+// Each pixel is written as 8 bytes and its last 2 bytes are overwritten by the next pixel,
+// so the caller must leave at least one pixel after the block.
+__attribute__((target("sse2"))) static inline void
+store_yc48_sse2(uint8_t *const dst, __m128i const y, __m128i const cb, __m128i const cr) {
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const ycb_lo = _mm_unpacklo_epi16(y, cb);
+  __m128i const ycb_hi = _mm_unpackhi_epi16(y, cb);
+  __m128i const cr_lo = _mm_unpacklo_epi16(cr, zero);
+  __m128i const cr_hi = _mm_unpackhi_epi16(cr, zero);
+  __m128i const px[4] = {
+      _mm_unpacklo_epi32(ycb_lo, cr_lo),
+      _mm_unpackhi_epi32(ycb_lo, cr_lo),
+      _mm_unpacklo_epi32(ycb_hi, cr_hi),
+      _mm_unpackhi_epi32(ycb_hi, cr_hi),
+  };
+  for (size_t i = 0; i < 4; ++i) {
+    _mm_storel_epi64((void *)(dst + i * 12), px[i]);
+    _mm_storel_epi64((void *)(dst + i * 12 + 6), _mm_srli_si128(px[i], 8));
+  }
+}
+
+// y, u and v hold 8 pixels in 16-bit lanes.
+__attribute__((target("sse2"))) static inline void yc48_sse2(
+    uint8_t *const dst, __m128i const y, __m128i const u, __m128i const v, int const bits, bool const full_range) {
+  store_yc48_sse2(dst,
+                  yc48_luma_sse2(y, bits, full_range),
+                  yc48_chroma_sse2(u, bits, full_range),
+                  yc48_chroma_sse2(v, bits, full_range));
+}
+
+__attribute__((target("sse2"))) static void planar_yc48_row_sse2(uint8_t *const dst,
+                                                                 uint8_t const *const y,
+                                                                 uint8_t const *const u0,
+                                                                 uint8_t const *const u1,
+                                                                 uint8_t const *const v0,
+                                                                 uint8_t const *const v1,
+                                                                 size_t const width,
+                                                                 bool const full_range) {
+  __m128i const zero = _mm_setzero_si128();
+  size_t x = 0;
+  for (; x + 8 < width; x += 8) {
+    size_t const c = x >> 1;
+    __m128i const ua = interp_sse2(_mm_cvtsi32_si128(load32(u0 + c)), _mm_cvtsi32_si128(load32(u1 + c)));
+    __m128i const ub = interp_sse2(_mm_cvtsi32_si128(load32(u0 + c + 1)), _mm_cvtsi32_si128(load32(u1 + c + 1)));
+    __m128i const va = interp_sse2(_mm_cvtsi32_si128(load32(v0 + c)), _mm_cvtsi32_si128(load32(v1 + c)));
+    __m128i const vb = interp_sse2(_mm_cvtsi32_si128(load32(v0 + c + 1)), _mm_cvtsi32_si128(load32(v1 + c + 1)));
+    yc48_sse2(dst + x * 6,
+              _mm_unpacklo_epi8(_mm_loadl_epi64((void const *)(y + x)), zero),
+              _mm_unpacklo_epi8(_mm_unpacklo_epi8(ua, _mm_avg_epu8(ua, ub)), zero),
+              _mm_unpacklo_epi8(_mm_unpacklo_epi8(va, _mm_avg_epu8(va, vb)), zero),
+              8,
+              full_range);
+  }
+  planar_yc48_row_c(dst + x * 6, y + x, u0 + x / 2, u1 + x / 2, v0 + x / 2, v1 + x / 2, width - x, full_range);
+}
+
+__attribute__((target("sse2"))) static void semiplanar_yc48_row_sse2(uint8_t *const dst,
+                                                                     uint8_t const *const y,
+                                                                     uint8_t const *const uv0,
+                                                                     uint8_t const *const uv1,
+                                                                     size_t const width,
+                                                                     bool const full_range) {
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const mask = _mm_set1_epi16(0xff);
+  size_t x = 0;
+  for (; x + 8 < width; x += 8) {
+    __m128i const a =
+        interp_sse2(_mm_loadl_epi64((void const *)(uv0 + x)), _mm_loadl_epi64((void const *)(uv1 + x)));
+    __m128i const b =
+        interp_sse2(_mm_loadl_epi64((void const *)(uv0 + x + 2)), _mm_loadl_epi64((void const *)(uv1 + x + 2)));
+    __m128i const uv = _mm_unpacklo_epi16(a, _mm_avg_epu8(a, b));
+    yc48_sse2(dst + x * 6,
+              _mm_unpacklo_epi8(_mm_loadl_epi64((void const *)(y + x)), zero),
+              _mm_and_si128(uv, mask),
+              _mm_srli_epi16(uv, 8),
+              8,
+              full_range);
+  }
+  semiplanar_yc48_row_c(dst + x * 6, y + x, uv0 + x, uv1 + x, width - x, full_range);
+}
+
+__attribute__((target("avx2"))) static inline __m256i interp_avx2(__m256i const near, __m256i const far) {
+  return _mm256_avg_epu8(near, _mm256_avg_epu8(near, far));
+}
+
+__attribute__((target("avx2"))) static inline __m256i range_avx2(__m256i const v, int const mul, int const add) {
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const m = _mm256_set1_epi16((short)mul);
+  __m256i const a = _mm256_set1_epi16((short)add);
+  __m256i const lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, v), m), a), 8);
+  __m256i const hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, v), m), a), 8);
+  return _mm256_packus_epi16(lo, hi);
+}
+
+// AVX2 unpack works within 128-bit lanes, so the halves are reordered before storing.
+__attribute__((target("avx2"))) static inline void
+store_yuy2_avx2(uint8_t *const dst, __m256i y, __m256i uv, bool const full_range) {
+  if (full_range) {
+    y = range_avx2(y, range_y_mul, range_y_add);
+    uv = range_avx2(uv, range_c_mul, range_c_add);
+  }
+  __m256i const lo = _mm256_unpacklo_epi8(y, uv);
+  __m256i const hi = _mm256_unpackhi_epi8(y, uv);
+  _mm256_storeu_si256((void *)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+  _mm256_storeu_si256((void *)(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+__attribute__((target("avx2"))) static void planar_row_avx2(uint8_t *const dst,
+                                                            uint8_t const *const y,
+                                                            uint8_t const *const u0,
+                                                            uint8_t const *const u1,
+                                                            uint8_t const *const v0,
+                                                            uint8_t const *const v1,
+                                                            size_t const width,
+                                                            bool const full_range) {
+  size_t const n = width & ~(size_t)31;
+  for (size_t x = 0; x < n; x += 32) {
+    size_t const c = x >> 1;
+    __m128i const u = interp_sse2(_mm_loadu_si128((void const *)(u0 + c)), _mm_loadu_si128((void const *)(u1 + c)));
+    __m128i const v = interp_sse2(_mm_loadu_si128((void const *)(v0 + c)), _mm_loadu_si128((void const *)(v1 + c)));
+    __m256i const uv =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(u, v)), _mm_unpackhi_epi8(u, v), 1);
+    store_yuy2_avx2(dst + x * 2, _mm256_loadu_si256((void const *)(y + x)), uv, full_range);
+  }
+  planar_row_sse2(dst + n * 2, y + n, u0 + n / 2, u1 + n / 2, v0 + n / 2, v1 + n / 2, width - n, full_range);
+}
+
+__attribute__((target("avx2"))) static void semiplanar_row_avx2(uint8_t *const dst,
+                                                                uint8_t const *const y,
+                                                                uint8_t const *const uv0,
+                                                                uint8_t const *const uv1,
+                                                                size_t const width,
+                                                                bool const full_range) {
+  size_t const n = width & ~(size_t)31;
+  for (size_t x = 0; x < n; x += 32) {
+    __m256i const uv =
+        interp_avx2(_mm256_loadu_si256((void const *)(uv0 + x)), _mm256_loadu_si256((void const *)(uv1 + x)));
+    store_yuy2_avx2(dst + x * 2, _mm256_loadu_si256((void const *)(y + x)), uv, full_range);
+  }
+  semiplanar_row_sse2(dst + n * 2, y + n, uv0 + n, uv1 + n, width - n, full_range);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+yc48_luma_avx2(__m256i const v, int const bits, bool const full_range) {
+  __m256i const r = _mm256_mulhi_epu16(_mm256_sll_epi16(v, _mm_cvtsi32_si128(15 - bits)),
+                                       _mm256_set1_epi16((short)((full_range ? yc48_full_y_mul : yc48_y_mul) << 3)));
+  return full_range ? r : _mm256_sub_epi16(r, _mm256_set1_epi16(yc48_y_sub));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+yc48_chroma_avx2(__m256i const v, int const bits, bool const full_range) {
+  int const s = bits - 8;
+  __m256i const d = _mm256_sub_epi16(v, _mm256_set1_epi16((short)(128 << s)));
+  __m256i const one = _mm256_set1_epi16(1);
+  __m256i const k = full_range ? _mm256_set1_epi32(((yc48_full_c_add << s) << 16) | yc48_full_c_mul)
+                               : _mm256_set1_epi32(((yc48_c_add << s) << 16) | yc48_c_mul);
+  __m128i const shift = _mm_cvtsi32_si128(bits);
+  __m256i const lo = _mm256_sra_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(d, one), k), shift);
+  __m256i const hi = _mm256_sra_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(d, one), k), shift);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+// y, u and v hold 16 pixels in 16-bit lanes, unpack and pack above keep the pixel order within each lane.
+__attribute__((target("avx2"))) static inline void yc48_avx2(
+    uint8_t *const dst, __m256i const y, __m256i const u, __m256i const v, int const bits, bool const full_range) {
+  __m256i const yy = yc48_luma_avx2(y, bits, full_range);
+  __m256i const cb = yc48_chroma_avx2(u, bits, full_range);
+  __m256i const cr = yc48_chroma_avx2(v, bits, full_range);
+  store_yc48_sse2(dst, _mm256_castsi256_si128(yy), _mm256_castsi256_si128(cb), _mm256_castsi256_si128(cr));
+  store_yc48_sse2(
+      dst + 48, _mm256_extracti128_si256(yy, 1), _mm256_extracti128_si256(cb, 1), _mm256_extracti128_si256(cr, 1));
+}
+
+__attribute__((target("avx2"))) static void planar_yc48_row_avx2(uint8_t *const dst,
+                                                                 uint8_t const *const y,
+                                                                 uint8_t const *const u0,
+                                                                 uint8_t const *const u1,
+                                                                 uint8_t const *const v0,
+                                                                 uint8_t const *const v1,
+                                                                 size_t const width,
+                                                                 bool const full_range) {
+  size_t x = 0;
+  for (; x + 16 < width; x += 16) {
+    size_t const c = x >> 1;
+    __m128i const ua =
+        interp_sse2(_mm_loadl_epi64((void const *)(u0 + c)), _mm_loadl_epi64((void const *)(u1 + c)));
+    __m128i const ub =
+        interp_sse2(_mm_loadl_epi64((void const *)(u0 + c + 1)), _mm_loadl_epi64((void const *)(u1 + c + 1)));
+    __m128i const va =
+        interp_sse2(_mm_loadl_epi64((void const *)(v0 + c)), _mm_loadl_epi64((void const *)(v1 + c)));
+    __m128i const vb =
+        interp_sse2(_mm_loadl_epi64((void const *)(v0 + c + 1)), _mm_loadl_epi64((void const *)(v1 + c + 1)));
+    yc48_avx2(dst + x * 6,
+              _mm256_cvtepu8_epi16(_mm_loadu_si128((void const *)(y + x))),
+              _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(ua, _mm_avg_epu8(ua, ub))),
+              _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(va, _mm_avg_epu8(va, vb))),
+              8,
+              full_range);
+  }
+  planar_yc48_row_sse2(dst + x * 6, y + x, u0 + x / 2, u1 + x / 2, v0 + x / 2, v1 + x / 2, width - x, full_range);
+}
+
+__attribute__((target("avx2"))) static void semiplanar_yc48_row_avx2(uint8_t *const dst,
+                                                                     uint8_t const *const y,
+                                                                     uint8_t const *const uv0,
+                                                                     uint8_t const *const uv1,
+                                                                     size_t const width,
+                                                                     bool const full_range) {
+  __m256i const mask = _mm256_set1_epi16(0xff);
+  size_t x = 0;
+  for (; x + 16 < width; x += 16) {
+    __m128i const a =
+        interp_sse2(_mm_loadu_si128((void const *)(uv0 + x)), _mm_loadu_si128((void const *)(uv1 + x)));
+    __m128i const b =
+        interp_sse2(_mm_loadu_si128((void const *)(uv0 + x + 2)), _mm_loadu_si128((void const *)(uv1 + x + 2)));
+    __m128i const h = _mm_avg_epu8(a, b);
+    __m256i const uv =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(a, h)), _mm_unpackhi_epi16(a, h), 1);
+    yc48_avx2(dst + x * 6,
+              _mm256_cvtepu8_epi16(_mm_loadu_si128((void const *)(y + x))),
+              _mm256_and_si256(uv, mask),
+              _mm256_srli_epi16(uv, 8),
+              8,
+              full_range);
+  }
+  semiplanar_yc48_row_sse2(dst + x * 6, y + x, uv0 + x, uv1 + x, width - x, full_range);
+}
+
+__attribute__((target("sse2"))) static inline __m128i load16_sse2(uint16_t const *const p) {
+  return _mm_loadu_si128((void const *)p);
+}
+
+__attribute__((target("sse2"))) static inline __m128i p010_sse2(__m128i const v) { return _mm_srli_epi16(v, 6); }
+
+__attribute__((target("sse2"))) static inline __m128i interp16_sse2(__m128i const near, __m128i const far) {
+  return _mm_avg_epu16(near, _mm_avg_epu16(near, far));
+}
+
+// Adds the dither thresholds and packs two vectors of 10-bit samples into 8-bit samples.
+__attribute__((target("sse2"))) static inline __m128i pack10_sse2(__m128i const a, __m128i const b, __m128i const d) {
+  return _mm_packus_epi16(_mm_srli_epi16(_mm_adds_epu16(a, d), 2), _mm_srli_epi16(_mm_adds_epu16(b, d), 2));
+}
+
+__attribute__((target("sse2"))) static void planar10_row_sse2(uint8_t *const dst,
+                                                              uint16_t const *const y,
+                                                              uint16_t const *const u0,
+                                                              uint16_t const *const u1,
+                                                              uint16_t const *const v0,
+                                                              uint16_t const *const v1,
+                                                              size_t const width,
+                                                              uint8_t const *const dither) {
+  // Luma and chroma both alternate between the even and odd thresholds.
+  __m128i const d = _mm_set1_epi32(dither[0] | (dither[1] << 16));
+  size_t const n = width & ~(size_t)15;
+  for (size_t x = 0; x < n; x += 16) {
+    size_t const c = x >> 1;
+    __m128i const uv = pack10_sse2(interp16_sse2(load16_sse2(u0 + c), load16_sse2(u1 + c)),
+                                   interp16_sse2(load16_sse2(v0 + c), load16_sse2(v1 + c)),
+                                   d);
+    store_yuy2_sse2(dst + x * 2,
+                    pack10_sse2(load16_sse2(y + x), load16_sse2(y + x + 8), d),
+                    _mm_unpacklo_epi8(uv, _mm_srli_si128(uv, 8)),
+                    false);
+  }
+  planar10_row_c(dst + n * 2, y + n, u0 + n / 2, u1 + n / 2, v0 + n / 2, v1 + n / 2, width - n, dither);
+}
+
+__attribute__((target("sse2"))) static void p010_row_sse2(uint8_t *const dst,
+                                                          uint16_t const *const y,
+                                                          uint16_t const *const uv0,
+                                                          uint16_t const *const uv1,
+                                                          size_t const width,
+                                                          uint8_t const *const dither) {
+  __m128i const dy = _mm_set1_epi32(dither[0] | (dither[1] << 16));
+  __m128i const duv = _mm_set1_epi64x((int64_t)(dither[0] * 0x10001) | ((int64_t)(dither[1] * 0x10001) << 32));
+  size_t const n = width & ~(size_t)15;
+  for (size_t x = 0; x < n; x += 16) {
+    __m128i const a = interp16_sse2(p010_sse2(load16_sse2(uv0 + x)), p010_sse2(load16_sse2(uv1 + x)));
+    __m128i const b = interp16_sse2(p010_sse2(load16_sse2(uv0 + x + 8)), p010_sse2(load16_sse2(uv1 + x + 8)));
+    store_yuy2_sse2(dst + x * 2,
+                    pack10_sse2(p010_sse2(load16_sse2(y + x)), p010_sse2(load16_sse2(y + x + 8)), dy),
+                    pack10_sse2(a, b, duv),
+                    false);
+  }
+  p010_row_c(dst + n * 2, y + n, uv0 + n, uv1 + n, width - n, dither);
+}
+
+__attribute__((target("sse2"))) static void planar10_yc48_row_sse2(uint8_t *const dst,
+                                                                   uint16_t const *const y,
+                                                                   uint16_t const *const u0,
+                                                                   uint16_t const *const u1,
+                                                                   uint16_t const *const v0,
+                                                                   uint16_t const *const v1,
+                                                                   size_t const width,
+                                                                   uint8_t const *const dither) {
+  size_t x = 0;
+  for (; x + 8 < width; x += 8) {
+    size_t const c = x >> 1;
+    __m128i const ua = interp16_sse2(_mm_loadl_epi64((void const *)(u0 + c)), _mm_loadl_epi64((void const *)(u1 + c)));
+    __m128i const ub =
+        interp16_sse2(_mm_loadl_epi64((void const *)(u0 + c + 1)), _mm_loadl_epi64((void const *)(u1 + c + 1)));
+    __m128i const va = interp16_sse2(_mm_loadl_epi64((void const *)(v0 + c)), _mm_loadl_epi64((void const *)(v1 + c)));
+    __m128i const vb =
+        interp16_sse2(_mm_loadl_epi64((void const *)(v0 + c + 1)), _mm_loadl_epi64((void const *)(v1 + c + 1)));
+    yc48_sse2(dst + x * 6,
+              load16_sse2(y + x),
+              _mm_unpacklo_epi16(ua, _mm_avg_epu16(ua, ub)),
+              _mm_unpacklo_epi16(va, _mm_avg_epu16(va, vb)),
+              10,
+              false);
+  }
+  planar10_yc48_row_c(dst + x * 6, y + x, u0 + x / 2, u1 + x / 2, v0 + x / 2, v1 + x / 2, width - x, dither);
+}
+
+// Chroma pairs are interleaved with their horizontal averages as 32-bit units, then split into u and v.
+__attribute__((target("sse2"))) static void p010_yc48_row_sse2(uint8_t *const dst,
+                                                               uint16_t const *const y,
+                                                               uint16_t const *const uv0,
+                                                               uint16_t const *const uv1,
+                                                               size_t const width,
+                                                               uint8_t const *const dither) {
+  __m128i const mask = _mm_set1_epi32(0xffff);
+  size_t x = 0;
+  for (; x + 8 < width; x += 8) {
+    __m128i const a = interp16_sse2(p010_sse2(load16_sse2(uv0 + x)), p010_sse2(load16_sse2(uv1 + x)));
+    __m128i const b = interp16_sse2(p010_sse2(load16_sse2(uv0 + x + 2)), p010_sse2(load16_sse2(uv1 + x + 2)));
+    __m128i const h = _mm_avg_epu16(a, b);
+    __m128i const lo = _mm_unpacklo_epi32(a, h);
+    __m128i const hi = _mm_unpackhi_epi32(a, h);
+    yc48_sse2(dst + x * 6,
+              p010_sse2(load16_sse2(y + x)),
+              _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask)),
+              _mm_packs_epi32(_mm_srli_epi32(lo, 16), _mm_srli_epi32(hi, 16)),
+              10,
+              false);
+  }
+  p010_yc48_row_c(dst + x * 6, y + x, uv0 + x, uv1 + x, width - x, dither);
+}
+
+__attribute__((target("avx2"))) static inline __m256i load16_avx2(uint16_t const *const p) {
+  return _mm256_loadu_si256((void const *)p);
+}
+
+__attribute__((target("avx2"))) static inline __m256i p010_avx2(__m256i const v) { return _mm256_srli_epi16(v, 6); }
+
+__attribute__((target("avx2"))) static inline __m256i interp16_avx2(__m256i const near, __m256i const far) {
+  return _mm256_avg_epu16(near, _mm256_avg_epu16(near, far));
+}
+
+// The result is packed within 128-bit lanes, the caller reorders the quarters if needed.
+__attribute__((target("avx2"))) static inline __m256i pack10_avx2(__m256i const a, __m256i const b, __m256i const d) {
+  return _mm256_packus_epi16(_mm256_srli_epi16(_mm256_adds_epu16(a, d), 2),
+                             _mm256_srli_epi16(_mm256_adds_epu16(b, d), 2));
+}
+
+__attribute__((target("avx2"))) static void planar10_row_avx2(uint8_t *const dst,
+                                                              uint16_t const *const y,
+                                                              uint16_t const *const u0,
+                                                              uint16_t const *const u1,
+                                                              uint16_t const *const v0,
+                                                              uint16_t const *const v1,
+                                                              size_t const width,
+                                                              uint8_t const *const dither) {
+  __m256i const d = _mm256_set1_epi32(dither[0] | (dither[1] << 16));
+  size_t const n = width & ~(size_t)31;
+  for (size_t x = 0; x < n; x += 32) {
+    size_t const c = x >> 1;
+    // Each lane holds 8 u followed by 8 v, interleaving them within the lane gives the natural order.
+    __m256i const uv = pack10_avx2(interp16_avx2(load16_avx2(u0 + c), load16_avx2(u1 + c)),
+                                   interp16_avx2(load16_avx2(v0 + c), load16_avx2(v1 + c)),
+                                   d);
+    store_yuy2_avx2(dst + x * 2,
+                    _mm256_permute4x64_epi64(pack10_avx2(load16_avx2(y + x), load16_avx2(y + x + 16), d), 0xd8),
+                    _mm256_unpacklo_epi8(uv, _mm256_srli_si256(uv, 8)),
+                    false);
+  }
+  planar10_row_sse2(dst + n * 2, y + n, u0 + n / 2, u1 + n / 2, v0 + n / 2, v1 + n / 2, width - n, dither);
+}
+
+__attribute__((target("avx2"))) static void p010_row_avx2(uint8_t *const dst,
+                                                          uint16_t const *const y,
+                                                          uint16_t const *const uv0,
+                                                          uint16_t const *const uv1,
+                                                          size_t const width,
+                                                          uint8_t const *const dither) {
+  __m256i const dy = _mm256_set1_epi32(dither[0] | (dither[1] << 16));
+  __m256i const duv = _mm256_set1_epi64x((int64_t)(dither[0] * 0x10001) | ((int64_t)(dither[1] * 0x10001) << 32));
+  size_t const n = width & ~(size_t)31;
+  for (size_t x = 0; x < n; x += 32) {
+    __m256i const a = interp16_avx2(p010_avx2(load16_avx2(uv0 + x)), p010_avx2(load16_avx2(uv1 + x)));
+    __m256i const b = interp16_avx2(p010_avx2(load16_avx2(uv0 + x + 16)), p010_avx2(load16_avx2(uv1 + x + 16)));
+    store_yuy2_avx2(
+        dst + x * 2,
+        _mm256_permute4x64_epi64(pack10_avx2(p010_avx2(load16_avx2(y + x)), p010_avx2(load16_avx2(y + x + 16)), dy),
+                                 0xd8),
+        _mm256_permute4x64_epi64(pack10_avx2(a, b, duv), 0xd8),
+        false);
+  }
+  p010_row_sse2(dst + n * 2, y + n, uv0 + n, uv1 + n, width - n, dither);
+}
+
+__attribute__((target("avx2"))) static void planar10_yc48_row_avx2(uint8_t *const dst,
+                                                                   uint16_t const *const y,
+                                                                   uint16_t const *const u0,
+                                                                   uint16_t const *const u1,
+                                                                   uint16_t const *const v0,
+                                                                   uint16_t const *const v1,
+                                                                   size_t const width,
+                                                                   uint8_t const *const dither) {
+  size_t x = 0;
+  for (; x + 16 < width; x += 16) {
+    size_t const c = x >> 1;
+    __m128i const ua = interp16_sse2(load16_sse2(u0 + c), load16_sse2(u1 + c));
+    __m128i const ub = interp16_sse2(load16_sse2(u0 + c + 1), load16_sse2(u1 + c + 1));
+    __m128i const va = interp16_sse2(load16_sse2(v0 + c), load16_sse2(v1 + c));
+    __m128i const vb = interp16_sse2(load16_sse2(v0 + c + 1), load16_sse2(v1 + c + 1));
+    __m128i const uh = _mm_avg_epu16(ua, ub);
+    __m128i const vh = _mm_avg_epu16(va, vb);
+    __m256i const u =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(ua, uh)), _mm_unpackhi_epi16(ua, uh), 1);
+    __m256i const v =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(va, vh)), _mm_unpackhi_epi16(va, vh), 1);
+    yc48_avx2(dst + x * 6, load16_avx2(y + x), u, v, 10, false);
+  }
+  planar10_yc48_row_sse2(dst + x * 6, y + x, u0 + x / 2, u1 + x / 2, v0 + x / 2, v1 + x / 2, width - x, dither);
+}
+
+__attribute__((target("avx2"))) static void p010_yc48_row_avx2(uint8_t *const dst,
+                                                               uint16_t const *const y,
+                                                               uint16_t const *const uv0,
+                                                               uint16_t const *const uv1,
+                                                               size_t const width,
+                                                               uint8_t const *const dither) {
+  __m256i const mask = _mm256_set1_epi32(0xffff);
+  size_t x = 0;
+  for (; x + 16 < width; x += 16) {
+    __m256i const a = interp16_avx2(p010_avx2(load16_avx2(uv0 + x)), p010_avx2(load16_avx2(uv1 + x)));
+    __m256i const b = interp16_avx2(p010_avx2(load16_avx2(uv0 + x + 2)), p010_avx2(load16_avx2(uv1 + x + 2)));
+    __m256i const h = _mm256_avg_epu16(a, b);
+    __m256i const lo = _mm256_unpacklo_epi32(a, h);
+    __m256i const hi = _mm256_unpackhi_epi32(a, h);
+    yc48_avx2(dst + x * 6,
+              p010_avx2(load16_avx2(y + x)),
+              _mm256_packs_epi32(_mm256_and_si256(lo, mask), _mm256_and_si256(hi, mask)),
+              _mm256_packs_epi32(_mm256_srli_epi32(lo, 16), _mm256_srli_epi32(hi, 16)),
+              10,
+              false);
+  }
+  p010_yc48_row_sse2(dst + x * 6, y + x, uv0 + x, uv1 + x, width - x, dither);
+}
+
+// pshufb indices that gather B, G and R bytes of 16 gbrp pixels into the three 16-byte chunks of 48 BGR24 bytes.
+// 128 clears the byte, so the three shuffles of a chunk can be combined with OR.
+static uint8_t const gbrp_shuffle[3][3][16] = {
+    {
+        {0, 128, 128, 1, 128, 128, 2, 128, 128, 3, 128, 128, 4, 128, 128, 5},
+        {128, 0, 128, 128, 1, 128, 128, 2, 128, 128, 3, 128, 128, 4, 128, 128},
+        {128, 128, 0, 128, 128, 1, 128, 128, 2, 128, 128, 3, 128, 128, 4, 128},
+    },
+    {
+        {128, 128, 6, 128, 128, 7, 128, 128, 8, 128, 128, 9, 128, 128, 10, 128},
+        {5, 128, 128, 6, 128, 128, 7, 128, 128, 8, 128, 128, 9, 128, 128, 10},
+        {128, 5, 128, 128, 6, 128, 128, 7, 128, 128, 8, 128, 128, 9, 128, 128},
+    },
+    {
+        {128, 11, 128, 128, 12, 128, 128, 13, 128, 128, 14, 128, 128, 15, 128, 128},
+        {128, 128, 11, 128, 128, 12, 128, 128, 13, 128, 128, 14, 128, 128, 15, 128},
+        {10, 128, 128, 11, 128, 128, 12, 128, 128, 13, 128, 128, 14, 128, 128, 15},
+    },
+};
+
+// pshufb indices that move B, G and R of 4 packed pixels into the first 12 bytes, the last 4 bytes are cleared.
+__attribute__((target("ssse3"))) static inline __m128i packed_rgb_shuffle_ssse3(struct rgb_order const *const order) {
+  uint8_t m[16];
+  for (size_t i = 0; i < 4; ++i) {
+    m[i * 3 + 0] = (uint8_t)(i * order->bpp + order->b);
+    m[i * 3 + 1] = (uint8_t)(i * order->bpp + order->g);
+    m[i * 3 + 2] = (uint8_t)(i * order->bpp + order->r);
+    m[12 + i] = 128;
+  }
+  return _mm_loadu_si128((void const *)m);
+}
+
+__attribute__((target("ssse3"))) static void packed_rgb_row_ssse3(uint8_t *const dst,
+                                                                  uint8_t const *const src,
+                                                                  size_t const width,
+                                                                  struct rgb_order const *const order) {
+  __m128i const shuffle = packed_rgb_shuffle_ssse3(order);
+  size_t x = 0;
+  // Each store writes 16 bytes for 4 pixels and the next store overwrites the last 4,
+  // the margin keeps both the 16-byte loads and stores inside the row.
+  for (; x + 6 <= width; x += 4) {
+    __m128i const v = _mm_loadu_si128((void const *)(src + x * order->bpp));
+    _mm_storeu_si128((void *)(dst + x * 3), _mm_shuffle_epi8(v, shuffle));
+  }
+  packed_rgb_row_c(dst + x * 3, src + x * order->bpp, width - x, order);
+}
+
+__attribute__((target("ssse3"))) static void gbrp_row_ssse3(uint8_t *const dst,
+                                                            uint8_t const *const g,
+                                                            uint8_t const *const b,
+                                                            uint8_t const *const r,
+                                                            size_t const width) {
+  size_t x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i const vb = _mm_loadu_si128((void const *)(b + x));
+    __m128i const vg = _mm_loadu_si128((void const *)(g + x));
+    __m128i const vr = _mm_loadu_si128((void const *)(r + x));
+    for (size_t i = 0; i < 3; ++i) {
+      __m128i const sb = _mm_shuffle_epi8(vb, _mm_loadu_si128((void const *)gbrp_shuffle[i][0]));
+      __m128i const sg = _mm_shuffle_epi8(vg, _mm_loadu_si128((void const *)gbrp_shuffle[i][1]));
+      __m128i const sr = _mm_shuffle_epi8(vr, _mm_loadu_si128((void const *)gbrp_shuffle[i][2]));
+      _mm_storeu_si128((void *)(dst + x * 3 + i * 16), _mm_or_si128(_mm_or_si128(sb, sg), sr));
+    }
+  }
+  gbrp_row_c(dst + x * 3, g + x, b + x, r + x, width - x);
+}
+
+__attribute__((target("avx2"))) static void packed_rgb_row_avx2(uint8_t *const dst,
+                                                                uint8_t const *const src,
+                                                                size_t const width,
+                                                                struct rgb_order const *const order) {
+  __m256i const shuffle = _mm256_broadcastsi128_si256(packed_rgb_shuffle_ssse3(order));
+  // Moves the 12 valid bytes of each lane next to each other.
+  __m256i const compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  size_t x = 0;
+  // Each store writes 32 bytes for 8 pixels and the next store overwrites the last 8,
+  // the margin keeps both the loads of pixels x + 4 onwards and the stores inside the row.
+  for (; x + 11 <= width; x += 8) {
+    __m128i const lo = _mm_loadu_si128((void const *)(src + x * order->bpp));
+    __m128i const hi = _mm_loadu_si128((void const *)(src + (x + 4) * order->bpp));
+    __m256i const v = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), shuffle);
+    _mm256_storeu_si256((void *)(dst + x * 3), _mm256_permutevar8x32_epi32(v, compact));
+  }
+  packed_rgb_row_ssse3(dst + x * 3, src + x * order->bpp, width - x, order);
+}
+
+__attribute__((target("avx2"))) static inline __m256i gbrp_shuffle_avx2(size_t const chunk, size_t const plane) {
+  return _mm256_broadcastsi128_si256(_mm_loadu_si128((void const *)gbrp_shuffle[chunk][plane]));
+}
+
+__attribute__((target("avx2"))) static void gbrp_row_avx2(uint8_t *const dst,
+                                                          uint8_t const *const g,
+                                                          uint8_t const *const b,
+                                                          uint8_t const *const r,
+                                                          size_t const width) {
+  size_t x = 0;
+  // Each lane converts 16 pixels, the low lanes form the first 48 bytes and the high lanes the next 48.
+  for (; x + 32 <= width; x += 32) {
+    __m256i const vb = _mm256_loadu_si256((void const *)(b + x));
+    __m256i const vg = _mm256_loadu_si256((void const *)(g + x));
+    __m256i const vr = _mm256_loadu_si256((void const *)(r + x));
+    __m256i o[3];
+    for (size_t i = 0; i < 3; ++i) {
+      __m256i const sb = _mm256_shuffle_epi8(vb, gbrp_shuffle_avx2(i, 0));
+      __m256i const sg = _mm256_shuffle_epi8(vg, gbrp_shuffle_avx2(i, 1));
+      __m256i const sr = _mm256_shuffle_epi8(vr, gbrp_shuffle_avx2(i, 2));
+      o[i] = _mm256_or_si256(_mm256_or_si256(sb, sg), sr);
+    }
+    uint8_t *const d = dst + x * 3;
+    _mm256_storeu_si256((void *)d, _mm256_permute2x128_si256(o[0], o[1], 0x20));
+    _mm256_storeu_si256((void *)(d + 32), _mm256_permute2x128_si256(o[2], o[0], 0x30));
+    _mm256_storeu_si256((void *)(d + 64), _mm256_permute2x128_si256(o[1], o[2], 0x31));
+  }
+  gbrp_row_ssse3(dst + x * 3, g + x, b + x, r + x, width - x);
+}
+
+static enum pixconv_isa detect_isa(void) {
+  unsigned int a = 0, b = 0, c = 0, d = 0;
+  if (!__get_cpuid(1, &a, &b, &c, &d)) {
+    return pixconv_isa_c;
+  }
+  if (!(d & bit_SSE2)) {
+    return pixconv_isa_c;
+  }
+  bool const ssse3 = (c & bit_SSSE3) != 0;
+  // AVX registers are usable only if the OS saves them on context switches.
+  if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+    unsigned int xcr0_lo = 0, xcr0_hi = 0;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) == 6 && __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2)) {
+      return pixconv_isa_avx2;
+    }
+  }
+  return ssse3 ? pixconv_isa_ssse3 : pixconv_isa_sse2;
+}
+
+#endif
+
+enum pixconv_isa pixconv_get_isa(void) {
+#if PIXCONV_X86
+  static int isa = -1;
+  if (isa == -1) {
+    isa = (int)detect_isa();
+  }
+  return (enum pixconv_isa)isa;
+#else
+  return pixconv_isa_c;
+#endif
+}
+
+static planar_row_func get_planar_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return planar_row_sse2;
+  case pixconv_isa_avx2:
+    return planar_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return planar_row_c;
+}
+
+static semiplanar_row_func get_semiplanar_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return semiplanar_row_sse2;
+  case pixconv_isa_avx2:
+    return semiplanar_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return semiplanar_row_c;
+}
+
+static planar_row_func get_planar_yc48_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return planar_yc48_row_sse2;
+  case pixconv_isa_avx2:
+    return planar_yc48_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return planar_yc48_row_c;
+}
+
+static semiplanar_row_func get_semiplanar_yc48_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return semiplanar_yc48_row_sse2;
+  case pixconv_isa_avx2:
+    return semiplanar_yc48_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return semiplanar_yc48_row_c;
+}
+
+static planar16_row_func get_planar10_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return planar10_row_sse2;
+  case pixconv_isa_avx2:
+    return planar10_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return planar10_row_c;
+}
+
+static semiplanar16_row_func get_p010_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return p010_row_sse2;
+  case pixconv_isa_avx2:
+    return p010_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return p010_row_c;
+}
+
+static planar16_row_func get_planar10_yc48_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return planar10_yc48_row_sse2;
+  case pixconv_isa_avx2:
+    return planar10_yc48_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return planar10_yc48_row_c;
+}
+
+static semiplanar16_row_func get_p010_yc48_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+    return p010_yc48_row_sse2;
+  case pixconv_isa_avx2:
+    return p010_yc48_row_avx2;
+#else
+  case pixconv_isa_sse2:
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return p010_yc48_row_c;
+}
+
+static packed_rgb_row_func get_packed_rgb_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+  case pixconv_isa_sse2:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_ssse3:
+    return packed_rgb_row_ssse3;
+  case pixconv_isa_avx2:
+    return packed_rgb_row_avx2;
+#else
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return packed_rgb_row_c;
+}
+
+static gbrp_row_func get_gbrp_row(enum pixconv_isa const isa) {
+  switch (isa) {
+  case pixconv_isa_c:
+  case pixconv_isa_sse2:
+    break;
+#if PIXCONV_X86
+  case pixconv_isa_ssse3:
+    return gbrp_row_ssse3;
+  case pixconv_isa_avx2:
+    return gbrp_row_avx2;
+#else
+  case pixconv_isa_ssse3:
+  case pixconv_isa_avx2:
+    break;
+#endif
+  }
+  return gbrp_row_c;
+}
+
+static bool is_10bit(enum pixconv_layout const layout) {
+  return layout == pixconv_layout_yuv420p10 || layout == pixconv_layout_yuv422p10 || layout == pixconv_layout_p010;
+}
+
+// Returns the nearest and the second nearest chroma rows of luma row y.
+static void get_chroma_rows(struct pixconv_yuv const *const src, int const y, int *const c0, int *const c1) {
+  if (src->layout == pixconv_layout_yuv422p || src->layout == pixconv_layout_yuv422p10) {
+    *c0 = y;
+    *c1 = y;
+    return;
+  }
+  int const chroma_height = (src->height + 1) / 2;
+  int const nearest = y >> 1;
+  int const second = (y & 1) ? nearest + 1 : nearest - 1;
+  *c0 = nearest;
+  *c1 = second < 0 ? 0 : (second >= chroma_height ? chroma_height - 1 : second);
+}
+
+static void convert_rows(struct pixconv_yuv const *const src,
+                         uint8_t *const dst,
+                         ptrdiff_t const dst_stride,
+                         int const y_begin,
+                         int const y_end,
+                         planar_row_func const planar,
+                         semiplanar_row_func const semiplanar) {
+  for (int y = y_begin; y < y_end; ++y) {
+    int c0 = 0, c1 = 0;
+    get_chroma_rows(src, y, &c0, &c1);
+    uint8_t *const d = dst + dst_stride * y;
+    uint8_t const *const luma = src->planes[0] + src->strides[0] * y;
+    if (src->layout == pixconv_layout_nv12) {
+      semiplanar(d,
+                 luma,
+                 src->planes[1] + src->strides[1] * c0,
+                 src->planes[1] + src->strides[1] * c1,
+                 (size_t)src->width,
+                 src->full_range);
+      continue;
+    }
+    planar(d,
+           luma,
+           src->planes[1] + src->strides[1] * c0,
+           src->planes[1] + src->strides[1] * c1,
+           src->planes[2] + src->strides[2] * c0,
+           src->planes[2] + src->strides[2] * c1,
+           (size_t)src->width,
+           src->full_range);
+  }
+}
+
+static inline uint16_t const *row16(struct pixconv_yuv const *const src, size_t const plane, int const y) {
+  return (uint16_t const *)(void const *)(src->planes[plane] + src->strides[plane] * y);
+}
+
+static void convert_rows16(struct pixconv_yuv const *const src,
+                           uint8_t *const dst,
+                           ptrdiff_t const dst_stride,
+                           int const y_begin,
+                           int const y_end,
+                           planar16_row_func const planar,
+                           semiplanar16_row_func const semiplanar) {
+  // 2x2 Bayer matrix scaled to the 2 bits that are dropped, without dithering every sample is rounded.
+  static uint8_t const bayer[2][2] = {{0, 2}, {3, 1}};
+  static uint8_t const nearest[2] = {2, 2};
+  for (int y = y_begin; y < y_end; ++y) {
+    int c0 = 0, c1 = 0;
+    get_chroma_rows(src, y, &c0, &c1);
+    uint8_t *const d = dst + dst_stride * y;
+    uint8_t const *const dither = src->dither ? bayer[y & 1] : nearest;
+    if (src->layout == pixconv_layout_p010) {
+      semiplanar(d, row16(src, 0, y), row16(src, 1, c0), row16(src, 1, c1), (size_t)src->width, dither);
+      continue;
+    }
+    planar(d,
+           row16(src, 0, y),
+           row16(src, 1, c0),
+           row16(src, 1, c1),
+           row16(src, 2, c0),
+           row16(src, 2, c1),
+           (size_t)src->width,
+           dither);
+  }
+}
+
+void pixconv_yuv_to_yuy2(struct pixconv_yuv const *const src,
+                         uint8_t *const dst,
+                         ptrdiff_t const dst_stride,
+                         int const y_begin,
+                         int const y_end,
+                         enum pixconv_isa const isa) {
+  if (is_10bit(src->layout)) {
+    convert_rows16(src, dst, dst_stride, y_begin, y_end, get_planar10_row(isa), get_p010_row(isa));
+    return;
+  }
+  convert_rows(src, dst, dst_stride, y_begin, y_end, get_planar_row(isa), get_semiplanar_row(isa));
+}
+
+void pixconv_yuv_to_yc48(struct pixconv_yuv const *const src,
+                         uint8_t *const dst,
+                         ptrdiff_t const dst_stride,
+                         int const y_begin,
+                         int const y_end,
+                         enum pixconv_isa const isa) {
+  if (is_10bit(src->layout)) {
+    convert_rows16(src, dst, dst_stride, y_begin, y_end, get_planar10_yc48_row(isa), get_p010_yc48_row(isa));
+    return;
+  }
+  convert_rows(src, dst, dst_stride, y_begin, y_end, get_planar_yc48_row(isa), get_semiplanar_yc48_row(isa));
+}
+
+void pixconv_yuv444p16_to_yc48(struct pixconv_yuv const *const src,
+                               uint8_t *const dst,
+                               ptrdiff_t const dst_stride,
+                               int const y_begin,
+                               int const y_end) {
+  for (int y = y_begin; y < y_end; ++y) {
+    uint8_t *const d = dst + dst_stride * y;
+    uint8_t const *const p[3] = {
+        src->planes[0] + src->strides[0] * y,
+        src->planes[1] + src->strides[1] * y,
+        src->planes[2] + src->strides[2] * y,
+    };
+    for (size_t x = 0; x < (size_t)src->width; ++x) {
+      uint16_t v[3];
+      for (size_t i = 0; i < 3; ++i) {
+        memcpy(v + i, p[i] + x * 2, sizeof(uint16_t));
+      }
+      store_yc48(d + x * 6, yc48_luma(v[0], 16, false), yc48_chroma(v[1], 16, false), yc48_chroma(v[2], 16, false));
+    }
+  }
+}
+
+void pixconv_rgb_to_bgr24(struct pixconv_rgb const *const src,
+                          uint8_t *const dst,
+                          ptrdiff_t const dst_stride,
+                          int const y_begin,
+                          int const y_end,
+                          enum pixconv_isa const isa) {
+  if (src->layout == pixconv_rgb_layout_gbrp) {
+    gbrp_row_func const row = get_gbrp_row(isa);
+    for (int y = y_begin; y < y_end; ++y) {
+      row(dst + dst_stride * y,
+          src->planes[0] + src->strides[0] * y,
+          src->planes[1] + src->strides[1] * y,
+          src->planes[2] + src->strides[2] * y,
+          (size_t)src->width);
+    }
+    return;
+  }
+  static struct rgb_order const orders[] = {
+      [pixconv_rgb_layout_rgb24] = {.bpp = 3, .b = 2, .g = 1, .r = 0},
+      [pixconv_rgb_layout_rgbx] = {.bpp = 4, .b = 2, .g = 1, .r = 0},
+      [pixconv_rgb_layout_bgrx] = {.bpp = 4, .b = 0, .g = 1, .r = 2},
+      [pixconv_rgb_layout_xrgb] = {.bpp = 4, .b = 3, .g = 2, .r = 1},
+      [pixconv_rgb_layout_xbgr] = {.bpp = 4, .b = 1, .g = 2, .r = 3},
+  };
+  struct rgb_order const *const order = orders + src->layout;
+  packed_rgb_row_func const row = get_packed_rgb_row(isa);
+  for (int y = y_begin; y < y_end; ++y) {
+    row(dst + dst_stride * y, src->planes[0] + src->strides[0] * y, (size_t)src->width, order);
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "ovbase.h"
+
+// Pixel format conversion kernels that do not need swscale.
+// They only repack, interpolate chroma and adjust the range, so source and destination must have the same size.
+
+enum pixconv_isa {
+  pixconv_isa_c,
+  pixconv_isa_sse2,
+  // YUV kernels use the SSE2 implementation, only byte shuffles of RGB kernels need SSSE3.
+  pixconv_isa_ssse3,
+  pixconv_isa_avx2,
+};
+
+enum pixconv_layout {
+  pixconv_layout_yuv420p,
+  pixconv_layout_yuv422p,
+  pixconv_layout_nv12,
+  // 10-bit samples in the low bits of 16-bit little endian words.
+  pixconv_layout_yuv420p10,
+  pixconv_layout_yuv422p10,
+  // 10-bit samples in the high bits, chroma is interleaved like nv12.
+  pixconv_layout_p010,
+};
+
+struct pixconv_yuv {
+  enum pixconv_layout layout;
+  // Converts full range (JPEG) input to limited range output.
+  // 10-bit layouts are limited range only and ignore this.
+  bool full_range;
+  // Applies 2x2 ordered dithering when 10-bit input is reduced to 8-bit YUY2, otherwise it is rounded.
+  bool dither;
+  // must be even.
+  int width;
+  int height;
+  uint8_t const *planes[3];
+  ptrdiff_t strides[3];
+};
+
+enum pixconv_rgb_layout {
+  // R, G, B bytes.
+  pixconv_rgb_layout_rgb24,
+  // 4 bytes per pixel in the named byte order, x is padding or alpha and is dropped.
+  pixconv_rgb_layout_rgbx,
+  pixconv_rgb_layout_bgrx,
+  pixconv_rgb_layout_xrgb,
+  pixconv_rgb_layout_xbgr,
+  // 8-bit planes in G, B, R order.
+  pixconv_rgb_layout_gbrp,
+};
+
+struct pixconv_rgb {
+  enum pixconv_rgb_layout layout;
+  int width;
+  int height;
+  uint8_t const *planes[3];
+  ptrdiff_t strides[3];
+};
+
+// Returns the best instruction set supported by the running CPU.
+enum pixconv_isa pixconv_get_isa(void);
+
+// Converts rows [y_begin, y_end) into packed YUY2.
+// The result does not depend on isa, every implementation produces the same bytes.
+void pixconv_yuv_to_yuy2(struct pixconv_yuv const *const src,
+                         uint8_t *const dst,
+                         ptrdiff_t const dst_stride,
+                         int const y_begin,
+                         int const y_end,
+                         enum pixconv_isa const isa);
+
+// Converts rows [y_begin, y_end) into YC48, the 16-bit 4:4:4 format used inside AviUtl.
+// The result does not depend on isa, every implementation produces the same bytes.
+void pixconv_yuv_to_yc48(struct pixconv_yuv const *const src,
+                         uint8_t *const dst,
+                         ptrdiff_t const dst_stride,
+                         int const y_begin,
+                         int const y_end,
+                         enum pixconv_isa const isa);
+
+// Converts rows [y_begin, y_end) of limited range yuv444p16 into YC48.
+// This is the fallback for formats that are converted by swscale first, src->layout and src->full_range are ignored.
+void pixconv_yuv444p16_to_yc48(struct pixconv_yuv const *const src,
+                               uint8_t *const dst,
+                               ptrdiff_t const dst_stride,
+                               int const y_begin,
+                               int const y_end);
+
+// Converts rows [y_begin, y_end) into BGR24.
+// For bottom-up output, dst points to the last row and dst_stride is negative.
+// The result does not depend on isa, every implementation produces the same bytes.
+void pixconv_rgb_to_bgr24(struct pixconv_rgb const *const src,
+                          uint8_t *const dst,
+                          ptrdiff_t const dst_stride,
+                          int const y_begin,
+                          int const y_end,
+                          enum pixconv_isa const isa);
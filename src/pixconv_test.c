@@ -0,0 +1,470 @@
+#include "pixconv.c"
+
+#include "ovtest.h"
+
+#include <stdlib.h>
+
+struct image {
+  uint8_t *planes[3];
+  struct pixconv_yuv yuv;
+};
+
+static NODISCARD error image_create(struct image *const img,
+                                    enum pixconv_layout const layout,
+                                    bool const full_range,
+                                    int const width,
+                                    int const height) {
+  bool const is10 = layout == pixconv_layout_yuv420p10 || layout == pixconv_layout_yuv422p10 ||
+                    layout == pixconv_layout_p010;
+  bool const semiplanar = layout == pixconv_layout_nv12 || layout == pixconv_layout_p010;
+  int const ch = layout == pixconv_layout_yuv422p || layout == pixconv_layout_yuv422p10 ? height : (height + 1) / 2;
+  ptrdiff_t const bps = is10 ? 2 : 1;
+  // Strides are padded to catch kernels that assume tightly packed rows.
+  ptrdiff_t const ys = (width + 7) * bps;
+  ptrdiff_t const cs = ((semiplanar ? width : width / 2) + 5) * bps;
+  *img = (struct image){
+      .yuv =
+          {
+              .layout = layout,
+              .full_range = full_range,
+              .width = width,
+              .height = height,
+              .strides = {ys, cs, semiplanar ? 0 : cs},
+          },
+  };
+  size_t const sizes[3] = {(size_t)(ys * height), (size_t)(cs * ch), (size_t)(cs * ch)};
+  for (size_t i = 0; i < 3; ++i) {
+    error err = mem(&img->planes[i], sizes[i], 1);
+    if (efailed(err)) {
+      return ethru(err);
+    }
+    if (is10) {
+      // p010 stores the 10 bits in the high bits.
+      for (size_t j = 0; j < sizes[i]; j += 2) {
+        uint16_t const v = (uint16_t)((rand() & 1023) << (layout == pixconv_layout_p010 ? 6 : 0));
+        memcpy(img->planes[i] + j, &v, sizeof(v));
+      }
+    } else {
+      for (size_t j = 0; j < sizes[i]; ++j) {
+        img->planes[i][j] = (uint8_t)rand();
+      }
+    }
+    img->yuv.planes[i] = img->planes[i];
+  }
+  return eok();
+}
+
+static void image_destroy(struct image *const img) {
+  for (size_t i = 0; i < 3; ++i) {
+    if (img->planes[i]) {
+      ereport(mem_free(&img->planes[i]));
+    }
+  }
+}
+
+static void test_full_range(void) {
+  static uint8_t const y[2] = {0, 255};
+  static uint8_t const u[1] = {0};
+  static uint8_t const v[1] = {255};
+  static uint8_t const want[4] = {16, 16, 235, 240};
+  uint8_t got[4] = {0};
+  pixconv_yuv_to_yuy2(
+      &(struct pixconv_yuv){
+          .layout = pixconv_layout_yuv422p,
+          .full_range = true,
+          .width = 2,
+          .height = 1,
+          .planes = {y, u, v},
+          .strides = {2, 1, 1},
+      },
+      got,
+      4,
+      0,
+      1,
+      pixconv_isa_c);
+  TEST_CHECK(memcmp(got, want, 4) == 0);
+  TEST_MSG("want %d %d %d %d got %d %d %d %d", want[0], want[1], want[2], want[3], got[0], got[1], got[2], got[3]);
+}
+
+static void test_chroma_interpolation(void) {
+  static uint8_t const y[4] = {0, 0, 0, 0};
+  static uint8_t const u[1] = {0};
+  static uint8_t const v[1] = {200};
+  uint8_t got[8] = {0};
+  // A single chroma row is shared by both luma rows.
+  pixconv_yuv_to_yuy2(
+      &(struct pixconv_yuv){
+          .layout = pixconv_layout_yuv420p,
+          .width = 2,
+          .height = 2,
+          .planes = {y, u, v},
+          .strides = {2, 1, 1},
+      },
+      got,
+      4,
+      0,
+      2,
+      pixconv_isa_c);
+  TEST_CHECK(got[1] == 0 && got[3] == 200 && got[5] == 0 && got[7] == 200);
+}
+
+static void test_isa_matches_c(void) {
+  static int const widths[] = {2, 14, 30, 64, 98, 1920};
+  static int const heights[] = {1, 2, 5};
+  enum pixconv_isa const best = pixconv_get_isa();
+  for (int isa = pixconv_isa_sse2; isa <= (int)best; ++isa) {
+    for (int layout = pixconv_layout_yuv420p; layout <= pixconv_layout_nv12; ++layout) {
+      for (int full_range = 0; full_range < 2; ++full_range) {
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+          for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); ++h) {
+            struct image img = {0};
+            uint8_t *want = NULL;
+            uint8_t *got = NULL;
+            ptrdiff_t const stride = widths[w] * 2;
+            size_t const bytes = (size_t)(stride * heights[h]);
+            if (!TEST_SUCCEEDED_F(
+                    image_create(&img, (enum pixconv_layout)layout, full_range != 0, widths[w], heights[h]))) {
+              goto cleanup;
+            }
+            if (!TEST_SUCCEEDED_F(mem(&want, bytes, 1)) || !TEST_SUCCEEDED_F(mem(&got, bytes, 1))) {
+              goto cleanup;
+            }
+            pixconv_yuv_to_yuy2(&img.yuv, want, stride, 0, heights[h], pixconv_isa_c);
+            pixconv_yuv_to_yuy2(&img.yuv, got, stride, 0, heights[h], (enum pixconv_isa)isa);
+            TEST_CHECK(memcmp(want, got, bytes) == 0);
+            TEST_MSG("isa: %d layout: %d full_range: %d width: %d height: %d",
+                     isa,
+                     layout,
+                     full_range,
+                     widths[w],
+                     heights[h]);
+          cleanup:
+            if (got) {
+              ereport(mem_free(&got));
+            }
+            if (want) {
+              ereport(mem_free(&want));
+            }
+            image_destroy(&img);
+          }
+        }
+      }
+    }
+  }
+}
+
+static void test_yc48_range(void) {
+  static uint8_t const y[2] = {16, 235};
+  static uint8_t const u[1] = {16};
+  static uint8_t const v[1] = {240};
+  static int16_t const want[6] = {0, -2048, 2048, 4096, -2048, 2048};
+  int16_t got[6] = {0};
+  pixconv_yuv_to_yc48(
+      &(struct pixconv_yuv){
+          .layout = pixconv_layout_yuv422p,
+          .width = 2,
+          .height = 1,
+          .planes = {y, u, v},
+          .strides = {2, 1, 1},
+      },
+      (uint8_t *)got,
+      12,
+      0,
+      1,
+      pixconv_isa_c);
+  TEST_CHECK(memcmp(got, want, sizeof(want)) == 0);
+  TEST_MSG("want %d %d %d %d %d %d got %d %d %d %d %d %d",
+           want[0],
+           want[1],
+           want[2],
+           want[3],
+           want[4],
+           want[5],
+           got[0],
+           got[1],
+           got[2],
+           got[3],
+           got[4],
+           got[5]);
+}
+
+static void test_yc48_chroma_interpolation(void) {
+  static uint8_t const y[4] = {16, 16, 16, 16};
+  static uint8_t const u[2] = {128, 240};
+  static uint8_t const v[2] = {128, 16};
+  int16_t got[12] = {0};
+  pixconv_yuv_to_yc48(
+      &(struct pixconv_yuv){
+          .layout = pixconv_layout_yuv422p,
+          .width = 4,
+          .height = 1,
+          .planes = {y, u, v},
+          .strides = {4, 2, 2},
+      },
+      (uint8_t *)got,
+      24,
+      0,
+      1,
+      pixconv_isa_c);
+  // The second pixel lies between both chroma samples, the last one repeats the nearest sample.
+  TEST_CHECK(got[1] == 0 && got[4] == 1024 && got[7] == 2048 && got[10] == 2048);
+  TEST_MSG("cb %d %d %d %d", got[1], got[4], got[7], got[10]);
+  TEST_CHECK(got[2] == 0 && got[5] == -1024 && got[8] == -2048 && got[11] == -2048);
+  TEST_MSG("cr %d %d %d %d", got[2], got[5], got[8], got[11]);
+}
+
+static void test_yc48_isa_matches_c(void) {
+  static int const widths[] = {2, 14, 16, 18, 30, 64, 98, 1920};
+  static int const heights[] = {1, 2, 5};
+  enum pixconv_isa const best = pixconv_get_isa();
+  for (int isa = pixconv_isa_sse2; isa <= (int)best; ++isa) {
+    for (int layout = pixconv_layout_yuv420p; layout <= pixconv_layout_nv12; ++layout) {
+      for (int full_range = 0; full_range < 2; ++full_range) {
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+          for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); ++h) {
+            struct image img = {0};
+            uint8_t *want = NULL;
+            uint8_t *got = NULL;
+            ptrdiff_t const stride = widths[w] * 6;
+            size_t const bytes = (size_t)(stride * heights[h]);
+            if (!TEST_SUCCEEDED_F(
+                    image_create(&img, (enum pixconv_layout)layout, full_range != 0, widths[w], heights[h]))) {
+              goto cleanup;
+            }
+            if (!TEST_SUCCEEDED_F(mem(&want, bytes, 1)) || !TEST_SUCCEEDED_F(mem(&got, bytes, 1))) {
+              goto cleanup;
+            }
+            pixconv_yuv_to_yc48(&img.yuv, want, stride, 0, heights[h], pixconv_isa_c);
+            pixconv_yuv_to_yc48(&img.yuv, got, stride, 0, heights[h], (enum pixconv_isa)isa);
+            TEST_CHECK(memcmp(want, got, bytes) == 0);
+            TEST_MSG("isa: %d layout: %d full_range: %d width: %d height: %d",
+                     isa,
+                     layout,
+                     full_range,
+                     widths[w],
+                     heights[h]);
+          cleanup:
+            if (got) {
+              ereport(mem_free(&got));
+            }
+            if (want) {
+              ereport(mem_free(&want));
+            }
+            image_destroy(&img);
+          }
+        }
+      }
+    }
+  }
+}
+
+static void test_10bit_dither(void) {
+  // 514 lies halfway between 8-bit 128 and 129.
+  static uint16_t const y[4] = {514, 514, 514, 514};
+  static uint16_t const u[2] = {514, 514};
+  static uint16_t const v[2] = {514, 514};
+  static uint8_t const want_round[8] = {129, 129, 129, 129, 129, 129, 129, 129};
+  static uint8_t const want_dither[8] = {128, 128, 129, 128, 129, 129, 128, 129};
+  for (int dither = 0; dither < 2; ++dither) {
+    uint8_t got[8] = {0};
+    pixconv_yuv_to_yuy2(
+        &(struct pixconv_yuv){
+            .layout = pixconv_layout_yuv422p10,
+            .dither = dither != 0,
+            .width = 2,
+            .height = 2,
+            .planes = {(uint8_t const *)y, (uint8_t const *)u, (uint8_t const *)v},
+            .strides = {4, 2, 2},
+        },
+        got,
+        4,
+        0,
+        2,
+        pixconv_isa_c);
+    uint8_t const *const want = dither ? want_dither : want_round;
+    TEST_CHECK(memcmp(got, want, 8) == 0);
+    TEST_MSG("dither: %d got %d %d %d %d %d %d %d %d",
+             dither,
+             got[0],
+             got[1],
+             got[2],
+             got[3],
+             got[4],
+             got[5],
+             got[6],
+             got[7]);
+  }
+}
+
+static void test_yc48_10bit_range(void) {
+  static uint16_t const y[2] = {64, 940};
+  static uint16_t const u[1] = {64};
+  static uint16_t const v[1] = {960};
+  static int16_t const want[6] = {0, -2048, 2048, 4096, -2048, 2048};
+  int16_t got[6] = {0};
+  pixconv_yuv_to_yc48(
+      &(struct pixconv_yuv){
+          .layout = pixconv_layout_yuv422p10,
+          .width = 2,
+          .height = 1,
+          .planes = {(uint8_t const *)y, (uint8_t const *)u, (uint8_t const *)v},
+          .strides = {4, 2, 2},
+      },
+      (uint8_t *)got,
+      12,
+      0,
+      1,
+      pixconv_isa_c);
+  TEST_CHECK(memcmp(got, want, sizeof(want)) == 0);
+  TEST_MSG("got %d %d %d %d %d %d", got[0], got[1], got[2], got[3], got[4], got[5]);
+}
+
+static void test_10bit_isa_matches_c(void) {
+  static int const widths[] = {2, 14, 16, 18, 30, 32, 34, 64, 98, 1920};
+  static int const heights[] = {1, 2, 5};
+  enum pixconv_isa const best = pixconv_get_isa();
+  for (int isa = pixconv_isa_sse2; isa <= (int)best; ++isa) {
+    for (int layout = pixconv_layout_yuv420p10; layout <= pixconv_layout_p010; ++layout) {
+      for (int mode = 0; mode < 3; ++mode) {
+        // 0: YUY2, 1: dithered YUY2, 2: YC48
+        bool const yc48 = mode == 2;
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+          for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); ++h) {
+            struct image img = {0};
+            uint8_t *want = NULL;
+            uint8_t *got = NULL;
+            ptrdiff_t const stride = widths[w] * (yc48 ? 6 : 2);
+            size_t const bytes = (size_t)(stride * heights[h]);
+            if (!TEST_SUCCEEDED_F(image_create(&img, (enum pixconv_layout)layout, false, widths[w], heights[h]))) {
+              goto cleanup;
+            }
+            img.yuv.dither = mode == 1;
+            if (!TEST_SUCCEEDED_F(mem(&want, bytes, 1)) || !TEST_SUCCEEDED_F(mem(&got, bytes, 1))) {
+              goto cleanup;
+            }
+            if (yc48) {
+              pixconv_yuv_to_yc48(&img.yuv, want, stride, 0, heights[h], pixconv_isa_c);
+              pixconv_yuv_to_yc48(&img.yuv, got, stride, 0, heights[h], (enum pixconv_isa)isa);
+            } else {
+              pixconv_yuv_to_yuy2(&img.yuv, want, stride, 0, heights[h], pixconv_isa_c);
+              pixconv_yuv_to_yuy2(&img.yuv, got, stride, 0, heights[h], (enum pixconv_isa)isa);
+            }
+            TEST_CHECK(memcmp(want, got, bytes) == 0);
+            TEST_MSG("isa: %d layout: %d mode: %d width: %d height: %d", isa, layout, mode, widths[w], heights[h]);
+          cleanup:
+            if (got) {
+              ereport(mem_free(&got));
+            }
+            if (want) {
+              ereport(mem_free(&want));
+            }
+            image_destroy(&img);
+          }
+        }
+      }
+    }
+  }
+}
+
+static void test_rgb_order(void) {
+  // Every layout holds B = 1, G = 2, R = 3 in two rows, the second row is doubled.
+  static uint8_t const rgb24[2][3] = {{3, 2, 1}, {6, 4, 2}};
+  static uint8_t const rgbx[2][4] = {{3, 2, 1, 255}, {6, 4, 2, 255}};
+  static uint8_t const bgrx[2][4] = {{1, 2, 3, 255}, {2, 4, 6, 255}};
+  static uint8_t const xrgb[2][4] = {{255, 3, 2, 1}, {255, 6, 4, 2}};
+  static uint8_t const xbgr[2][4] = {{255, 1, 2, 3}, {255, 2, 4, 6}};
+  static uint8_t const g[2] = {2, 4};
+  static uint8_t const b[2] = {1, 2};
+  static uint8_t const r[2] = {3, 6};
+  struct pixconv_rgb const srcs[] = {
+      {.layout = pixconv_rgb_layout_rgb24, .planes = {rgb24[0]}, .strides = {3}},
+      {.layout = pixconv_rgb_layout_rgbx, .planes = {rgbx[0]}, .strides = {4}},
+      {.layout = pixconv_rgb_layout_bgrx, .planes = {bgrx[0]}, .strides = {4}},
+      {.layout = pixconv_rgb_layout_xrgb, .planes = {xrgb[0]}, .strides = {4}},
+      {.layout = pixconv_rgb_layout_xbgr, .planes = {xbgr[0]}, .strides = {4}},
+      {.layout = pixconv_rgb_layout_gbrp, .planes = {g, b, r}, .strides = {1, 1, 1}},
+  };
+  // Bottom-up, the second source row comes first.
+  static uint8_t const want[6] = {2, 4, 6, 1, 2, 3};
+  for (size_t i = 0; i < sizeof(srcs) / sizeof(srcs[0]); ++i) {
+    struct pixconv_rgb src = srcs[i];
+    src.width = 1;
+    src.height = 2;
+    uint8_t got[6] = {0};
+    pixconv_rgb_to_bgr24(&src, got + 3, -3, 0, 2, pixconv_isa_c);
+    TEST_CHECK(memcmp(got, want, sizeof(want)) == 0);
+    TEST_MSG("layout: %d got %d %d %d %d %d %d", src.layout, got[0], got[1], got[2], got[3], got[4], got[5]);
+  }
+}
+
+static void test_rgb_isa_matches_c(void) {
+  static int const widths[] = {1, 3, 5, 6, 7, 10, 11, 12, 15, 16, 17, 31, 32, 33, 64, 98, 1920};
+  static int const heights[] = {1, 2, 5};
+  enum pixconv_isa const best = pixconv_get_isa();
+  for (int isa = pixconv_isa_sse2; isa <= (int)best; ++isa) {
+    for (int layout = pixconv_rgb_layout_rgb24; layout <= pixconv_rgb_layout_gbrp; ++layout) {
+      bool const planar = layout == pixconv_rgb_layout_gbrp;
+      ptrdiff_t const bpp = planar ? 1 : (layout == pixconv_rgb_layout_rgb24 ? 3 : 4);
+      for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+        for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); ++h) {
+          uint8_t *planes[3] = {0};
+          uint8_t *want = NULL;
+          uint8_t *got = NULL;
+          ptrdiff_t const stride = widths[w] * 3;
+          size_t const bytes = (size_t)(stride * heights[h]);
+          // Rows are tightly packed so that reads past the end of the last row are caught.
+          struct pixconv_rgb src = {
+              .layout = (enum pixconv_rgb_layout)layout,
+              .width = widths[w],
+              .height = heights[h],
+          };
+          for (size_t i = 0; i < (planar ? 3 : 1); ++i) {
+            size_t const size = (size_t)(widths[w] * bpp * heights[h]);
+            if (!TEST_SUCCEEDED_F(mem(&planes[i], size, 1))) {
+              goto cleanup;
+            }
+            for (size_t j = 0; j < size; ++j) {
+              planes[i][j] = (uint8_t)rand();
+            }
+            src.planes[i] = planes[i];
+            src.strides[i] = widths[w] * bpp;
+          }
+          if (!TEST_SUCCEEDED_F(mem(&want, bytes, 1)) || !TEST_SUCCEEDED_F(mem(&got, bytes, 1))) {
+            goto cleanup;
+          }
+          pixconv_rgb_to_bgr24(&src, want, stride, 0, heights[h], pixconv_isa_c);
+          pixconv_rgb_to_bgr24(&src, got, stride, 0, heights[h], (enum pixconv_isa)isa);
+          TEST_CHECK(memcmp(want, got, bytes) == 0);
+          TEST_MSG("isa: %d layout: %d width: %d height: %d", isa, layout, widths[w], heights[h]);
+        cleanup:
+          if (got) {
+            ereport(mem_free(&got));
+          }
+          if (want) {
+            ereport(mem_free(&want));
+          }
+          for (size_t i = 0; i < 3; ++i) {
+            if (planes[i]) {
+              ereport(mem_free(&planes[i]));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_LIST = {
+    {"test_full_range", test_full_range},
+    {"test_chroma_interpolation", test_chroma_interpolation},
+    {"test_isa_matches_c", test_isa_matches_c},
+    {"test_yc48_range", test_yc48_range},
+    {"test_yc48_chroma_interpolation", test_yc48_chroma_interpolation},
+    {"test_yc48_isa_matches_c", test_yc48_isa_matches_c},
+    {"test_10bit_dither", test_10bit_dither},
+    {"test_yc48_10bit_range", test_yc48_10bit_range},
+    {"test_10bit_isa_matches_c", test_10bit_isa_matches_c},
+    {"test_rgb_order", test_rgb_order},
+    {"test_rgb_isa_matches_c", test_rgb_isa_matches_c},
+    {NULL, NULL},
+};
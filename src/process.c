@@ -6,6 +6,8 @@
 #include "ovutil/str.h"
 #include "ovutil/win32.h"
 
+#include "tpool.h"
+
 #include <stdatomic.h>
 
 struct process {
@@ -49,12 +51,11 @@ struct notifydata {
   void *userdata;
 };
 
-static int call_notify(void *userdata) {
+static void call_notify(void *const userdata) {
   struct notifydata *d = userdata;
   struct notifydata dl = *d;
-  ereport(mem_free(&userdata));
+  ereport(mem_free(&d));
   dl.fn(dl.userdata);
-  return 0;
 }
 
 static int worker(void *userdata) {
@@ -76,13 +77,12 @@ static int worker(void *userdata) {
   }
   d->fn = p->opt.on_terminate;
   d->userdata = p->opt.userdata;
-  thrd_t th;
-  if (thrd_create(&th, call_notify, d) != thrd_success) {
-    ereport(errg(err_unexpected));
+  err = tpool_submit(tpool_priority_foreground, NULL, call_notify, d);
+  if (efailed(err)) {
+    ereport(err);
     ereport(mem_free(&d));
     return 1;
   }
-  thrd_detach(th);
   return 0;
 }
 
@@ -1,5 +1,69 @@
 #include "resampler.h"
 
+#include <string.h>
+
+static bool get_pcmconv_layout(int const format, AVChannelLayout const *const ch, enum pcmconv_layout *const layout) {
+  if (format != AV_SAMPLE_FMT_FLTP) {
+    return false;
+  }
+  if (av_channel_layout_compare(ch, &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO) == 0) {
+    *layout = pcmconv_layout_fltp_stereo;
+    return true;
+  }
+  if (av_channel_layout_compare(ch, &(AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1) == 0 ||
+      av_channel_layout_compare(ch, &(AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1_BACK) == 0) {
+    *layout = pcmconv_layout_fltp_5_1;
+    return true;
+  }
+  return false;
+}
+
+// Sets up the conversion from the input, the samples swresample is holding are discarded.
+static NODISCARD error configure(struct resampler *const r,
+                                 AVChannelLayout const *const ch_layout,
+                                 int const format,
+                                 int const sample_rate) {
+  if (r->ctx) {
+    swr_free(&r->ctx);
+  }
+  int ret = swr_alloc_set_opts2(&r->ctx,
+                                &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO,
+                                resampler_out_sample_format,
+                                r->out_rate,
+#if LIBSWRESAMPLE_VERSION_INT < AV_VERSION_INT(5, 0, 0)
+                                ov_deconster_(ch_layout),
+#else
+                                ch_layout,
+#endif
+                                format,
+                                sample_rate,
+                                0,
+                                NULL);
+  if (ret < 0) {
+    return errffmpeg(ret);
+  }
+  if (r->use_sox) {
+    av_opt_set_int(r->ctx, "engine", SWR_ENGINE_SOXR, 0);
+  }
+  ret = swr_init(r->ctx);
+  if (ret < 0) {
+    return errffmpeg(ret);
+  }
+  av_channel_layout_uninit(&r->in_ch_layout);
+  ret = av_channel_layout_copy(&r->in_ch_layout, ch_layout);
+  if (ret < 0) {
+    return errffmpeg(ret);
+  }
+  r->in_format = format;
+  r->in_sample_rate = sample_rate;
+  // Interleaved 16-bit stereo at the output rate only needs to be copied.
+  r->passthrough = format == resampler_out_sample_format && sample_rate == r->out_rate &&
+                   (av_channel_layout_compare(ch_layout, &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO) == 0 ||
+                    (ch_layout->order == AV_CHANNEL_ORDER_UNSPEC && ch_layout->nb_channels == resampler_out_channels));
+  r->pcmconv = sample_rate == r->out_rate && get_pcmconv_layout(format, ch_layout, &r->pcmconv_layout);
+  return eok();
+}
+
 NODISCARD error resampler_create(struct resampler **const rp, struct resampler_options const *const opt) {
   if (!rp || *rp || !opt || !opt->codecpar || opt->out_rate <= 0) {
     return errg(err_invalid_arugment);
@@ -14,35 +78,18 @@ NODISCARD error resampler_create(struct resampler **const rp, struct resampler_o
       .gcd = gcd(opt->codecpar->sample_rate, opt->out_rate),
       .pos = AV_NOPTS_VALUE,
       .samples = opt->out_rate * resampler_out_channels,
+      .out_rate = opt->out_rate,
+      .use_sox = opt->use_sox,
+      .pcmconv_isa = pcmconv_get_isa(),
   };
   int r = av_samples_alloc(&resampler->buf, NULL, 2, resampler->samples, AV_SAMPLE_FMT_S16, 0);
   if (r < 0) {
     err = errffmpeg(r);
     goto cleanup;
   }
-  r = swr_alloc_set_opts2(&resampler->ctx,
-                          &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO,
-                          resampler_out_sample_format,
-                          opt->out_rate,
-#if LIBSWRESAMPLE_VERSION_INT < AV_VERSION_INT(5, 0, 0)
-                          ov_deconster_(&opt->codecpar->ch_layout),
-#else
-                          &opt->codecpar->ch_layout,
-#endif
-                          opt->codecpar->format,
-                          opt->codecpar->sample_rate,
-                          0,
-                          NULL);
-  if (r < 0) {
-    err = errffmpeg(r);
-    goto cleanup;
-  }
-  if (opt->use_sox) {
-    av_opt_set_int(resampler->ctx, "engine", SWR_ENGINE_SOXR, 0);
-  }
-  r = swr_init(resampler->ctx);
-  if (r < 0) {
-    err = errffmpeg(r);
+  err = configure(resampler, &opt->codecpar->ch_layout, opt->codecpar->format, opt->codecpar->sample_rate);
+  if (efailed(err)) {
+    err = ethru(err);
     goto cleanup;
   }
   *rp = resampler;
@@ -64,8 +111,69 @@ void resampler_destroy(struct resampler **const rp) {
   if (r->buf) {
     av_freep(&r->buf);
   }
+  av_channel_layout_uninit(&r->in_ch_layout);
   ereport(mem_free(rp));
 }
 
+size_t resampler_get_memory_usage(struct resampler const *const r) {
+  if (!r || !r->buf) {
+    return 0;
+  }
+  return (size_t)r->samples * (size_t)resampler_out_sample_size;
+}
+
+NODISCARD error resampler_set_input(struct resampler *const r, AVFrame const *const frame) {
+  if (!r || !frame) {
+    return errg(err_invalid_arugment);
+  }
+  if (!frame->ch_layout.nb_channels || frame->sample_rate <= 0 ||
+      (frame->format == r->in_format && frame->sample_rate == r->in_sample_rate &&
+       av_channel_layout_compare(&frame->ch_layout, &r->in_ch_layout) == 0)) {
+    return eok();
+  }
+  error err = configure(r, &frame->ch_layout, frame->format, frame->sample_rate);
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  return eok();
+}
+
 NODISCARD error resampler_resample(
-    struct resampler *const r, void const *const in, int const in_samples, void *const out, int *const out_samples);
+    struct resampler *const r, void const *const in, int const in_samples, void *const out, int *const out_samples) {
+  if (!r || (!in && in_samples) || in_samples < 0 || !out || !out_samples || *out_samples < 0) {
+    return errg(err_invalid_arugment);
+  }
+  uint8_t const *const *const planes = in;
+  if ((r->passthrough || r->pcmconv) && in_samples > *out_samples) {
+    // swresample keeps what does not fit, so it has to convert everything that follows as well.
+    r->passthrough = false;
+    r->pcmconv = false;
+  }
+  if (r->passthrough || r->pcmconv) {
+    if (in_samples && r->passthrough) {
+      memcpy(out, planes[0], (size_t)(in_samples * resampler_out_sample_size));
+    } else if (in_samples) {
+      float const *ch[6] = {0};
+      for (size_t i = 0; i < 6; ++i) {
+        ch[i] = (void const *)planes[i];
+      }
+      pcmconv_fltp_to_s16(r->pcmconv_layout, ch, out, (size_t)in_samples, r->pcmconv_isa);
+    }
+    *out_samples = in_samples;
+    return eok();
+  }
+  int const r2 = swr_convert(r->ctx,
+                             (uint8_t *[1]){out},
+                             *out_samples,
+#if LIBSWRESAMPLE_VERSION_INT < AV_VERSION_INT(5, 0, 0)
+                             ov_deconster_(planes),
+#else
+                             planes,
+#endif
+                             in_samples);
+  if (r2 < 0) {
+    return errffmpeg(r2);
+  }
+  *out_samples = r2;
+  return eok();
+}
@@ -2,6 +2,7 @@
 
 #include "ffmpeg.h"
 #include "ovbase.h"
+#include "pcmconv.h"
 
 // AviUtl only supports 16-bit.
 // The number of channels is fixed to 2 because it is rarely used with more than 1 or 2 channels.
@@ -28,10 +29,22 @@ static inline struct gcd {
 struct resampler {
   SwrContext *ctx;
   uint8_t *buf;
-  int64_t pos; // sample position in output sample rate
-  int samples; // size of buf in samples
-  int written; // number of samples written to buf
+  int64_t pos;      // sample position in output sample rate
+  int samples;      // size of buf in samples
+  int written;      // number of samples written to buf
+  bool estimated;   // buf was converted at a position estimated from the timestamp
+  bool passthrough; // the input is already in the output format, swresample is skipped
+  // Float stereo and 5.1 at the output rate are converted by pcmconv instead of swresample.
+  bool pcmconv;
+  enum pcmconv_layout pcmconv_layout;
+  enum pcmconv_isa pcmconv_isa;
   struct gcd gcd;
+  // The input the conversion is set up for, see resampler_set_input.
+  AVChannelLayout in_ch_layout;
+  int in_format;
+  int in_sample_rate;
+  int out_rate;
+  bool use_sox;
 };
 
 struct resampler_options {
@@ -42,5 +55,15 @@ struct resampler_options {
 
 NODISCARD error resampler_create(struct resampler **const rp, struct resampler_options const *const opt);
 void resampler_destroy(struct resampler **const rp);
+// Returns the bytes used by the output buffer.
+size_t resampler_get_memory_usage(struct resampler const *const r);
+// Decoders may output another format, layout or sample rate than the stream parameters say.
+// Sets up the conversion again if the frame differs from the input it was set up for,
+// passthrough and pcmconv are only used when the frame itself qualifies for them.
+NODISCARD error resampler_set_input(struct resampler *const r, AVFrame const *const frame);
+// Converts in_samples samples of in, the data pointers of a frame, and writes them to out.
+// *out_samples is the capacity of out on input and the number of samples written on output.
+// If the samples do not fit without swresample, swresample converts them and every following call.
+// in can be NULL to take out the samples swresample is holding.
 NODISCARD error resampler_resample(
     struct resampler *const r, void const *const in, int const in_samples, void *const out, int *const out_samples);
@@ -4,8 +4,11 @@
 #include "ovutil/str.h"
 #include "ovutil/win32.h"
 
+#include <stdlib.h>
+
 #include "audio.h"
 #include "config.h"
+#include "now.h"
 #include "progress.h"
 #include "resampler.h"
 #include "video.h"
@@ -18,6 +21,9 @@ struct stream {
   struct audio *a;
   struct info_video vi;
   struct info_audio ai;
+  struct timespec used_at;
+  // Seconds it took to open the file, an estimate of the cost of opening it again.
+  double open_time;
 };
 
 struct fileid {
@@ -58,6 +64,11 @@ cleanup:
   return r;
 }
 
+// The frames of one file may take a quarter of the memory budget, enforce_budget keeps the total of all files in it.
+static size_t get_framepool_ceiling(struct config const *const config) {
+  return (size_t)config_get_memory_budget(config) * 1024 * 1024 / 4;
+}
+
 static NODISCARD error create_video(struct stream *sp, struct video **v) {
   error err = video_create(v,
                            &(struct video_options){
@@ -65,6 +76,12 @@ static NODISCARD error create_video(struct stream *sp, struct video **v) {
                                .preferred_decoders = config_get_preferred_decoders(sp->config),
                                .num_stream = (size_t)(config_get_number_of_stream(sp->config)),
                                .scaling = config_get_scaling(sp->config),
+                               .convert_bands = config_get_convert_bands(sp->config),
+                               .yc48 = config_get_output_yc48(sp->config),
+                               .dither = config_get_dither(sp->config),
+                               .max_resolution = config_get_max_resolution(sp->config),
+                               .preview = config_get_fast_preview(sp->config),
+                               .framepool_ceiling = get_framepool_ceiling(sp->config),
                            });
   if (efailed(err)) {
     err = ethru(err);
@@ -74,6 +91,15 @@ cleanup:
   return err;
 }
 
+static size_t get_audio_cache_budget(struct config const *const config) {
+  size_t const budget = (size_t)config_get_memory_budget(config) * 1024 * 1024;
+  if (budget) {
+    return budget / 16;
+  }
+  // About 6 minutes of 48kHz stereo.
+  return sizeof(void *) == 4 ? (size_t)16 * 1024 * 1024 : (size_t)64 * 1024 * 1024;
+}
+
 static NODISCARD error create_audio(struct stream *sp, struct audio **a) {
   error err = audio_create(a,
                            &(struct audio_options){
@@ -82,6 +108,9 @@ static NODISCARD error create_audio(struct stream *sp, struct audio **a) {
                                .num_stream = (size_t)(config_get_number_of_stream(sp->config)),
                                .index_mode = config_get_audio_index_mode(sp->config),
                                .sample_rate = config_get_audio_sample_rate(sp->config),
+                               .cache_budget = get_audio_cache_budget(sp->config),
+                               .decode_track = config_get_audio_decode_track(sp->config),
+                               .use_sox = config_get_audio_use_sox(sp->config),
                            });
   if (efailed(err)) {
     err = ethru(err);
@@ -176,6 +205,7 @@ static NODISCARD error stream_create(struct stream **const spp,
       .file = file,
       .config = config,
   };
+  double const started = now();
   err = create_video(sp, &v);
   if (efailed(err)) {
     ereport(err);
@@ -190,6 +220,7 @@ static NODISCARD error stream_create(struct stream **const spp,
   } else {
     audio_get_info(a, &sp->ai);
   }
+  sp->open_time = now() - started;
   if (!v && !a) {
     err = errg(err_fail);
     goto cleanup;
@@ -242,6 +273,20 @@ static void stream_destroy(struct stream **const spp) {
 #endif
 }
 
+static void stream_hibernate(struct stream *const sp, int const idle_seconds) {
+  if (sp && sp->v) {
+    video_hibernate(sp->v, idle_seconds);
+  }
+  if (sp && sp->a) {
+    audio_hibernate(sp->a, idle_seconds);
+  }
+}
+
+// Seconds lost when the stream is destroyed and has to be opened again.
+static double stream_get_reopen_cost(struct stream *const sp) {
+  return sp->open_time + audio_get_index_build_time(sp->a);
+}
+
 static struct info_video const *stream_get_video_info(struct stream const *const sp) { return &sp->vi; }
 
 static struct info_audio const *stream_get_audio_info(struct stream const *const sp) { return &sp->ai; }
@@ -249,7 +294,8 @@ static struct info_audio const *stream_get_audio_info(struct stream const *const
 static NODISCARD error stream_read_video(struct stream *const sp,
                                          int64_t const frame,
                                          void *const buf,
-                                         size_t *const written) {
+                                         size_t *const written,
+                                         bool const saving) {
   if (!sp || !buf) {
     return errg(err_invalid_arugment);
   }
@@ -261,8 +307,9 @@ static NODISCARD error stream_read_video(struct stream *const sp,
       goto cleanup;
     }
   }
+  timespec_get(&sp->used_at, TIME_UTC);
   size_t wr = 0;
-  err = video_read(sp->v, frame, buf, &wr);
+  err = video_read(sp->v, frame, buf, &wr, saving);
   if (efailed(err)) {
     err = ethru(err);
     goto cleanup;
@@ -292,6 +339,7 @@ static NODISCARD error stream_read_audio(struct stream *const sp,
       goto cleanup;
     }
   }
+  timespec_get(&sp->used_at, TIME_UTC);
   int wr = 0;
   err = audio_read(sp->a, rp, start, (int)length, buf, &wr, accurate);
   if (efailed(err)) {
@@ -333,8 +381,46 @@ struct streammap {
   int key_index;
   struct poolitem *pool;
   size_t pool_length;
+  struct timespec swept_at;
+};
+
+struct resampler_usage {
+  struct stream const *stream;
+  size_t bytes;
 };
 
+static bool add_resampler_usage(void const *const item, void *const udata) {
+  struct streamitem const *const si = item;
+  struct resampler_usage *const ru = udata;
+  if (si->stream == ru->stream) {
+    ru->bytes += resampler_get_memory_usage(si->resampler);
+  }
+  return true;
+}
+
+// The resamplers belong to the handles, every handle of the file is counted.
+static void stream_get_memory_usage(struct streammap *const smp,
+                                    struct stream *const sp,
+                                    struct memory_usage *const mu) {
+  mu->video += video_get_memory_usage(sp->v);
+  mu->audio += audio_get_memory_usage(sp->a);
+  mu->index += audio_get_index_memory_usage(sp->a);
+  mu->audio_cache += audio_get_cache_memory_usage(sp->a);
+  struct resampler_usage ru = {.stream = sp};
+  ereport(hmscan(&smp->map, add_resampler_usage, &ru));
+  mu->resampler += ru.bytes;
+}
+
+static size_t sum_memory_usage(struct memory_usage const *const mu) {
+  return mu->video + mu->audio + mu->index + mu->audio_cache + mu->resampler;
+}
+
+static size_t stream_get_total_memory_usage(struct streammap *const smp, struct stream *const sp) {
+  struct memory_usage mu = {0};
+  stream_get_memory_usage(smp, sp, &mu);
+  return sum_memory_usage(&mu);
+}
+
 NODISCARD error streammap_create(struct streammap **smpp) {
   progress_init();
 
@@ -361,16 +447,17 @@ NODISCARD error streammap_create(struct streammap **smpp) {
     goto cleanup;
   }
   if (config_get_handle_manage_mode(smp->config) == chmm_pool) {
+    // The number of closed streams kept is limited by get_pool_budget, this only bounds the scans.
     enum {
-      keep_length = 4,
+      max_pool_length = 32,
     };
-    smp->pool_length = keep_length;
-    err = mem(&smp->pool, keep_length, sizeof(struct poolitem));
+    smp->pool_length = max_pool_length;
+    err = mem(&smp->pool, max_pool_length, sizeof(struct poolitem));
     if (efailed(err)) {
       err = ethru(err);
       goto cleanup;
     }
-    memset(smp->pool, 0, sizeof(struct poolitem) * keep_length);
+    memset(smp->pool, 0, sizeof(struct poolitem) * max_pool_length);
   }
   *smpp = smp;
 #ifndef NDEBUG
@@ -599,6 +686,67 @@ static struct stream *get_stream(struct streammap *const smp, intptr_t const idx
   return si->stream;
 }
 
+static size_t get_pool_budget(struct config const *const config) {
+  size_t const budget = (size_t)config_get_memory_budget(config) * 1024 * 1024;
+  if (budget) {
+    return budget / 4;
+  }
+  return sizeof(void *) == 4 ? (size_t)256 * 1024 * 1024 : (size_t)1024 * 1024 * 1024;
+}
+
+static size_t get_footprint(struct streammap *const smp, struct stream *const sp) {
+  // Even a stream without decoders keeps a file handle and a few allocations.
+  static size_t const min_footprint = 64 * 1024;
+  return stream_get_total_memory_usage(smp, sp) + min_footprint;
+}
+
+// Returns the reopen time saved per byte by keeping the item.
+// Items that have not been used for a while are less likely to be used again.
+static double get_pool_value(struct streammap *const smp,
+                             struct poolitem const *const pi,
+                             struct timespec const *const at) {
+  double const age = (double)(at->tv_sec - pi->used_at.tv_sec) + 1;
+  return stream_get_reopen_cost(pi->stream) / ((double)get_footprint(smp, pi->stream) * age);
+}
+
+static struct poolitem *find_eviction(struct streammap *const smp, struct timespec const *const at) {
+  struct poolitem *found = NULL;
+  double found_value = 0;
+  for (size_t i = 0; i < smp->pool_length; ++i) {
+    if (!smp->pool[i].stream) {
+      continue;
+    }
+    double const value = get_pool_value(smp, smp->pool + i, at);
+    if (!found || value < found_value) {
+      found = smp->pool + i;
+      found_value = value;
+    }
+  }
+  return found;
+}
+
+// Evicts the least valuable items until the kept streams fit in the pool budget.
+static void trim_pool(struct streammap *const smp, struct timespec const *const at) {
+  size_t const budget = get_pool_budget(smp->config);
+  for (;;) {
+    size_t total = 0;
+    for (size_t i = 0; i < smp->pool_length; ++i) {
+      if (smp->pool[i].stream) {
+        total += get_footprint(smp, smp->pool[i].stream);
+      }
+    }
+    if (total <= budget) {
+      break;
+    }
+    struct poolitem *const pi = find_eviction(smp, at);
+    stream_destroy(&pi->stream);
+    *pi = (struct poolitem){0};
+#ifndef NDEBUG
+    OutputDebugStringA("evicted from pool");
+#endif
+  }
+}
+
 static NODISCARD error add_to_pool(struct streammap *const smp, struct stream *sp) {
   struct poolitem fi = {
       .stream = sp,
@@ -612,24 +760,21 @@ static NODISCARD error add_to_pool(struct streammap *const smp, struct stream *s
     goto cleanup;
   }
   struct poolitem *unused = NULL;
-  struct poolitem *oldest = NULL;
   for (size_t i = 0; i < smp->pool_length; ++i) {
-    if (!oldest || isold(&oldest->used_at, &smp->pool[i].used_at)) {
-      oldest = smp->pool + i;
-    }
-    if (!unused && !smp->pool[i].stream) {
+    if (!smp->pool[i].stream) {
       unused = smp->pool + i;
       break;
     }
   }
   if (!unused) {
-    stream_destroy(&oldest->stream);
-    unused = oldest;
+    unused = find_eviction(smp, &fi.used_at);
+    stream_destroy(&unused->stream);
   }
   *unused = fi;
 #ifndef NDEBUG
   OutputDebugStringA("moved to pool");
 #endif
+  trim_pool(smp, &fi.used_at);
 cleanup:
   return err;
 }
@@ -681,13 +826,246 @@ struct info_audio const *streammap_get_audio_info(struct streammap *const smp, i
   return stream_get_audio_info(sp);
 }
 
-NODISCARD error streammap_read_video(
-    struct streammap *const smp, intptr_t const idx, int64_t const frame, void *const buf, size_t *const written) {
+static bool hibernate_item(void const *const item, void *const udata) {
+  struct streamitem const *const si = item;
+  stream_hibernate(si->stream, *(int const *)udata);
+  return true;
+}
+
+struct coldfile {
+  struct stream *stream;
+  // Set for files kept in the handle pool that no handle refers to.
+  struct poolitem *pooled;
+};
+
+struct collect_context {
+  struct coldfile *files;
+  size_t len;
+};
+
+static bool count_item(void const *const item, void *const udata) {
+  (void)item;
+  ++*(size_t *)udata;
+  return true;
+}
+
+static bool collect_item(void const *const item, void *const udata) {
+  struct streamitem const *const si = item;
+  struct collect_context *const cc = udata;
+  for (size_t i = 0; i < cc->len; ++i) {
+    if (cc->files[i].stream == si->stream) {
+      return true;
+    }
+  }
+  cc->files[cc->len++] = (struct coldfile){.stream = si->stream};
+  return true;
+}
+
+static int compare_used_at(void const *const a, void const *const b) {
+  struct coldfile const *const fa = a;
+  struct coldfile const *const fb = b;
+  if (isold(&fa->stream->used_at, &fb->stream->used_at)) {
+    return 1;
+  }
+  if (isold(&fb->stream->used_at, &fa->stream->used_at)) {
+    return -1;
+  }
+  return 0;
+}
+
+// Lists every opened file once, the least recently used first.
+static NODISCARD error collect_files(struct streammap *const smp, struct collect_context *const cc) {
+  size_t n = smp->pool_length;
+  error err = hmscan(&smp->map, count_item, &n);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  if (!n) {
+    goto cleanup;
+  }
+  err = mem(&cc->files, n, sizeof(struct coldfile));
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = hmscan(&smp->map, collect_item, cc);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  for (size_t i = 0; i < smp->pool_length; ++i) {
+    if (smp->pool[i].stream) {
+      cc->files[cc->len++] = (struct coldfile){.stream = smp->pool[i].stream, .pooled = smp->pool + i};
+    }
+  }
+  qsort(cc->files, cc->len, sizeof(struct coldfile), compare_used_at);
+cleanup:
+  return err;
+}
+
+NODISCARD error streammap_get_memory_usage(struct streammap *const smp,
+                                           intptr_t const idx,
+                                           struct memory_usage *const mu) {
+  if (!smp || !mu) {
+    return errg(err_invalid_arugment);
+  }
+  struct streamitem *si = NULL;
+  error err = hmget(&smp->map, &((struct streamitem){.key = idx}), &si);
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  if (!si) {
+    return errg(err_invalid_arugment);
+  }
+  *mu = (struct memory_usage){0};
+  stream_get_memory_usage(smp, si->stream, mu);
+  // The other handles of the file have their own resamplers.
+  mu->resampler = resampler_get_memory_usage(si->resampler);
+  return eok();
+}
+
+NODISCARD error streammap_get_total_memory_usage(struct streammap *const smp, struct memory_usage *const mu) {
+  if (!smp || !mu) {
+    return errg(err_invalid_arugment);
+  }
+  struct collect_context cc = {0};
+  error err = collect_files(smp, &cc);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  *mu = (struct memory_usage){0};
+  for (size_t i = 0; i < cc.len; ++i) {
+    stream_get_memory_usage(smp, cc.files[i].stream, mu);
+  }
+cleanup:
+  if (cc.files) {
+    ereport(mem_free(&cc.files));
+  }
+  return err;
+}
+
+// What is freed when the budget is exceeded, cheaper to restore first.
+enum shed_step {
+  shed_decoders,
+  shed_resamplers,
+  shed_audio_cache,
+  shed_pooled,
+  shed_index,
+  shed_files,
+  shed_steps,
+};
+
+static bool drop_resampler(void const *const item, void *const udata) {
+  struct streamitem *const si = ov_deconster_(item);
+  if (si->stream == udata && si->resampler) {
+    resampler_destroy(&si->resampler);
+  }
+  return true;
+}
+
+static void shed(struct streammap *const smp, struct coldfile *const cf, enum shed_step const step) {
+  struct stream *const sp = cf->stream;
+  if (step == shed_decoders) {
+    stream_hibernate(sp, 0);
+  } else if (step == shed_resamplers) {
+    // The next read of each handle creates its resampler again and seeks.
+    ereport(hmscan(&smp->map, drop_resampler, sp));
+  } else if (step == shed_audio_cache) {
+    audio_drop_cache(sp->a);
+  } else if (step == shed_pooled) {
+    if (cf->pooled) {
+      stream_destroy(&cf->pooled->stream);
+      *cf->pooled = (struct poolitem){0};
+      cf->stream = NULL;
+    }
+  } else if (step == shed_index) {
+    audio_drop_index(sp->a);
+  } else if (step == shed_files) {
+    // The information is kept, the decoders are opened again by the next read.
+    video_destroy(&sp->v);
+    audio_destroy(&sp->a);
+  }
+}
+
+// Frees memory from the least recently used files until the usage fits in the budget.
+// The file being read only loses its idle decoders.
+static void enforce_budget(struct streammap *const smp, struct stream const *const hot) {
+  size_t const budget = (size_t)config_get_memory_budget(smp->config) * 1024 * 1024;
+  if (!budget) {
+    return;
+  }
+  struct collect_context cc = {0};
+  error err = collect_files(smp, &cc);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  size_t total = 0;
+  for (size_t i = 0; i < cc.len; ++i) {
+    total += stream_get_total_memory_usage(smp, cc.files[i].stream);
+  }
+  if (total <= budget) {
+    goto cleanup;
+  }
+#ifndef NDEBUG
+  OutputDebugStringA("memory budget exceeded");
+#endif
+  for (int step = 0; step < shed_steps && total > budget; ++step) {
+    for (size_t i = 0; i < cc.len && total > budget; ++i) {
+      struct coldfile *const cf = cc.files + i;
+      if (!cf->stream || (step != shed_decoders && cf->stream == hot)) {
+        continue;
+      }
+      size_t const before = stream_get_total_memory_usage(smp, cf->stream);
+      shed(smp, cf, (enum shed_step)step);
+      size_t const after = cf->stream ? stream_get_total_memory_usage(smp, cf->stream) : 0;
+      if (after < before) {
+        total -= before - after;
+      }
+    }
+  }
+cleanup:
+  if (cc.files) {
+    ereport(mem_free(&cc.files));
+  }
+  ereport(err);
+}
+
+// Closes idle decoders and enforces the memory budget, at most once per second.
+static void sweep(struct streammap *const smp, struct stream const *const hot) {
+  int idle_timeout = config_get_idle_timeout(smp->config);
+  if (!idle_timeout && !config_get_memory_budget(smp->config)) {
+    return;
+  }
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  if (now.tv_sec == smp->swept_at.tv_sec) {
+    return;
+  }
+  smp->swept_at = now;
+  if (idle_timeout) {
+    ereport(hmscan(&smp->map, hibernate_item, &idle_timeout));
+    for (size_t i = 0; i < smp->pool_length; ++i) {
+      stream_hibernate(smp->pool[i].stream, idle_timeout);
+    }
+  }
+  enforce_budget(smp, hot);
+}
+
+NODISCARD error streammap_read_video(struct streammap *const smp,
+                                     intptr_t const idx,
+                                     int64_t const frame,
+                                     void *const buf,
+                                     size_t *const written,
+                                     bool const saving) {
   struct stream *const sp = get_stream(smp, idx);
   if (!sp) {
     return errg(err_invalid_arugment);
   }
-  return stream_read_video(sp, frame, buf, written);
+  sweep(smp, sp);
+  return stream_read_video(sp, frame, buf, written, saving);
 }
 
 NODISCARD error streammap_read_audio(struct streammap *const smp,
@@ -702,5 +1080,6 @@ NODISCARD error streammap_read_audio(struct streammap *const smp,
   if (!sp) {
     return errg(err_invalid_arugment);
   }
+  sweep(smp, sp);
   return stream_read_audio(sp, rp, start, length, buf, written, accurate);
 }
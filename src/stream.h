@@ -17,8 +17,30 @@ NODISCARD error streammap_free_stream(struct streammap *const smp, intptr_t cons
 struct info_video const *streammap_get_video_info(struct streammap *const smp, intptr_t const idx);
 struct info_audio const *streammap_get_audio_info(struct streammap *const smp, intptr_t const idx);
 
-NODISCARD error streammap_read_video(
-    struct streammap *const smp, intptr_t const idx, int64_t const frame, void *const buf, size_t *const written);
+// Estimated bytes used by a handle.
+// Decoders are measured by their frame buffers and I/O buffers, their internal allocations are not included.
+struct memory_usage {
+  size_t video;
+  size_t audio;
+  size_t index;
+  // Resampled output kept for repeated reads.
+  size_t audio_cache;
+  size_t resampler;
+};
+
+// Handles of the same file share the video, audio and index usage in the handle cache mode.
+NODISCARD error streammap_get_memory_usage(struct streammap *const smp,
+                                           intptr_t const idx,
+                                           struct memory_usage *const mu);
+// Counts every opened file once, including the files kept in the handle pool.
+NODISCARD error streammap_get_total_memory_usage(struct streammap *const smp, struct memory_usage *const mu);
+
+NODISCARD error streammap_read_video(struct streammap *const smp,
+                                     intptr_t const idx,
+                                     int64_t const frame,
+                                     void *const buf,
+                                     size_t *const written,
+                                     bool const saving);
 NODISCARD error streammap_read_audio(struct streammap *const smp,
                                      intptr_t const idx,
                                      int64_t const start,
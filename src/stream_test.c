@@ -0,0 +1,94 @@
+#include "stream.c"
+
+#include "tpool.h"
+
+#ifndef FFMPEGDIR
+#  define FFMPEGDIR L"."
+#endif
+#ifndef TESTDATADIR
+#  define TESTDATADIR L"."
+#endif
+
+static void initdll(void) { SetDllDirectoryW(FFMPEGDIR); }
+#define TEST_MY_INIT initdll()
+#include "ovtest.h"
+
+static bool read_frame(struct streammap *const smp, intptr_t const idx) {
+  struct info_video const *const vi = streammap_get_video_info(smp, idx);
+  if (!TEST_CHECK(vi != NULL)) {
+    return false;
+  }
+  void *buf = NULL;
+  size_t written = 0;
+  bool r = TEST_SUCCEEDED_F(mem(&buf, (size_t)(vi->width * vi->height * vi->bit_depth / 8), 1)) &&
+           TEST_SUCCEEDED_F(streammap_read_video(smp, idx, 0, buf, &written, false));
+  if (buf) {
+    ereport(mem_free(&buf));
+  }
+  return r;
+}
+
+static bool read_samples(struct streammap *const smp, intptr_t const idx) {
+  struct info_audio const *const ai = streammap_get_audio_info(smp, idx);
+  if (!TEST_CHECK(ai != NULL)) {
+    return false;
+  }
+  enum {
+    samples = 4096,
+  };
+  void *buf = NULL;
+  int written = 0;
+  bool r = TEST_SUCCEEDED_F(mem(&buf, samples, (size_t)(ai->channels * ai->bit_depth / 8))) &&
+           TEST_SUCCEEDED_F(streammap_read_audio(smp, idx, 0, samples, buf, &written, true));
+  if (buf) {
+    ereport(mem_free(&buf));
+  }
+  return r;
+}
+
+static void test_memory_usage(void) {
+  struct streammap *smp = NULL;
+  intptr_t idx1 = 0, idx2 = 0;
+  struct memory_usage mu1 = {0}, mu2 = {0}, total = {0};
+  error err = eok();
+  if (!TEST_SUCCEEDED_F(streammap_create(&smp))) {
+    goto cleanup;
+  }
+  if (!TEST_SUCCEEDED_F(streammap_create_stream(smp, TESTDATADIR L"\\15secs.mp4", &idx1)) ||
+      !TEST_SUCCEEDED_F(streammap_create_stream(smp, TESTDATADIR L"\\15secs.mp4", &idx2))) {
+    goto cleanup;
+  }
+  if (!read_frame(smp, idx1) || !read_samples(smp, idx1) || !read_samples(smp, idx2)) {
+    goto cleanup;
+  }
+
+  if (!TEST_SUCCEEDED_F(streammap_get_memory_usage(smp, idx1, &mu1)) ||
+      !TEST_SUCCEEDED_F(streammap_get_memory_usage(smp, idx2, &mu2)) ||
+      !TEST_SUCCEEDED_F(streammap_get_total_memory_usage(smp, &total))) {
+    goto cleanup;
+  }
+  TEST_CHECK(mu1.video > 0);
+  TEST_CHECK(mu1.resampler > 0);
+  TEST_CHECK(mu2.resampler > 0);
+  if (config_get_handle_manage_mode(smp->config) == chmm_cache) {
+    // Both handles refer to the same file, it is counted once in the total.
+    TEST_CHECK(mu1.video == mu2.video);
+    TEST_CHECK(total.video == mu1.video);
+    TEST_MSG("want %zu got %zu", mu1.video, total.video);
+  }
+  // Every handle has its own resampler.
+  TEST_CHECK(total.resampler == mu1.resampler + mu2.resampler);
+  TEST_MSG("want %zu got %zu", mu1.resampler + mu2.resampler, total.resampler);
+
+  err = streammap_get_memory_usage(smp, idx2 + 1, &mu1);
+  TEST_CHECK(eisg(err, err_invalid_arugment));
+  efree(&err);
+cleanup:
+  streammap_destroy(&smp);
+  tpool_exit();
+}
+
+TEST_LIST = {
+    {"test_memory_usage", test_memory_usage},
+    {NULL, NULL},
+};
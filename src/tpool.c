@@ -0,0 +1,358 @@
+#include "tpool.h"
+
+#include <ovutil/win32.h>
+#include <stdatomic.h>
+
+struct task {
+  tpool_func fn;
+  void *userdata;
+  struct tpool_group *group;
+};
+
+// Ring buffer of tasks.
+// The owner worker takes the newest task and other workers steal the oldest one.
+struct deque {
+  struct task *items;
+  size_t head;
+  size_t len;
+  size_t cap;
+};
+
+struct worker {
+  mtx_t mtx;
+  struct deque queues[tpool_priority_max];
+  thrd_t thread;
+};
+
+enum state {
+  state_stopped,
+  state_starting,
+  state_running,
+};
+
+static atomic_int g_state = state_stopped;
+static struct worker *g_workers = NULL;
+static size_t g_num_workers = 0;
+static atomic_size_t g_next_worker = 0;
+static atomic_size_t g_queued = 0;
+static atomic_bool g_exiting = false;
+
+// g_mtx guards the concurrency counters and is used to sleep until g_epoch changes.
+static mtx_t g_mtx;
+static cnd_t g_cnd;
+static atomic_size_t g_epoch = 0;
+static atomic_int g_sleepers = 0;
+static size_t g_running[tpool_priority_max] = {0};
+
+// 1-based index of the worker running on the current thread, 0 for other threads.
+static _Thread_local size_t g_worker_index = 0;
+
+static NODISCARD error deque_push(struct deque *const d, struct task const *const t) {
+  if (d->len == d->cap) {
+    size_t const cap = d->cap ? d->cap * 2 : 16;
+    struct task *items = NULL;
+    error err = mem(&items, cap, sizeof(struct task));
+    if (efailed(err)) {
+      return ethru(err);
+    }
+    for (size_t i = 0; i < d->len; ++i) {
+      items[i] = d->items[(d->head + i) % d->cap];
+    }
+    if (d->items) {
+      ereport(mem_free(&d->items));
+    }
+    d->items = items;
+    d->head = 0;
+    d->cap = cap;
+  }
+  d->items[(d->head + d->len) % d->cap] = *t;
+  ++d->len;
+  return eok();
+}
+
+static bool deque_pop_back(struct deque *const d, struct task *const t) {
+  if (!d->len) {
+    return false;
+  }
+  --d->len;
+  *t = d->items[(d->head + d->len) % d->cap];
+  return true;
+}
+
+static bool deque_pop_front(struct deque *const d, struct task *const t) {
+  if (!d->len) {
+    return false;
+  }
+  *t = d->items[d->head];
+  d->head = (d->head + 1) % d->cap;
+  --d->len;
+  return true;
+}
+
+static void wake_workers(void) {
+  atomic_fetch_add(&g_epoch, 1);
+  if (atomic_load(&g_sleepers)) {
+    mtx_lock(&g_mtx);
+    cnd_broadcast(&g_cnd);
+    mtx_unlock(&g_mtx);
+  }
+}
+
+static bool reserve(enum tpool_priority const priority) {
+  size_t const n = g_num_workers;
+  size_t const max_indexing = n / 2 ? n / 2 : 1;
+  size_t const max_background = n - 1 ? n - 1 : 1;
+  bool ok = true;
+  mtx_lock(&g_mtx);
+  size_t const background = g_running[tpool_priority_prefetch] + g_running[tpool_priority_indexing];
+  switch (priority) {
+  case tpool_priority_foreground:
+    break;
+  case tpool_priority_prefetch:
+    ok = background < max_background;
+    break;
+  case tpool_priority_indexing:
+    ok = background < max_background && g_running[tpool_priority_indexing] < max_indexing;
+    break;
+  case tpool_priority_max:
+    ok = false;
+    break;
+  }
+  if (ok) {
+    ++g_running[priority];
+  }
+  mtx_unlock(&g_mtx);
+  return ok;
+}
+
+// Gives back a slot that was reserved but not used.
+// Nothing became runnable, so waking the workers here would only make idle workers spin.
+static void unreserve(enum tpool_priority const priority) {
+  mtx_lock(&g_mtx);
+  --g_running[priority];
+  mtx_unlock(&g_mtx);
+}
+
+// Gives back the slot of a task that has finished.
+static void release(enum tpool_priority const priority) {
+  unreserve(priority);
+  if (priority != tpool_priority_foreground) {
+    // Tasks that were held back by the concurrency limit may be runnable now.
+    wake_workers();
+  }
+}
+
+static bool take(size_t const self, enum tpool_priority const priority, struct task *const t) {
+  struct worker *const w = g_workers + self;
+  mtx_lock(&w->mtx);
+  bool found = deque_pop_back(&w->queues[priority], t);
+  mtx_unlock(&w->mtx);
+  for (size_t i = 1; !found && i < g_num_workers; ++i) {
+    struct worker *const victim = g_workers + (self + i) % g_num_workers;
+    mtx_lock(&victim->mtx);
+    found = deque_pop_front(&victim->queues[priority], t);
+    mtx_unlock(&victim->mtx);
+  }
+  if (found) {
+    atomic_fetch_sub(&g_queued, 1);
+  }
+  return found;
+}
+
+static void group_done(struct tpool_group *const g) {
+  mtx_lock(&g->mtx);
+  if (--g->pending == 0) {
+    cnd_broadcast(&g->cnd);
+  }
+  mtx_unlock(&g->mtx);
+}
+
+static bool run_task(size_t const self, enum tpool_priority const priority) {
+  if (!reserve(priority)) {
+    return false;
+  }
+  struct task t;
+  if (!take(self, priority, &t)) {
+    unreserve(priority);
+    return false;
+  }
+  t.fn(t.userdata);
+  if (t.group) {
+    group_done(t.group);
+  }
+  release(priority);
+  return true;
+}
+
+static bool run_one(size_t const self) {
+  for (int i = 0; i < tpool_priority_max; ++i) {
+    if (run_task(self, (enum tpool_priority)i)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int worker_main(void *userdata) {
+  size_t const self = (size_t)userdata;
+  g_worker_index = self + 1;
+  for (;;) {
+    size_t const epoch = atomic_load(&g_epoch);
+    if (run_one(self)) {
+      continue;
+    }
+    if (atomic_load(&g_exiting) && atomic_load(&g_queued) == 0) {
+      break;
+    }
+    mtx_lock(&g_mtx);
+    atomic_fetch_add(&g_sleepers, 1);
+    while (atomic_load(&g_epoch) == epoch) {
+      cnd_wait(&g_cnd, &g_mtx);
+    }
+    atomic_fetch_sub(&g_sleepers, 1);
+    mtx_unlock(&g_mtx);
+  }
+  return 0;
+}
+
+static void destroy_workers(size_t const started) {
+  atomic_store(&g_exiting, true);
+  wake_workers();
+  for (size_t i = 0; i < started; ++i) {
+    thrd_join(g_workers[i].thread, NULL);
+  }
+  for (size_t i = 0; i < g_num_workers; ++i) {
+    for (size_t j = 0; j < tpool_priority_max; ++j) {
+      if (g_workers[i].queues[j].items) {
+        ereport(mem_free(&g_workers[i].queues[j].items));
+      }
+    }
+    mtx_destroy(&g_workers[i].mtx);
+  }
+  ereport(mem_free(&g_workers));
+  g_num_workers = 0;
+  cnd_destroy(&g_cnd);
+  mtx_destroy(&g_mtx);
+}
+
+static NODISCARD error start(void) {
+  SYSTEM_INFO si = {0};
+  GetSystemInfo(&si);
+  // At least three workers, otherwise a long foreground task would stall everything else.
+  // With three or more, indexing can use at most n/2 slots out of n-1 background slots,
+  // so an indexer never takes the last slot prefetch can use.
+  size_t const n = si.dwNumberOfProcessors > 3 ? (size_t)si.dwNumberOfProcessors : 3;
+  error err = mem(&g_workers, n, sizeof(struct worker));
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  mtx_init(&g_mtx, mtx_plain);
+  cnd_init(&g_cnd);
+  atomic_store(&g_exiting, false);
+  for (size_t i = 0; i < n; ++i) {
+    g_workers[i] = (struct worker){0};
+    mtx_init(&g_workers[i].mtx, mtx_plain);
+  }
+  g_num_workers = n;
+  for (size_t i = 0; i < n; ++i) {
+    if (thrd_create(&g_workers[i].thread, worker_main, (void *)i) != thrd_success) {
+      destroy_workers(i);
+      return emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("failed to start new thread")));
+    }
+  }
+  return eok();
+}
+
+// Starts the workers on first use, DllMain is not a safe place to create threads.
+static NODISCARD error ensure_started(void) {
+  for (;;) {
+    int st = state_stopped;
+    if (atomic_compare_exchange_strong(&g_state, &st, state_starting)) {
+      error err = start();
+      atomic_store(&g_state, efailed(err) ? state_stopped : state_running);
+      return err;
+    }
+    if (st == state_running) {
+      return eok();
+    }
+    Sleep(0);
+  }
+}
+
+void tpool_group_init(struct tpool_group *const g) {
+  mtx_init(&g->mtx, mtx_plain);
+  cnd_init(&g->cnd);
+  g->pending = 0;
+}
+
+void tpool_group_exit(struct tpool_group *const g) {
+  cnd_destroy(&g->cnd);
+  mtx_destroy(&g->mtx);
+}
+
+void tpool_group_wait(struct tpool_group *const g) {
+  mtx_lock(&g->mtx);
+  while (g->pending) {
+    // A worker runs queued foreground tasks instead of blocking its slot, the tasks it waits for may be among them.
+    // Background tasks are left to the other workers, they could keep it busy long after the group is done.
+    // Other threads only sleep, a task must not run in the middle of whatever their caller is doing.
+    bool ran = false;
+    if (g_worker_index) {
+      mtx_unlock(&g->mtx);
+      ran = run_task(g_worker_index - 1, tpool_priority_foreground);
+      mtx_lock(&g->mtx);
+    }
+    if (!ran && g->pending) {
+      cnd_wait(&g->cnd, &g->mtx);
+    }
+  }
+  mtx_unlock(&g->mtx);
+}
+
+NODISCARD error tpool_submit(enum tpool_priority const priority,
+                             struct tpool_group *const g,
+                             tpool_func const fn,
+                             void *const userdata) {
+  if (priority >= tpool_priority_max || !fn) {
+    return errg(err_invalid_arugment);
+  }
+  error err = ensure_started();
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  // Tasks submitted from a worker stay on it, which keeps related work on the same thread unless stolen.
+  size_t const idx = g_worker_index ? g_worker_index - 1 : atomic_fetch_add(&g_next_worker, 1) % g_num_workers;
+  if (g) {
+    mtx_lock(&g->mtx);
+    ++g->pending;
+    mtx_unlock(&g->mtx);
+  }
+  atomic_fetch_add(&g_queued, 1);
+  struct worker *const w = g_workers + idx;
+  mtx_lock(&w->mtx);
+  err = deque_push(&w->queues[priority],
+                   &(struct task){
+                       .fn = fn,
+                       .userdata = userdata,
+                       .group = g,
+                   });
+  mtx_unlock(&w->mtx);
+  if (efailed(err)) {
+    atomic_fetch_sub(&g_queued, 1);
+    if (g) {
+      group_done(g);
+    }
+    return ethru(err);
+  }
+  wake_workers();
+  return eok();
+}
+
+void tpool_exit(void) {
+  int st = state_running;
+  if (!atomic_compare_exchange_strong(&g_state, &st, state_starting)) {
+    return;
+  }
+  destroy_workers(g_num_workers);
+  atomic_store(&g_state, state_stopped);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ovbase.h"
+#include "ovthreads.h"
+
+// Process-wide thread pool shared by all opened files.
+// Workers are created on the first submission and stopped by tpool_exit.
+
+enum tpool_priority {
+  // Work the user is waiting for.
+  tpool_priority_foreground,
+  // Speculative work such as opening extra decoders.
+  // Never occupies all workers, so foreground work can always start.
+  tpool_priority_prefetch,
+  // Long-running scans. Limited to half of the workers.
+  tpool_priority_indexing,
+  tpool_priority_max,
+};
+
+typedef void (*tpool_func)(void *const userdata);
+
+// Tracks completion of submitted tasks.
+struct tpool_group {
+  mtx_t mtx;
+  cnd_t cnd;
+  size_t pending;
+};
+
+void tpool_group_init(struct tpool_group *const g);
+void tpool_group_exit(struct tpool_group *const g);
+// Waits until all tasks submitted with the group have finished.
+// A worker that waits here runs queued foreground tasks meanwhile, so waiting workers cannot leave
+// the tasks they wait for queued behind them.
+// Must not be called from a task that belongs to the same group.
+void tpool_group_wait(struct tpool_group *const g);
+
+// g can be NULL if completion does not need to be tracked.
+NODISCARD error tpool_submit(enum tpool_priority const priority,
+                             struct tpool_group *const g,
+                             tpool_func const fn,
+                             void *const userdata);
+// Runs all remaining tasks and stops the workers.
+void tpool_exit(void);
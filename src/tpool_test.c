@@ -0,0 +1,110 @@
+#include "tpool.c"
+
+#include "ovtest.h"
+
+struct counter {
+  atomic_int done;
+  atomic_int running;
+  atomic_int peak;
+};
+
+static void count(void *const userdata) {
+  struct counter *const c = userdata;
+  int const running = atomic_fetch_add(&c->running, 1) + 1;
+  int peak = atomic_load(&c->peak);
+  while (peak < running && !atomic_compare_exchange_weak(&c->peak, &peak, running)) {
+  }
+  Sleep(1);
+  atomic_fetch_sub(&c->running, 1);
+  atomic_fetch_add(&c->done, 1);
+}
+
+static void test_group_wait(void) {
+  enum {
+    num_tasks = 100,
+  };
+  struct counter c = {0};
+  struct tpool_group g;
+  tpool_group_init(&g);
+  for (int i = 0; i < num_tasks; ++i) {
+    if (!TEST_SUCCEEDED_F(tpool_submit(tpool_priority_foreground, &g, count, &c))) {
+      break;
+    }
+  }
+  tpool_group_wait(&g);
+  TEST_CHECK(atomic_load(&c.done) == num_tasks);
+  TEST_MSG("want %d got %d", num_tasks, atomic_load(&c.done));
+  tpool_group_exit(&g);
+  tpool_exit();
+}
+
+static void test_priority_limit(void) {
+  struct counter indexing = {0};
+  struct counter prefetch = {0};
+  struct tpool_group g;
+  tpool_group_init(&g);
+  for (int i = 0; i < 64; ++i) {
+    if (!TEST_SUCCEEDED_F(tpool_submit(tpool_priority_indexing, &g, count, &indexing))) {
+      break;
+    }
+    if (!TEST_SUCCEEDED_F(tpool_submit(tpool_priority_prefetch, &g, count, &prefetch))) {
+      break;
+    }
+  }
+  tpool_group_wait(&g);
+  int const max_indexing = g_num_workers / 2 ? (int)(g_num_workers / 2) : 1;
+  int const max_background = g_num_workers - 1 ? (int)(g_num_workers - 1) : 1;
+  TEST_CHECK(atomic_load(&indexing.peak) <= max_indexing);
+  TEST_MSG("want <= %d got %d", max_indexing, atomic_load(&indexing.peak));
+  TEST_CHECK(atomic_load(&prefetch.peak) <= max_background);
+  TEST_MSG("want <= %d got %d", max_background, atomic_load(&prefetch.peak));
+  tpool_group_exit(&g);
+  tpool_exit();
+}
+
+struct nested {
+  struct counter *inner;
+};
+
+// Waits for its own tasks while every worker may be doing the same.
+static void wait_nested(void *const userdata) {
+  struct nested *const n = userdata;
+  struct tpool_group g;
+  tpool_group_init(&g);
+  for (int i = 0; i < 4; ++i) {
+    if (!TEST_SUCCEEDED_F(tpool_submit(tpool_priority_foreground, &g, count, n->inner))) {
+      break;
+    }
+  }
+  tpool_group_wait(&g);
+  tpool_group_exit(&g);
+}
+
+static void test_nested_wait(void) {
+  enum {
+    num_tasks = 64,
+  };
+  struct counter inner = {0};
+  struct nested n = {
+      .inner = &inner,
+  };
+  struct tpool_group g;
+  tpool_group_init(&g);
+  for (int i = 0; i < num_tasks; ++i) {
+    if (!TEST_SUCCEEDED_F(tpool_submit(tpool_priority_foreground, &g, wait_nested, &n))) {
+      break;
+    }
+  }
+  tpool_group_wait(&g);
+  TEST_CHECK(atomic_load(&inner.done) == num_tasks * 4);
+  TEST_MSG("want %d got %d", num_tasks * 4, atomic_load(&inner.done));
+  tpool_group_exit(&g);
+  tpool_exit();
+}
+
+TEST_LIST = {
+    {"test_group_wait", test_group_wait},
+    {"test_priority_limit", test_priority_limit},
+    {"test_nested_wait", test_nested_wait},
+    {NULL, NULL},
+};
@@ -3,9 +3,16 @@
 #include <ovprintf.h>
 #include <ovthreads.h>
 #include <ovutil/win32.h>
+#include <stdatomic.h>
 
+#include <libavutil/imgutils.h>
+
+#include "convert.h"
 #include "ffmpeg.h"
+#include "framepool.h"
 #include "now.h"
+#include "pipeline.h"
+#include "tpool.h"
 
 #define SHOWLOG_VIDEO_GET_INFO 0
 #define SHOWLOG_VIDEO_INIT_BENCH 0
@@ -15,17 +22,30 @@
 #define SHOWLOG_VIDEO_SEEK_SPEED 0
 #define SHOWLOG_VIDEO_FIND_STREAM 0
 #define SHOWLOG_VIDEO_READ 0
+#define SHOWLOG_VIDEO_DECODE_MODE 0
+#define SHOWLOG_VIDEO_HIBERNATE 0
+#define SHOWLOG_VIDEO_PIPELINE 0
 
 // It seems some decoders do not support discard.
 #define ffmpeg_grab_discard ffmpeg_grab
 
 static bool const is_output_yuy2 = true;
 
+// A pool member whose ffmpeg.cctx is NULL is hibernating, it is reopened when a read chooses it.
 struct stream {
   struct ffmpeg_stream ffmpeg;
   int64_t current_gop_intra_pts;
+  // Last use, zero until the first use so that unused members are chosen first.
   struct timespec ts;
+  // Unused members count as idle from the time they were opened.
+  struct timespec opened_at;
+  // Threads counted in g_decoder_threads, always changed through set_thread_count.
+  int thread_count;
   bool eof_reached;
+  bool saving;
+  // The decoder trades quality for speed, see set_decode_mode.
+  bool preview;
+  bool pipelined;
 };
 
 enum status {
@@ -41,13 +61,44 @@ struct video {
 
   struct wstr filepath;
   void *handle;
+  // Kept so that pool members can be opened without probing the decoders again.
+  AVCodec const *codec;
   mtx_t mtx;
-  thrd_t thread;
+  struct tpool_group group;
   enum status status;
+  // number of streams that are opened or being opened.
+  size_t claimed;
 
-  struct SwsContext *sws_context;
+  // Converters for each source size and pixel format seen so far, the decoder may change them mid-stream.
+  struct convert_cache *convert;
+  enum video_format_scaling_algorithm scaling;
+  int convert_bands;
+  bool dither;
+  bool preview;
   int64_t valid_first_pts;
-  bool yuy2;
+  // Output size, it is smaller than the decoded size when max_resolution is set.
+  int width;
+  int height;
+  int src_width;
+  int src_height;
+  int pix_fmt;
+  enum convert_format format;
+
+  // Converts frames of preview decoding with a cheaper scaling algorithm.
+  struct convert_cache *preview_convert;
+
+  // Frame buffers shared by the decoders of all streams.
+  struct framepool *framepool;
+
+  // While exporting sequentially, one stream is lent to the pipeline and is skipped by find_stream.
+  struct pipeline *pipeline;
+  struct convert_cache *pipeline_convert;
+  struct stream *pipeline_stream;
+  int64_t pipeline_pts;
+  int64_t pipeline_window;
+  int pipeline_misses;
+  // Busy time of the pipeline stages summed over every pipeline of this file.
+  struct pipeline_stats pipeline_stats;
 };
 
 static inline int64_t get_start_time(struct stream const *const stream) {
@@ -59,34 +110,108 @@ static inline int64_t frame_to_pts(int64_t const frame, struct stream const *con
          get_start_time(stream);
 }
 
-static size_t scale(struct video *const v, struct stream *stream, void *buf) {
-  int const width = stream->ffmpeg.cctx->width;
-  int const height = stream->ffmpeg.cctx->height;
-  if (v->yuy2) {
-    sws_scale(v->sws_context,
-              (const uint8_t *const *)stream->ffmpeg.frame->data,
-              stream->ffmpeg.frame->linesize,
-              0,
-              height,
-              (uint8_t *[4]){(uint8_t *)buf, NULL, NULL, NULL},
-              (int[4]){width * 2, 0, 0, 0});
-    return (size_t)(width * height * 2);
-  }
-  int const output_linesize = width * 3;
-  sws_scale(v->sws_context,
-            (const uint8_t *const *)stream->ffmpeg.frame->data,
-            stream->ffmpeg.frame->linesize,
-            0,
-            height,
-            (uint8_t *[4]){(uint8_t *)buf + output_linesize * (height - 1), NULL, NULL, NULL},
-            (int[4]){-(output_linesize), 0, 0, 0});
-  return (size_t)(width * height * 3);
+static int get_processor_count(void) {
+  static int count = 0;
+  if (count == 0) {
+    SYSTEM_INFO si = {0};
+    GetSystemInfo(&si);
+    count = si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+  }
+  return count;
+}
+
+// Threads of the opened decoders of every file, so that exporting one file does not oversubscribe
+// the processors while the decoders of other files are open.
+static atomic_int g_decoder_threads = 0;
+
+static void set_thread_count(struct stream *const stream, int const thread_count) {
+  atomic_fetch_add(&g_decoder_threads, thread_count - stream->thread_count);
+  stream->thread_count = thread_count;
+}
+
+// Decoder threads are distributed so that the total across the pool does not exceed the number of processors.
+// Interactive reads seek frequently, so slice threading with a few threads is used to keep the latency low.
+static int get_interactive_thread_count(struct video const *const v) {
+  int const n = get_processor_count() / (int)v->cap;
+  return n < 1 ? 1 : (n > 4 ? 4 : n);
+}
+
+// Export reads are mostly sequential, so frame threading can use all threads not used by other decoders.
+// Members of this file that are not opened yet are counted as interactive streams.
+static int get_export_thread_count(struct video *const v, struct stream const *const stream) {
+  mtx_lock(&v->mtx);
+  size_t const len = v->len;
+  mtx_unlock(&v->mtx);
+  int const used = atomic_load(&g_decoder_threads) - stream->thread_count +
+                   (int)(v->cap - len) * get_interactive_thread_count(v);
+  int const n = get_processor_count() - used;
+  return n < 1 ? 1 : n;
+}
+
+static int get_buffer(AVCodecContext *avctx, AVFrame *frame, int flags) {
+  struct video *const v = avctx->opaque;
+  return framepool_get_buffer2(v->framepool, avctx, frame, flags);
+}
+
+static void install_get_buffer(struct video *const v, AVCodecContext *const cctx) {
+  if (v->framepool) {
+    cctx->opaque = v;
+    cctx->get_buffer2 = get_buffer;
+  }
+}
+
+// Preview decoding is used for interactive reads when it is enabled, saving always gets full quality.
+// It decodes at half resolution if the decoder supports lowres,
+// and skips the loop filter and the IDCT of frames that no other frame refers to.
+static inline bool use_preview(struct video const *const v, bool const saving) { return v->preview && !saving; }
+
+// The decoder is only reopened when the threading or lowres changes, *reopened tells that the caller must seek.
+// The skip flags are read for every frame, so they are changed in place.
+static NODISCARD error set_decode_mode(struct video *const v,
+                                       struct stream *const stream,
+                                       bool const saving,
+                                       bool *const reopened) {
+  int const thread_type = saving ? (FF_THREAD_FRAME | FF_THREAD_SLICE) : FF_THREAD_SLICE;
+  bool const preview = use_preview(v, saving);
+  int const max_lowres = stream->ffmpeg.codec->max_lowres;
+  int const lowres = preview && max_lowres > 0 ? 1 : 0;
+  *reopened = stream->ffmpeg.cctx->thread_type != thread_type || stream->ffmpeg.cctx->lowres != lowres;
+  if (*reopened) {
+    int const thread_count = saving ? get_export_thread_count(v, stream) : get_interactive_thread_count(v);
+    error err = ffmpeg_reopen_codec(&stream->ffmpeg, thread_count, thread_type, lowres);
+    if (efailed(err)) {
+      return ethru(err);
+    }
+    install_get_buffer(v, stream->ffmpeg.cctx);
+    set_thread_count(stream, thread_count);
+    stream->current_gop_intra_pts = AV_NOPTS_VALUE;
+    stream->eof_reached = false;
+  }
+  stream->ffmpeg.cctx->skip_loop_filter = preview ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+  stream->ffmpeg.cctx->skip_idct = preview ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+#if SHOWLOG_VIDEO_DECODE_MODE
+  {
+    char s[256];
+    ov_snprintf(s,
+                256,
+                NULL,
+                "v #%zu decode mode: %s threads: %d lowres: %d reopened: %d",
+                stream - v->streams,
+                saving ? "export" : (preview ? "preview" : "interactive"),
+                stream->thread_count,
+                stream->ffmpeg.cctx->lowres,
+                *reopened);
+    OutputDebugStringA(s);
+  }
+#endif
+  stream->saving = saving;
+  stream->preview = preview;
+  return eok();
 }
 
 static size_t fill_blank(struct video *const v, void *buf) {
-  size_t const bytes =
-      (size_t)(v->streams[0].ffmpeg.cctx->width * v->streams[0].ffmpeg.cctx->height * (v->yuy2 ? 2 : 3));
-  if (v->yuy2) {
+  size_t const bytes = (size_t)(v->width * v->height * convert_get_bit_depth(v->format) / 8);
+  if (v->format == convert_format_yuy2) {
     for (size_t i = 0; i < bytes; i += 2) {
       ((uint8_t *)buf)[i] = 0;
       ((uint8_t *)buf)[i + 1] = 128;
@@ -98,10 +223,11 @@ static size_t fill_blank(struct video *const v, void *buf) {
 }
 
 void video_get_info(struct video const *const v, struct info_video *const vi) {
-  vi->width = v->streams[0].ffmpeg.cctx->width;
-  vi->height = v->streams[0].ffmpeg.cctx->height;
-  vi->bit_depth = v->yuy2 ? 16 : 24;
-  vi->is_rgb = !v->yuy2;
+  vi->width = v->width;
+  vi->height = v->height;
+  vi->bit_depth = convert_get_bit_depth(v->format);
+  vi->is_rgb = v->format == convert_format_bgr24;
+  vi->is_yc48 = v->format == convert_format_yc48;
   vi->frame_rate = v->streams[0].ffmpeg.stream->avg_frame_rate.num;
   vi->frame_scale = v->streams[0].ffmpeg.stream->avg_frame_rate.den;
   vi->frames = av_rescale_q(
@@ -270,38 +396,140 @@ cleanup:
   return err;
 }
 
-static int create_sub_stream(void *userdata) {
+// Pool members are opened concurrently by up to this many tasks per file.
+static size_t const max_parallel_open = 4;
+
+// Opens a pool member for interactive reads, the stream keeps its ts.
+static NODISCARD error open_member(struct video *const v, struct stream *const stream) {
+  int const thread_count = get_interactive_thread_count(v);
+  *stream = (struct stream){
+      .current_gop_intra_pts = AV_NOPTS_VALUE,
+      .ts = stream->ts,
+  };
+  timespec_get(&stream->opened_at, TIME_UTC);
+  error err = ffmpeg_open(&stream->ffmpeg,
+                          &(struct ffmpeg_open_options){
+                              .filepath = v->filepath.ptr,
+                              .handle = v->handle,
+                              .media_type = AVMEDIA_TYPE_VIDEO,
+                              .codec = v->codec,
+                              .try_grab = false,
+                              .thread_count = thread_count,
+                              .thread_type = FF_THREAD_SLICE,
+                          });
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  install_get_buffer(v, stream->ffmpeg.cctx);
+  set_thread_count(stream, thread_count);
+  return eok();
+}
+
+static inline bool is_hibernating(struct stream const *const stream) { return !stream->ffmpeg.cctx; }
+
+static inline bool is_older(struct timespec const *const a, struct timespec const *const b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+void video_hibernate(struct video *const v, int const idle_seconds) {
+  if (!v || idle_seconds < 0 || v->pipeline) {
+    return;
+  }
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  // Pool members may be appended by create_sub_stream meanwhile, so the lock is held until they are closed.
+  mtx_lock(&v->mtx);
+  size_t const len = v->len;
+  // The most recently used member stays open and is moved to the front,
+  // since the information and the seek index are read from streams[0].
+  size_t mru = 0;
+  for (size_t i = 1; i < len; ++i) {
+    if (is_older(&v->streams[mru].ts, &v->streams[i].ts)) {
+      mru = i;
+    }
+  }
+  if (mru) {
+    struct stream const tmp = v->streams[0];
+    v->streams[0] = v->streams[mru];
+    v->streams[mru] = tmp;
+  }
+  size_t closed = 0;
+  for (size_t i = 1; i < len; ++i) {
+    struct stream *const stream = v->streams + i;
+    struct timespec const *const last = is_older(&stream->ts, &stream->opened_at) ? &stream->opened_at : &stream->ts;
+    if (is_hibernating(stream) || now.tv_sec - last->tv_sec < idle_seconds) {
+      continue;
+    }
+    ffmpeg_close(&stream->ffmpeg);
+    set_thread_count(stream, 0);
+    *stream = (struct stream){
+        .current_gop_intra_pts = AV_NOPTS_VALUE,
+        .ts = stream->ts,
+    };
+    ++closed;
+  }
+  mtx_unlock(&v->mtx);
+  if (!closed) {
+    return;
+  }
+  // Frames of the closed decoders have returned to the pool.
+  framepool_trim(v->framepool);
+#if SHOWLOG_VIDEO_HIBERNATE
+  {
+    char s[256];
+    ov_snprintf(s, 256, NULL, "v hibernate: %zu of %zu members closed", closed, len);
+    OutputDebugStringA(s);
+  }
+#endif
+}
+
+size_t video_get_memory_usage(struct video *const v) {
+  if (!v) {
+    return 0;
+  }
+  size_t r = framepool_get_allocated(v->framepool) + framepool_get_unpooled(v->framepool);
+  // Decoders without DR1 allocate their own frames, assume a few frames per thread.
+  size_t frame_size = 0;
+  if (!(v->codec->capabilities & AV_CODEC_CAP_DR1)) {
+    int const sz = av_image_get_buffer_size(v->pix_fmt, v->src_width, v->src_height, 1);
+    frame_size = sz > 0 ? (size_t)sz : 0;
+  }
+  mtx_lock(&v->mtx);
+  for (size_t i = 0; i < v->len; ++i) {
+    struct stream const *const stream = v->streams + i;
+    if (is_hibernating(stream)) {
+      continue;
+    }
+    r += ffmpeg_get_memory_usage(&stream->ffmpeg) + frame_size * (size_t)(stream->ffmpeg.cctx->thread_count + 2);
+  }
+  mtx_unlock(&v->mtx);
+  return r;
+}
+
+static void create_sub_stream(void *const userdata) {
   struct video *const v = userdata;
   for (;;) {
     mtx_lock(&v->mtx);
-    size_t const cap = v->cap;
-    size_t const len = v->len;
-    enum status st = v->status;
+    bool const claimed = v->status != status_closing && v->claimed < v->cap;
+    if (claimed) {
+      ++v->claimed;
+    }
     mtx_unlock(&v->mtx);
-    if (st == status_closing || cap == len) {
+    if (!claimed) {
       break;
     }
-    v->streams[len] = (struct stream){
-        .current_gop_intra_pts = AV_NOPTS_VALUE,
-    };
-    error err = ffmpeg_open(&v->streams[len].ffmpeg,
-                            &(struct ffmpeg_open_options){
-                                .filepath = v->filepath.ptr,
-                                .handle = v->handle,
-                                .media_type = AVMEDIA_TYPE_VIDEO,
-                                .codec = v->streams[0].ffmpeg.codec,
-                                .try_grab = false,
-                            });
+    struct stream stream = {0};
+    error err = open_member(v, &stream);
     if (efailed(err)) {
       err = ethru(err);
       ereport(err);
       break;
     }
+    // find_stream only looks at streams[0..len), so the new member becomes usable as soon as len is updated.
     mtx_lock(&v->mtx);
-    ++v->len;
+    v->streams[v->len++] = stream;
     mtx_unlock(&v->mtx);
   }
-  return 0;
 }
 
 static struct stream *find_stream(struct video *const v, int64_t const pts, bool *const need_seek) {
@@ -310,7 +538,13 @@ static struct stream *find_stream(struct video *const v, int64_t const pts, bool
   mtx_lock(&v->mtx);
   size_t const num_stream = v->len;
   if (v->status == status_nothread && v->cap > 1) {
-    if (thrd_create(&v->thread, create_sub_stream, v) == thrd_success) {
+    size_t const n = v->cap - 1 < max_parallel_open ? v->cap - 1 : max_parallel_open;
+    for (size_t i = 0; i < n; ++i) {
+      error err = tpool_submit(tpool_priority_prefetch, &v->group, create_sub_stream, v);
+      if (efailed(err)) {
+        ereport(err);
+        break;
+      }
       v->status = status_running;
     }
   }
@@ -322,6 +556,9 @@ static struct stream *find_stream(struct video *const v, int64_t const pts, bool
     int64_t dist = INT64_MAX;
     for (size_t i = 0; i < num_stream; ++i) {
       struct stream *const stream = v->streams + i;
+      if (stream->pipelined || is_hibernating(stream)) {
+        continue;
+      }
       if (pts == stream->ffmpeg.frame->pts) {
         stream->ts = ts;
         *need_seek = false;
@@ -359,9 +596,15 @@ static struct stream *find_stream(struct video *const v, int64_t const pts, bool
   }
 
   // find same gop
-  if (avformat_index_get_entries_count(v->streams[0].ffmpeg.stream) > 1) {
-    AVIndexEntry const *const idx =
-        avformat_index_get_entry_from_timestamp(v->streams[0].ffmpeg.stream, pts, AVSEEK_FLAG_BACKWARD);
+  // The demuxer of the pipelined stream may be updating its index, so look up the index on another stream.
+  AVStream *index_stream = NULL;
+  for (size_t i = 0; i < num_stream && !index_stream; ++i) {
+    if (!v->streams[i].pipelined && !is_hibernating(v->streams + i)) {
+      index_stream = v->streams[i].ffmpeg.stream;
+    }
+  }
+  if (index_stream && avformat_index_get_entries_count(index_stream) > 1) {
+    AVIndexEntry const *const idx = avformat_index_get_entry_from_timestamp(index_stream, pts, AVSEEK_FLAG_BACKWARD);
     if (idx) {
       int64_t const gop_intra_pts = idx->timestamp;
       // find nearest stream
@@ -369,7 +612,8 @@ static struct stream *find_stream(struct video *const v, int64_t const pts, bool
       int64_t gap = INT64_MAX;
       for (size_t i = 0; i < num_stream; ++i) {
         struct stream *const stream = v->streams + i;
-        if (stream->current_gop_intra_pts != gop_intra_pts || pts < stream->ffmpeg.frame->pts) {
+        if (stream->pipelined || is_hibernating(stream) || stream->current_gop_intra_pts != gop_intra_pts ||
+            pts < stream->ffmpeg.frame->pts) {
           continue;
         }
         if (nearest == NULL || gap > pts - stream->ffmpeg.frame->pts) {
@@ -391,9 +635,13 @@ static struct stream *find_stream(struct video *const v, int64_t const pts, bool
   }
   // it seems should seek, so we choose stream to use by LRU.
   // but if the frame numbers are very close, avoid seeking.
+  // Hibernating members are the least recently used, so the pool is reopened one member at a time while in use.
   struct stream *oldest = NULL;
   for (size_t i = 0; i < num_stream; ++i) {
     struct stream *const stream = v->streams + i;
+    if (stream->pipelined) {
+      continue;
+    }
     if (oldest == NULL || oldest->ts.tv_sec > stream->ts.tv_sec ||
         (oldest->ts.tv_sec == stream->ts.tv_sec && oldest->ts.tv_nsec > stream->ts.tv_nsec)) {
       oldest = stream;
@@ -409,7 +657,136 @@ static struct stream *find_stream(struct video *const v, int64_t const pts, bool
   return oldest;
 }
 
-NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size_t *written) {
+static NODISCARD error create_convert(struct video *const v, int const sws_flags, struct convert_cache **const ccp);
+static int get_sws_flags(enum video_format_scaling_algorithm const scaling);
+
+static size_t convert_pipeline_frame(void *const userdata, AVFrame const *const frame, void *const dest) {
+  struct video *const v = userdata;
+  size_t const written = convert_cache_frame(v->pipeline_convert, frame, dest);
+  return written ? written : fill_blank(v, dest);
+}
+
+static void stop_pipeline(struct video *const v) {
+  if (!v->pipeline) {
+    return;
+  }
+  struct pipeline_stats st = {0};
+  pipeline_destroy(&v->pipeline, &st);
+  v->pipeline_stats.elapsed += st.elapsed;
+  v->pipeline_stats.demux += st.demux;
+  v->pipeline_stats.decode += st.decode;
+  v->pipeline_stats.convert += st.convert;
+  v->pipeline_stats.frames += st.frames;
+#if SHOWLOG_VIDEO_PIPELINE
+  if (st.elapsed > 0) {
+    char s[256];
+    ov_snprintf(s,
+                256,
+                NULL,
+                "v pipeline frames: %zu elapsed: %0.4fs demux: %0.1f%% decode: %0.1f%% convert: %0.1f%%",
+                st.frames,
+                st.elapsed,
+                st.demux * 100 / st.elapsed,
+                st.decode * 100 / st.elapsed,
+                st.convert * 100 / st.elapsed);
+    OutputDebugStringA(s);
+  }
+#endif
+  // The decoder has been advanced beyond the last frame held by the stream, so it must seek before reuse.
+  struct stream *const stream = v->pipeline_stream;
+  av_frame_unref(stream->ffmpeg.frame);
+  stream->current_gop_intra_pts = AV_NOPTS_VALUE;
+  stream->eof_reached = false;
+  stream->pipelined = false;
+  v->pipeline_stream = NULL;
+  v->pipeline_misses = 0;
+}
+
+// Hands the stream over to the pipeline, decoding continues from the frame that was just returned.
+static NODISCARD error start_pipeline(struct video *const v, struct stream *const stream) {
+  // avg_frame_rate is 0/0 when the demuxer could not tell.
+  // Without any frame rate the window of frames the pipeline may serve is unknown, so the stream keeps decoding.
+  AVRational rate = stream->ffmpeg.stream->avg_frame_rate;
+  if (rate.num <= 0 || rate.den <= 0) {
+    rate = stream->ffmpeg.stream->r_frame_rate;
+    if (rate.num <= 0 || rate.den <= 0) {
+      return eok();
+    }
+  }
+  // A converter cannot be shared between threads, the conversion stage uses its own one.
+  if (!v->pipeline_convert) {
+    error err = create_convert(v, get_sws_flags(v->scaling), &v->pipeline_convert);
+    if (efailed(err)) {
+      return ethru(err);
+    }
+  }
+  error err = pipeline_create(&v->pipeline,
+                              &(struct pipeline_options){
+                                  .ffmpeg = &stream->ffmpeg,
+                                  .frame_size = (size_t)(v->width * v->height * convert_get_bit_depth(v->format) / 8),
+                                  .convert = convert_pipeline_frame,
+                                  .userdata = v,
+                              });
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  stream->pipelined = true;
+  v->pipeline_stream = stream;
+  v->pipeline_pts = stream->ffmpeg.frame->pts;
+  v->pipeline_window = av_rescale_q(15, av_inv_q(stream->ffmpeg.cctx->pkt_timebase), rate);
+  v->pipeline_misses = 0;
+  return eok();
+}
+
+// Serves the request from the pipeline if it is the same or a little ahead of the last returned frame.
+static NODISCARD error
+read_pipeline(struct video *const v, int64_t const target_pts, void *buf, size_t *written, bool *const served) {
+  *served = false;
+  if (target_pts < v->pipeline_pts || target_pts > v->pipeline_pts + v->pipeline_window) {
+    return eok();
+  }
+  for (;;) {
+    struct pipeline_output const *out = NULL;
+    int const r = pipeline_peek(v->pipeline, &out);
+    if (r == AVERROR_EOF) {
+      *written = fill_blank(v, buf);
+      *served = true;
+      return eok();
+    }
+    if (r < 0) {
+      return errffmpeg(r);
+    }
+    if (out->pts >= target_pts) {
+      if (target_pts == v->pipeline_pts && out->pts != target_pts) {
+        // The frame was returned before the pipeline started and it is no longer held.
+        return eok();
+      }
+      memcpy(buf, out->buf, out->written);
+      *written = out->written;
+      v->pipeline_pts = out->pts;
+      *served = true;
+      return eok();
+    }
+    pipeline_pop(v->pipeline);
+  }
+}
+
+// Preview frames use the cheapest scaling algorithm, the caches also absorb the reduced size of lowres frames.
+static struct convert_cache *get_convert(struct video *const v, struct stream const *const stream) {
+  if (!stream->preview || v->scaling == video_format_scaling_algorithm_fast_bilinear) {
+    return v->convert;
+  }
+  if (!v->preview_convert) {
+    error err = create_convert(v, SWS_FAST_BILINEAR, &v->preview_convert);
+    if (efailed(err)) {
+      ereport(err);
+      return v->convert;
+    }
+  }
+  return v->preview_convert;
+}
+
+NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size_t *written, bool const saving) {
   if (!v || !v->streams[0].ffmpeg.stream || !buf || !written) {
     return errg(err_invalid_arugment);
   }
@@ -419,10 +796,38 @@ NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size
     frame = v->valid_first_pts;
   }
 
+  error err = eok();
+  if (v->pipeline) {
+    if (saving) {
+      bool served = false;
+      err = read_pipeline(v, target_pts, buf, written, &served);
+      if (efailed(err)) {
+        ereport(err);
+        err = eok();
+        stop_pipeline(v);
+      } else if (served) {
+        v->pipeline_misses = 0;
+        goto cleanup;
+      } else if (++v->pipeline_misses > 8 || v->len == 1) {
+        // Give up pipelining if the access pattern is no longer sequential.
+        stop_pipeline(v);
+      }
+    } else {
+      stop_pipeline(v);
+    }
+  }
+
   bool need_seek = false;
   struct stream *stream = find_stream(v, target_pts, &need_seek);
+  if (is_hibernating(stream)) {
+    err = open_member(v, stream);
+    if (efailed(err)) {
+      err = ethru(err);
+      goto cleanup;
+    }
+    need_seek = true;
+  }
 
-  error err = eok();
 #if SHOWLOG_VIDEO_READ
   {
     char s[256];
@@ -431,6 +836,18 @@ NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size
   }
 #endif
 
+  if (stream->saving != saving || stream->preview != use_preview(v, saving)) {
+    bool reopened = false;
+    err = set_decode_mode(v, stream, saving, &reopened);
+    if (efailed(err)) {
+      // The previous decoder is still usable.
+      ereport(err);
+      err = eok();
+    } else if (reopened) {
+      need_seek = true;
+    }
+  }
+
   if (need_seek) {
 #if SHOWLOG_VIDEO_READ
     OutputDebugStringA("video_read seek");
@@ -476,7 +893,18 @@ NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size
     OutputDebugStringA(s);
   }
 #endif
-  *written = scale(v, stream, buf);
+  *written = convert_cache_frame(get_convert(v, stream), stream->ffmpeg.frame, buf);
+  if (!*written) {
+    // The decoder switched to a format that cannot be converted.
+    *written = fill_blank(v, buf);
+  }
+  if (saving && !v->pipeline && !need_seek && skip_frames == 1) {
+    // A sequential read during export, the following frames are likely to be requested in order.
+    error err2 = start_pipeline(v, stream);
+    if (efailed(err2)) {
+      ereport(err2);
+    }
+  }
 cleanup:
   if (efailed(err)) {
     *written = fill_blank(v, buf);
@@ -484,16 +912,46 @@ cleanup:
   return err;
 }
 
-static inline struct SwsContext *create_sws_context(struct video *v, enum video_format_scaling_algorithm scaling) {
-  int pix_format = AV_PIX_FMT_BGR24;
-  if (is_output_yuy2) {
-    int const f = v->streams[0].ffmpeg.cctx->pix_fmt;
-    if (f != AV_PIX_FMT_RGB24 && f != AV_PIX_FMT_RGB32 && f != AV_PIX_FMT_RGBA && f != AV_PIX_FMT_BGR0 &&
-        f != AV_PIX_FMT_BGR24 && f != AV_PIX_FMT_ARGB && f != AV_PIX_FMT_ABGR && f != AV_PIX_FMT_GBRP) {
-      pix_format = AV_PIX_FMT_YUYV422;
-      v->yuy2 = true;
-    }
+// Fits the size in a (max_resolution * 16 / 9) x max_resolution box in the same orientation, keeping the aspect ratio.
+// Both sides are rounded to even numbers because YUY2 cannot have an odd width.
+static void fit_size(int const max_resolution, int const width, int const height, int *const w, int *const h) {
+  *w = width;
+  *h = height;
+  if (max_resolution <= 0) {
+    return;
   }
+  bool const landscape = width >= height;
+  int64_t const long_side = landscape ? width : height;
+  int64_t const short_side = landscape ? height : width;
+  int64_t const long_max = (int64_t)max_resolution * 16 / 9;
+  int64_t const short_max = max_resolution;
+  if (long_side <= long_max && short_side <= short_max) {
+    return;
+  }
+  int64_t l = long_max, s = short_max;
+  if (long_max * short_side > short_max * long_side) {
+    l = (long_side * short_max + short_side / 2) / short_side;
+  } else {
+    s = (short_side * long_max + long_side / 2) / long_side;
+  }
+  l = l < 2 ? 2 : (l + 1) & ~(int64_t)1;
+  s = s < 2 ? 2 : (s + 1) & ~(int64_t)1;
+  *w = (int)(landscape ? l : s);
+  *h = (int)(landscape ? s : l);
+}
+
+// RGB sources are passed as BGR24 to avoid a round trip through YUV.
+static enum convert_format choose_format(int const pix_fmt, bool const yc48) {
+  if (!is_output_yuy2 || pix_fmt == AV_PIX_FMT_RGB24 || pix_fmt == AV_PIX_FMT_RGB32 || pix_fmt == AV_PIX_FMT_RGBA ||
+      pix_fmt == AV_PIX_FMT_BGR0 || pix_fmt == AV_PIX_FMT_BGR24 || pix_fmt == AV_PIX_FMT_ARGB ||
+      pix_fmt == AV_PIX_FMT_ABGR || pix_fmt == AV_PIX_FMT_GBRP || pix_fmt == AV_PIX_FMT_RGB0 ||
+      pix_fmt == AV_PIX_FMT_0RGB || pix_fmt == AV_PIX_FMT_0BGR) {
+    return convert_format_bgr24;
+  }
+  return yc48 ? convert_format_yc48 : convert_format_yuy2;
+}
+
+static int get_sws_flags(enum video_format_scaling_algorithm const scaling) {
   int sws_flags = 0;
   switch (scaling) {
   case video_format_scaling_algorithm_fast_bilinear:
@@ -530,31 +988,44 @@ static inline struct SwsContext *create_sws_context(struct video *v, enum video_
     sws_flags |= SWS_SPLINE;
     break;
   }
+  return sws_flags;
+}
+
+static NODISCARD error create_convert(struct video *const v, int const sws_flags, struct convert_cache **const ccp) {
 #if SHOWLOG_VIDEO_GET_INFO
   {
     char s[256];
     ov_snprintf(s,
                 256,
                 NULL,
-                "sws_flags: %d pix_format: %d width: %d height: %d pix_fmt: %d",
+                "sws_flags: %d format: %d src: %dx%d dst: %dx%d pix_fmt: %d bands: %d",
                 sws_flags,
-                pix_format,
-                v->streams[0].ffmpeg.cctx->width,
-                v->streams[0].ffmpeg.cctx->height,
-                v->streams[0].ffmpeg.cctx->pix_fmt);
+                v->format,
+                v->src_width,
+                v->src_height,
+                v->width,
+                v->height,
+                v->pix_fmt,
+                v->convert_bands);
     OutputDebugStringA(s);
   }
 #endif
-  return sws_getContext(v->streams[0].ffmpeg.cctx->width,
-                        v->streams[0].ffmpeg.cctx->height,
-                        v->streams[0].ffmpeg.cctx->pix_fmt,
-                        v->streams[0].ffmpeg.cctx->width,
-                        v->streams[0].ffmpeg.cctx->height,
-                        pix_format,
-                        sws_flags,
-                        NULL,
-                        NULL,
-                        NULL);
+  error err = convert_cache_create(ccp,
+                                   &(struct convert_options){
+                                       .width = v->src_width,
+                                       .height = v->src_height,
+                                       .pix_fmt = v->pix_fmt,
+                                       .dst_width = v->width,
+                                       .dst_height = v->height,
+                                       .format = v->format,
+                                       .sws_flags = sws_flags,
+                                       .bands = v->convert_bands,
+                                       .dither = v->dither,
+                                   });
+  if (efailed(err)) {
+    return ethru(err);
+  }
+  return eok();
 }
 
 void video_destroy(struct video **const vpp) {
@@ -562,22 +1033,27 @@ void video_destroy(struct video **const vpp) {
     return;
   }
   struct video *v = *vpp;
-  if (v->sws_context) {
-    sws_freeContext(v->sws_context);
-  }
+  stop_pipeline(v);
+  convert_cache_destroy(&v->pipeline_convert);
+  convert_cache_destroy(&v->preview_convert);
+  convert_cache_destroy(&v->convert);
   if (v->streams) {
     if (v->status == status_running) {
       mtx_lock(&v->mtx);
       v->status = status_closing;
       mtx_unlock(&v->mtx);
-      thrd_join(v->thread, NULL);
+      tpool_group_wait(&v->group);
     }
     for (size_t i = 0; i < v->len; ++i) {
       ffmpeg_close(&v->streams[i].ffmpeg);
+      set_thread_count(v->streams + i, 0);
     }
     ereport(mem_free(&v->streams));
   }
+  // Frames still referenced elsewhere keep their buffers, the pool is released with the last of them.
+  framepool_destroy(&v->framepool);
   ereport(sfree(&v->filepath));
+  tpool_group_exit(&v->group);
   mtx_destroy(&v->mtx);
   ereport(mem_free(vpp));
 }
@@ -599,6 +1075,7 @@ NODISCARD error video_create(struct video **const vpp, struct video_options cons
       .valid_first_pts = AV_NOPTS_VALUE,
   };
   mtx_init(&v->mtx, mtx_plain);
+  tpool_group_init(&v->group);
 
   if (opt->filepath) {
     err = scpy(&v->filepath, opt->filepath);
@@ -615,9 +1092,21 @@ NODISCARD error video_create(struct video **const vpp, struct video_options cons
   }
   v->cap = cap;
 
+  // A 32-bit process cannot afford to keep as many idle frames as a 64-bit one.
+  size_t const ceiling =
+      opt->framepool_ceiling
+          ? opt->framepool_ceiling
+          : (sizeof(void *) == 4 ? (size_t)256 * 1024 * 1024 : (size_t)1024 * 1024 * 1024);
+  err = framepool_create(&v->framepool, ceiling);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+
 #if SHOWLOG_VIDEO_INIT_BENCH
   double const start = now();
 #endif
+  int const thread_count = get_interactive_thread_count(v);
   v->streams[0] = (struct stream){
       .current_gop_intra_pts = AV_NOPTS_VALUE,
   };
@@ -627,12 +1116,21 @@ NODISCARD error video_create(struct video **const vpp, struct video_options cons
                         .handle = opt->handle,
                         .media_type = AVMEDIA_TYPE_VIDEO,
                         .preferred_decoders = opt->preferred_decoders,
+                        .thread_count = thread_count,
+                        .thread_type = FF_THREAD_SLICE,
                     });
   if (efailed(err)) {
     err = ethru(err);
     goto cleanup;
   }
+  set_thread_count(v->streams + 0, thread_count);
+  timespec_get(&v->streams[0].opened_at, TIME_UTC);
+  v->codec = v->streams[0].ffmpeg.codec;
   v->len = 1;
+  v->claimed = 1;
+  v->src_width = v->streams[0].ffmpeg.cctx->width;
+  v->src_height = v->streams[0].ffmpeg.cctx->height;
+  fit_size(opt->max_resolution, v->src_width, v->src_height, &v->width, &v->height);
 #if SHOWLOG_VIDEO_INIT_BENCH
   {
     double const end = now();
@@ -642,11 +1140,18 @@ NODISCARD error video_create(struct video **const vpp, struct video_options cons
   }
 #endif
 
-  v->sws_context = create_sws_context(v, opt->scaling);
-  if (!v->sws_context) {
-    err = emsg(err_type_generic, err_fail, &native_unmanaged_const(NSTR("sws_getContext failed")));
+  v->scaling = opt->scaling;
+  v->convert_bands = opt->convert_bands;
+  v->dither = opt->dither;
+  v->preview = opt->preview;
+  v->pix_fmt = v->streams[0].ffmpeg.cctx->pix_fmt;
+  v->format = choose_format(v->pix_fmt, opt->yc48);
+  err = create_convert(v, get_sws_flags(v->scaling), &v->convert);
+  if (efailed(err)) {
+    err = ethru(err);
     goto cleanup;
   }
+  install_get_buffer(v, v->streams[0].ffmpeg.cctx);
 
   *vpp = v;
 cleanup:
@@ -25,9 +25,27 @@ struct video_options {
   char const *preferred_decoders;
   size_t num_stream;
   enum video_format_scaling_algorithm scaling;
+  // Number of bands a frame is split into for concurrent conversion, 0 means automatic.
+  int convert_bands;
+  // Outputs YC48 instead of YUY2 for YUV sources.
+  bool yc48;
+  // Uses ordered dithering when 10-bit sources are reduced to YUY2.
+  bool dither;
+  // Scales larger sources down to fit in (max_resolution * 16 / 9) x max_resolution, 0 means no limit.
+  // Portrait sources are fitted in the rotated box.
+  int max_resolution;
+  // Decodes interactive reads at reduced quality, reads for saving always get full quality.
+  bool preview;
+  // Bytes of idle frames the frame pool may keep, 0 uses a default that depends on the address space.
+  size_t framepool_ceiling;
 };
 
 NODISCARD error video_create(struct video **const vpp, struct video_options const *const opt);
 void video_destroy(struct video **const vpp);
-NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size_t *written);
+NODISCARD error video_read(struct video *const v, int64_t frame, void *buf, size_t *written, bool const saving);
+// Closes the decoders that have not been used for idle_seconds to free their memory, 0 closes all of them.
+// The most recently used decoder stays open, closed ones are reopened on the next read that needs them.
+void video_hibernate(struct video *const v, int const idle_seconds);
+// Returns the estimated bytes used by the decoders and their frames.
+size_t video_get_memory_usage(struct video *const v);
 void video_get_info(struct video const *const v, struct info_video *const vi);
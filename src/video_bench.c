@@ -0,0 +1,163 @@
+#include "video.c"
+
+#include <stdio.h>
+
+#ifndef FFMPEGDIR
+#  define FFMPEGDIR L"."
+#endif
+#ifndef TESTDATADIR
+#  define TESTDATADIR L"."
+#endif
+
+static void initdll(void) { SetDllDirectoryW(FFMPEGDIR); }
+#define TEST_MY_INIT initdll()
+#include "ovtest.h"
+
+static NODISCARD error open_video(struct video **const vpp, wchar_t const *const filename, size_t const num_stream) {
+  struct wstr ws = {0};
+  error err = scpym(&ws, TESTDATADIR, L"\\", filename);
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+  err = video_create(vpp,
+                     &(struct video_options){
+                         .filepath = ws.ptr,
+                         .num_stream = num_stream,
+                         .scaling = video_format_scaling_algorithm_fast_bilinear,
+                     });
+  if (efailed(err)) {
+    err = ethru(err);
+    goto cleanup;
+  }
+cleanup:
+  ereport(sfree(&ws));
+  return err;
+}
+
+static void report(char const *const name, size_t const num_stream, int64_t const frames, double const elapsed) {
+  char s[256];
+  ov_snprintf(s,
+              256,
+              NULL,
+              "%s num_stream: %zu frames: %lld elapsed: %0.4fs (%0.2ffps)",
+              name,
+              num_stream,
+              frames,
+              elapsed,
+              (double)frames / elapsed);
+  puts(s);
+}
+
+// Shows where the time went, the busiest stage limits the throughput of the pipeline.
+static void report_pipeline(struct pipeline_stats const *const st) {
+  if (st->elapsed <= 0) {
+    return;
+  }
+  char s[256];
+  ov_snprintf(s,
+              256,
+              NULL,
+              "  pipeline frames: %zu elapsed: %0.4fs demux: %0.1f%% decode: %0.1f%% convert: %0.1f%%",
+              st->frames,
+              st->elapsed,
+              st->demux * 100 / st->elapsed,
+              st->decode * 100 / st->elapsed,
+              st->convert * 100 / st->elapsed);
+  puts(s);
+}
+
+// next_frame returns the frame number to read for the i-th request.
+static void bench_decode(char const *const name,
+                         bool const saving,
+                         int64_t (*next_frame)(int64_t const i, int64_t const frames)) {
+  static size_t const num_streams[] = {1, 4, 8};
+  for (size_t n = 0; n < sizeof(num_streams) / sizeof(num_streams[0]); ++n) {
+    struct video *v = NULL;
+    void *buf = NULL;
+    error err = open_video(&v, L"15secs.mp4", num_streams[n]);
+    if (!TEST_SUCCEEDED_F(err)) {
+      goto cleanup;
+    }
+    struct info_video vi = {0};
+    video_get_info(v, &vi);
+    err = mem(&buf, (size_t)(vi.width * vi.height * 3), 1);
+    if (!TEST_SUCCEEDED_F(err)) {
+      goto cleanup;
+    }
+    double const start = now();
+    for (int64_t i = 0; i < vi.frames; ++i) {
+      size_t written = 0;
+      err = video_read(v, next_frame(i, vi.frames), buf, &written, saving);
+      if (!TEST_SUCCEEDED_F(err)) {
+        goto cleanup;
+      }
+    }
+    report(name, num_streams[n], vi.frames, now() - start);
+    stop_pipeline(v);
+    report_pipeline(&v->pipeline_stats);
+  cleanup:
+    if (buf) {
+      ereport(mem_free(&buf));
+    }
+    video_destroy(&v);
+  }
+}
+
+static int64_t sequential(int64_t const i, int64_t const frames) {
+  (void)frames;
+  return i;
+}
+
+// Emulates timeline scrubbing by jumping back and forth.
+static int64_t scrubbing(int64_t const i, int64_t const frames) { return (i * 37) % frames; }
+
+static void bench_decode_interactive(void) { bench_decode("interactive", false, scrubbing); }
+
+static void bench_decode_export(void) { bench_decode("export", true, sequential); }
+
+// Measures the time until the first stream is usable and until all pool members are opened.
+static void bench_open(void) {
+  static size_t const num_streams[] = {1, 4, 16};
+  for (size_t n = 0; n < sizeof(num_streams) / sizeof(num_streams[0]); ++n) {
+    struct video *v = NULL;
+    void *buf = NULL;
+    double const start = now();
+    error err = open_video(&v, L"15secs.mp4", num_streams[n]);
+    if (!TEST_SUCCEEDED_F(err)) {
+      goto cleanup;
+    }
+    double const first = now() - start;
+    struct info_video vi = {0};
+    video_get_info(v, &vi);
+    err = mem(&buf, (size_t)(vi.width * vi.height * 3), 1);
+    if (!TEST_SUCCEEDED_F(err)) {
+      goto cleanup;
+    }
+    // The first read starts opening the rest of the pool.
+    size_t written = 0;
+    err = video_read(v, 0, buf, &written, false);
+    if (!TEST_SUCCEEDED_F(err)) {
+      goto cleanup;
+    }
+    tpool_group_wait(&v->group);
+    double const all = now() - start;
+    TEST_CHECK(v->len == num_streams[n]);
+    TEST_MSG("want %zu got %zu", num_streams[n], v->len);
+    char s[256];
+    ov_snprintf(s, 256, NULL, "open num_stream: %zu first: %0.4fs all: %0.4fs", num_streams[n], first, all);
+    puts(s);
+  cleanup:
+    if (buf) {
+      ereport(mem_free(&buf));
+    }
+    video_destroy(&v);
+  }
+}
+
+TEST_LIST = {
+    {"bench_open", bench_open},
+    {"bench_decode_interactive", bench_decode_interactive},
+    {"bench_decode_export", bench_decode_export},
+    {NULL, NULL},
+};